@@ -0,0 +1,226 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 09:00:00
+ * @modify date 2026-10-20 09:00:00
+ * @desc [对桩服务器全速压测连接池, 输出queries/s, rows/s和每行的客户端cpu时间]
+ */
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <event2/event.h>
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+#include "mysqlpp_stub_server.h"
+
+enum bench_mode {
+    BENCH_QUERY,    // text protocol
+    BENCH_PREPARE,  // prepare + execute for every request
+    BENCH_PROMOTE   // query() with auto prepare
+};
+
+typedef struct bench_s {
+    bench_mode mode;
+    uint64_t deadline;
+    int running;
+
+    uint64_t queries;
+    uint64_t rows;
+    uint64_t failures;
+    uint64_t last_done;
+} bench_t;
+
+static void issue(mysqlpp_conn *conn, bench_t *b);
+
+static void finish(mysqlpp_conn *conn, bench_t *b) {
+    b->last_done = mysqlpp_conn::now_usec();
+    b->running--;
+
+    conn->close();
+}
+
+static bool query_callback(mysqlpp_conn *conn, void *argument) {
+    bench_t *b = (bench_t *)argument;
+
+    if (conn->failed()) {
+        if (b->failures++ == 0) {
+            fprintf(stderr, "query failed: %s\n", conn->error());
+        }
+
+        finish(conn, b);
+        return true;
+    }
+
+    if (conn->result_eof() || conn->get_column_count() == 0) {
+        b->queries++;
+        issue(conn, b);
+        return true;
+    }
+
+    // touch the row like a real caller would
+    char **row = conn->get_column_content();
+    if (row && row[0]) {
+        b->rows++;
+    }
+
+    return false;
+}
+
+static bool prepare_callback(mysqlpp_conn *conn, void *argument) {
+    bench_t *b = (bench_t *)argument;
+
+    if (conn->failed()) {
+        return query_callback(conn, argument);
+    }
+
+    conn->get_exec_bind()->set_int(1, (int)b->queries);
+
+    conn->set_user_callback(&query_callback);
+    conn->execute();
+
+    return false;
+}
+
+static void issue(mysqlpp_conn *conn, bench_t *b) {
+    if (mysqlpp_conn::now_usec() >= b->deadline) {
+        finish(conn, b);
+        return;
+    }
+
+    if (b->mode == BENCH_PREPARE) {
+        std::string s = "select * from bench where id = ?";
+
+        conn->set_user_callback(&prepare_callback);
+        conn->prepare(s);
+        return;
+    }
+
+    char sql[128];
+    snprintf(sql, sizeof(sql), "select * from bench where id = %llu", (unsigned long long)b->queries);
+
+    std::string s = sql;
+
+    conn->set_user_callback(&query_callback);
+    conn->query(s);
+}
+
+static uint64_t thread_cpu_usec() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-m query|prepare|promote] [-c connections] [-t seconds]\n"
+        "          [-r rows] [-n columns] [-w width] [-l latency_usec]\n", name);
+}
+
+int main(int argc, char **argv) {
+    stub_config_t config;
+    config.rows = 10;
+    config.columns = 4;
+    config.width = 16;
+    config.latency_usec = 0;
+
+    bench_mode mode = BENCH_QUERY;
+    const char *mode_name = "query";
+    int connections = 8;
+    int seconds = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:c:t:r:n:w:l:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            mode_name = optarg;
+            if (strcmp(optarg, "query") == 0) {
+                mode = BENCH_QUERY;
+            } else if (strcmp(optarg, "prepare") == 0) {
+                mode = BENCH_PREPARE;
+            } else if (strcmp(optarg, "promote") == 0) {
+                mode = BENCH_PROMOTE;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c': connections = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'r': config.rows = atoi(optarg); break;
+        case 'n': config.columns = atoi(optarg); break;
+        case 'w': config.width = atoi(optarg); break;
+        case 'l': config.latency_usec = strtoull(optarg, nullptr, 10); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (connections <= 0 || seconds <= 0 || config.rows < 0 || config.columns <= 0 || config.width < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mysqlpp_stub_server server(config);
+    if (!server.start()) {
+        fprintf(stderr, "stub server: %s\n", server.error().c_str());
+        return 1;
+    }
+
+    mysqlpp_pool::init_library(0, nullptr);
+
+    struct event_base *base = event_base_new();
+
+    mysqlpp_pool *pool = new mysqlpp_pool(base, "127.0.0.1", server.get_port(), "bench", "", "bench", connections, connections);
+
+    if (mode == BENCH_PROMOTE) {
+        pool->set_auto_prepare(1);
+    }
+
+    bench_t b;
+    memset(&b, 0, sizeof(b));
+    b.mode = mode;
+    b.running = connections;
+
+    uint64_t start = mysqlpp_conn::now_usec();
+    uint64_t cpu = thread_cpu_usec();
+
+    b.deadline = start + (uint64_t)seconds * 1000000;
+
+    for (int i = 0; i < connections; i++) {
+        mysqlpp_conn *conn = pool->get_connection();
+
+        conn->set_user_argument(&b);
+        issue(conn, &b);
+    }
+
+    event_base_dispatch(base);  // returns when every connection is back in the pool
+
+    cpu = thread_cpu_usec() - cpu;
+
+    double wall = (double)((b.last_done > start ? b.last_done : mysqlpp_conn::now_usec()) - start) / 1e6;
+    const mysqlpp_histogram &total = pool->get_phase_histogram(PHASE_TOTAL);
+
+    printf("mode %s, connections %d, rows %d, columns %d, width %d, latency %llu us\n",
+        mode_name, connections, config.rows, config.columns, config.width, (unsigned long long)config.latency_usec);
+    printf("queries   %llu (%.0f/s), failures %llu\n",
+        (unsigned long long)b.queries, b.queries / wall, (unsigned long long)b.failures);
+    printf("rows      %llu (%.0f/s)\n", (unsigned long long)b.rows, b.rows / wall);
+    printf("cpu       %.3f s client thread, %.3f us/query, %.3f us/row\n",
+        cpu / 1e6, b.queries ? (double)cpu / b.queries : 0.0, b.rows ? (double)cpu / b.rows : 0.0);
+    printf("latency   p50 %llu us, p99 %llu us, max %llu us\n",
+        (unsigned long long)total.percentile(50), (unsigned long long)total.percentile(99),
+        (unsigned long long)total.max());
+
+    delete pool;  // COM_QUIT while the server is still up
+    event_base_free(base);
+
+    server.stop();
+
+    return b.failures ? 1 : 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 10:00:00
+ * @modify date 2026-10-20 10:00:00
+ * @desc [参数绑定/结果取值/文本行处理的微基准, 用合成的列元数据, 不需要server]
+ */
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <benchmark/benchmark.h>
+#include "mysqlpp_conn.h"
+#include "mysqlpp_serialize.h"
+#include "mysqlpp_stmtstats.h"
+
+// 合成的结果: 列名c1..cN, 依次为INT, BIGINT, DOUBLE, VARCHAR循环
+class synthetic_result {
+public:
+    synthetic_result(int columns, int width) : _names(columns) {
+        _fields.resize(columns);
+        memset(&_fields[0], 0, sizeof(MYSQL_FIELD) * columns);
+
+        for (int i = 0; i < columns; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "c%d", i + 1);
+            _names[i] = name;
+
+            _fields[i].name = (char *)_names[i].c_str();
+            _fields[i].name_length = _names[i].size();
+            _fields[i].charsetnr = 33;
+
+            switch (i % 4) {
+            case 0: _fields[i].type = MYSQL_TYPE_LONG; _values.push_back("123456"); break;
+            case 1: _fields[i].type = MYSQL_TYPE_LONGLONG; _values.push_back("1234567890123"); break;
+            case 2: _fields[i].type = MYSQL_TYPE_DOUBLE; _values.push_back("3.14159"); break;
+            default: _fields[i].type = MYSQL_TYPE_VAR_STRING; _values.push_back(std::string(width, 'x')); break;
+            }
+        }
+
+        for (int i = 0; i < columns; i++) {
+            _row.push_back((char *)_values[i].c_str());
+            _lengths.push_back(_values[i].size());
+        }
+
+        _result = new mysqlpp_result(columns, &_fields[0]);
+        load();
+    }
+
+    ~synthetic_result() {
+        delete _result;
+    }
+
+    void load() {
+        for (size_t i = 0; i < _row.size(); i++) {
+            _result->set_value((int)i + 1, _row[i], _lengths[i]);
+        }
+    }
+
+    mysqlpp_result *result() {
+        return _result;
+    }
+
+    MYSQL_FIELD *fields() {
+        return &_fields[0];
+    }
+
+    char **row() {
+        return &_row[0];
+    }
+
+    unsigned long *lengths() {
+        return &_lengths[0];
+    }
+
+    size_t row_bytes() {
+        size_t n = 0;
+        for (size_t i = 0; i < _lengths.size(); i++)
+            n += _lengths[i];
+        return n;
+    }
+
+private:
+    std::vector<std::string> _names;
+    std::vector<std::string> _values;
+    std::vector<MYSQL_FIELD> _fields;
+    std::vector<char *> _row;
+    std::vector<unsigned long> _lengths;
+
+    mysqlpp_result *_result;
+};
+
+static const int bind_params = 16;
+
+static void BM_bind_set_int(benchmark::State &state) {
+    mysqlpp_bind bind(bind_params);
+    int i = 0;
+
+    for (auto _ : state) {
+        bind.set_int(i % bind_params + 1, i);
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_bind_set_int);
+
+static void BM_bind_set_llong(benchmark::State &state) {
+    mysqlpp_bind bind(bind_params);
+    long long i = 0;
+
+    for (auto _ : state) {
+        bind.set_llong((int)(i % bind_params) + 1, i);
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_bind_set_llong);
+
+static void BM_bind_set_double(benchmark::State &state) {
+    mysqlpp_bind bind(bind_params);
+    int i = 0;
+
+    for (auto _ : state) {
+        bind.set_double(i % bind_params + 1, i * 0.5);
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_bind_set_double);
+
+static void BM_bind_set_string(benchmark::State &state) {
+    mysqlpp_bind bind(bind_params);
+    std::string value(state.range(0), 'x');
+    int i = 0;
+
+    for (auto _ : state) {
+        bind.set_string(i % bind_params + 1, value.c_str());
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_bind_set_string)->Arg(8)->Arg(256)->Arg(4096);
+
+static void BM_bind_set_blob(benchmark::State &state) {
+    mysqlpp_bind bind(bind_params);
+    std::string value(256, 'x');
+    int i = 0;
+
+    for (auto _ : state) {
+        bind.set_blob(i % bind_params + 1, value.data(), (int)value.size());
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_bind_set_blob);
+
+static void BM_bind_set_timestamp(benchmark::State &state) {
+    mysqlpp_bind bind(bind_params);
+    time_t t = 1700000000;
+    int i = 0;
+
+    for (auto _ : state) {
+        bind.set_timestamp(i % bind_params + 1, t + i);
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_bind_set_timestamp);
+
+// typed getters on column 1..4: INT, BIGINT, DOUBLE, VARCHAR
+static void BM_result_get_string(benchmark::State &state) {
+    synthetic_result r(4, (int)state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_string(4));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_string)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_result_get_int(benchmark::State &state) {
+    synthetic_result r(4, 16);
+    bool is_null = false;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_int(1, is_null));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_int);
+
+static void BM_result_get_llong(benchmark::State &state) {
+    synthetic_result r(4, 16);
+    bool is_null = false;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_llong(2, is_null));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_llong);
+
+static void BM_result_get_double(benchmark::State &state) {
+    synthetic_result r(4, 16);
+    bool is_null = false;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_double(3, is_null));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_double);
+
+static void BM_result_get_blob(benchmark::State &state) {
+    synthetic_result r(4, 256);
+    int size = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_blob(4, size));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_blob);
+
+// by name on the last column: get_index is a linear scan
+static void BM_result_get_int_by_name(benchmark::State &state) {
+    int columns = (int)state.range(0);
+    synthetic_result r(columns, 16);
+    bool is_null = false;
+
+    char name[16];
+    snprintf(name, sizeof(name), "c%d", (columns - 1) / 4 * 4 + 1);  // last INT column
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_int_by_name(name, is_null));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_int_by_name)->Arg(4)->Arg(16)->Arg(64);
+
+static void BM_result_get_index(benchmark::State &state) {
+    int columns = (int)state.range(0);
+    synthetic_result r(columns, 16);
+
+    char name[16];
+    snprintf(name, sizeof(name), "c%d", columns);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r.result()->get_index(name));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_result_get_index)->Arg(4)->Arg(16)->Arg(64);
+
+// a whole row read through the typed getters, what a typical row callback does
+static void BM_result_read_row(benchmark::State &state) {
+    int columns = (int)state.range(0);
+    synthetic_result r(columns, 16);
+    bool is_null = false;
+
+    for (auto _ : state) {
+        r.load();
+
+        for (int i = 1; i <= columns; i++) {
+            switch ((i - 1) % 4) {
+            case 0: benchmark::DoNotOptimize(r.result()->get_int(i, is_null)); break;
+            case 1: benchmark::DoNotOptimize(r.result()->get_llong(i, is_null)); break;
+            case 2: benchmark::DoNotOptimize(r.result()->get_double(i, is_null)); break;
+            default: benchmark::DoNotOptimize(r.result()->get_string(i)); break;
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * columns);
+    state.SetBytesProcessed(state.iterations() * r.row_bytes());
+}
+BENCHMARK(BM_result_read_row)->Arg(4)->Arg(16);
+
+// text protocol rows through the serializers
+static void serialize_rows(benchmark::State &state, serialize_format format) {
+    int columns = (int)state.range(0);
+    synthetic_result r(columns, 32);
+    mysqlpp_serializer s(format);
+
+    s.begin(r.fields(), columns);
+
+    for (auto _ : state) {
+        s.add_row(r.row(), r.lengths());
+
+        if (s.size() > (1 << 20)) {
+            s.clear();
+        }
+    }
+
+    s.end();
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * r.row_bytes());
+}
+
+static void BM_text_row_json_array(benchmark::State &state) {
+    serialize_rows(state, SERIALIZE_JSON_ARRAY);
+}
+BENCHMARK(BM_text_row_json_array)->Arg(4)->Arg(16);
+
+static void BM_text_row_json_object(benchmark::State &state) {
+    serialize_rows(state, SERIALIZE_JSON_OBJECT);
+}
+BENCHMARK(BM_text_row_json_object)->Arg(4)->Arg(16);
+
+static void BM_text_row_csv(benchmark::State &state) {
+    serialize_rows(state, SERIALIZE_CSV);
+}
+BENCHMARK(BM_text_row_csv)->Arg(4)->Arg(16);
+
+// per statement work on the query path when statement stats or auto prepare is on
+static const char bench_sql[] =
+    "SELECT id, name, created FROM orders WHERE user_id = 123456 AND status IN ('paid', 'shipped', 'done') "
+    "AND created > '2026-01-01 00:00:00' ORDER BY created DESC LIMIT 20";
+
+static void BM_sql_fingerprint(benchmark::State &state) {
+    std::string normalized;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mysqlpp_stmt_stats::fingerprint(bench_sql, sizeof(bench_sql) - 1, normalized));
+    }
+
+    state.SetBytesProcessed(state.iterations() * (sizeof(bench_sql) - 1));
+}
+BENCHMARK(BM_sql_fingerprint);
+
+static void BM_sql_parameterize(benchmark::State &state) {
+    std::string shape;
+    std::vector<stmt_literal_t> literals;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mysqlpp_stmt_stats::parameterize(bench_sql, sizeof(bench_sql) - 1, shape, literals));
+    }
+
+    state.SetBytesProcessed(state.iterations() * (sizeof(bench_sql) - 1));
+}
+BENCHMARK(BM_sql_parameterize);
+
+BENCHMARK_MAIN();
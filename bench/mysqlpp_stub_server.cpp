@@ -0,0 +1,520 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 09:00:00
+ * @modify date 2026-10-20 09:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_stub_server.h"
+#include <algorithm>
+#include <map>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+enum {
+    COM_QUIT = 0x01,
+    COM_INIT_DB = 0x02,
+    COM_QUERY = 0x03,
+    COM_PING = 0x0e,
+    COM_STMT_PREPARE = 0x16,
+    COM_STMT_EXECUTE = 0x17,
+    COM_STMT_CLOSE = 0x19,
+    COM_STMT_RESET = 0x1a,
+    COM_RESET_CONNECTION = 0x1f
+};
+
+static const uint32_t stub_capabilities =
+    0x00000001 |  // CLIENT_LONG_PASSWORD, also tells MariaDB clients this is not a MariaDB server
+    0x00000004 |  // CLIENT_LONG_FLAG
+    0x00000008 |  // CLIENT_CONNECT_WITH_DB
+    0x00000200 |  // CLIENT_PROTOCOL_41
+    0x00002000 |  // CLIENT_TRANSACTIONS
+    0x00008000 |  // CLIENT_SECURE_CONNECTION
+    0x00020000 |  // CLIENT_MULTI_RESULTS
+    0x00040000 |  // CLIENT_PS_MULTI_RESULTS
+    0x00080000;   // CLIENT_PLUGIN_AUTH
+
+static const uint16_t stub_status = 0x0002;  // SERVER_STATUS_AUTOCOMMIT
+static const uint8_t stub_charset = 33;      // utf8_general_ci
+static const uint8_t type_var_string = 0xfd;
+
+static inline void put_int(std::string &s, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        s.push_back((char)(v >> (8 * i)));
+    }
+}
+
+static inline void put_lenenc(std::string &s, uint64_t v) {
+    if (v < 251) {
+        s.push_back((char)v);
+    } else if (v < 0x10000) {
+        s.push_back((char)0xfc);
+        put_int(s, v, 2);
+    } else if (v < 0x1000000) {
+        s.push_back((char)0xfd);
+        put_int(s, v, 3);
+    } else {
+        s.push_back((char)0xfe);
+        put_int(s, v, 8);
+    }
+}
+
+static inline void put_lenenc_str(std::string &s, const std::string &v) {
+    put_lenenc(s, v.size());
+    s.append(v);
+}
+
+// 跳过前导空白和注释之后是否为SELECT
+static bool is_select(const std::string &sql) {
+    size_t i = 0;
+
+    while (i < sql.size()) {
+        if (isspace((unsigned char)sql[i])) {
+            i++;
+        } else if (sql.compare(i, 2, "/*") == 0) {
+            size_t e = sql.find("*/", i + 2);
+            i = e == std::string::npos ? sql.size() : e + 2;
+        } else {
+            break;
+        }
+    }
+
+    return sql.size() - i >= 6 && strncasecmp(sql.c_str() + i, "select", 6) == 0;
+}
+
+static int count_params(const std::string &sql) {
+    int n = 0;
+    char quote = 0;
+
+    for (size_t i = 0; i < sql.size(); i++) {
+        char c = sql[i];
+
+        if (quote) {
+            if (c == '\\') {
+                i++;
+            } else if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"' || c == '`') {
+            quote = c;
+        } else if (c == '?') {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+// 一个客户端连接上的包读写, 响应先写到缓冲区, 每个命令只flush一次
+class stub_session {
+public:
+    stub_session(int fd) : _fd(fd), _seq(0), _pos(0) {
+    }
+
+    bool read_packet(std::string &payload) {
+        for (;;) {
+            if (_in.size() - _pos >= 4) {
+                const unsigned char *h = (const unsigned char *)_in.data() + _pos;
+                size_t len = h[0] | (h[1] << 8) | (h[2] << 16);
+
+                if (_in.size() - _pos >= 4 + len) {
+                    _seq = h[3] + 1;
+                    payload.assign(_in, _pos + 4, len);
+                    _pos += 4 + len;
+                    return true;
+                }
+            }
+
+            if (_pos) {
+                _in.erase(0, _pos);
+                _pos = 0;
+            }
+
+            char buf[16384];
+            ssize_t n = ::recv(_fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            _in.append(buf, n);
+        }
+    }
+
+    void packet(const std::string &payload) {
+        packet(payload.data(), payload.size());
+    }
+
+    void packet(const char *data, size_t len) {
+        put_int(_out, len, 3);
+        _out.push_back((char)_seq++);
+        _out.append(data, len);
+    }
+
+    void ok(uint64_t affected) {
+        std::string p;
+
+        p.push_back(0x00);
+        put_lenenc(p, affected);
+        put_lenenc(p, 0);  // insert id
+        put_int(p, stub_status, 2);
+        put_int(p, 0, 2);  // warnings
+
+        packet(p);
+    }
+
+    void eof() {
+        char p[5] = {(char)0xfe, 0, 0, (char)(stub_status & 0xff), (char)(stub_status >> 8)};
+
+        packet(p, sizeof(p));
+    }
+
+    void err(uint16_t code, const char *message) {
+        std::string p;
+
+        p.push_back((char)0xff);
+        put_int(p, code, 2);
+        p.append("#HY000");
+        p.append(message);
+
+        packet(p);
+    }
+
+    void columns(int count, int width) {
+        for (int i = 0; i < count; i++) {
+            std::string p;
+            char name[16];
+
+            snprintf(name, sizeof(name), "c%d", i + 1);
+
+            put_lenenc_str(p, "def");
+            put_lenenc_str(p, "bench");
+            put_lenenc_str(p, "t");
+            put_lenenc_str(p, "t");
+            put_lenenc_str(p, name);
+            put_lenenc_str(p, name);
+            p.push_back(0x0c);
+            put_int(p, stub_charset, 2);
+            put_int(p, width * 3, 4);
+            p.push_back((char)type_var_string);
+            put_int(p, 0, 2);  // flags
+            p.push_back(0);    // decimals
+            put_int(p, 0, 2);
+
+            packet(p);
+        }
+
+        eof();
+    }
+
+    bool flush() {
+        size_t off = 0;
+
+        while (off < _out.size()) {
+            ssize_t n = ::send(_fd, _out.data() + off, _out.size() - off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                _out.clear();
+                return false;
+            }
+            off += n;
+        }
+
+        _out.clear();
+        return true;
+    }
+
+private:
+    int _fd;
+    uint8_t _seq;
+
+    std::string _in;
+    size_t _pos;
+    std::string _out;
+};
+
+typedef struct stub_stmt_s {
+    int params;
+    int columns;
+} stub_stmt_t;
+
+mysqlpp_stub_server::mysqlpp_stub_server(const stub_config_t &config)
+    : _config(config),
+      _listen_fd(-1),
+      _port(0),
+      _stopping(false),
+      _commands(0) {
+}
+
+mysqlpp_stub_server::~mysqlpp_stub_server() {
+    stop();
+}
+
+void mysqlpp_stub_server::build_rows() {
+    std::string cell(_config.width, 'x');
+
+    _text_row.clear();
+    for (int i = 0; i < _config.columns; i++) {
+        put_lenenc_str(_text_row, cell);
+    }
+
+    // header, null bitmap with 2 bits offset, then values
+    _binary_row.assign(1 + (_config.columns + 7 + 2) / 8, '\0');
+    for (int i = 0; i < _config.columns; i++) {
+        put_lenenc_str(_binary_row, cell);
+    }
+}
+
+bool mysqlpp_stub_server::start(int port) {
+    build_rows();
+
+    _listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen_fd < 0) {
+        _error = std::string("socket: ") + strerror(errno);
+        return false;
+    }
+
+    int on = 1;
+    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (::bind(_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(_listen_fd, 128) != 0) {
+        _error = std::string("bind: ") + strerror(errno);
+        ::close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(_listen_fd, (struct sockaddr *)&addr, &len);
+    _port = ntohs(addr.sin_port);
+
+    _acceptor = std::thread(&mysqlpp_stub_server::accept_loop, this);
+
+    return true;
+}
+
+void mysqlpp_stub_server::stop() {
+    if (_listen_fd < 0) {
+        return;
+    }
+
+    _stopping = true;
+
+    ::shutdown(_listen_fd, SHUT_RDWR);
+    _acceptor.join();
+
+    ::close(_listen_fd);
+    _listen_fd = -1;
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (size_t i = 0; i < _fds.size(); i++) {
+            ::shutdown(_fds[i], SHUT_RDWR);
+        }
+    }
+
+    for (size_t i = 0; i < _sessions.size(); i++) {
+        _sessions[i].join();
+    }
+
+    _sessions.clear();
+}
+
+void mysqlpp_stub_server::accept_loop() {
+    while (!_stopping) {
+        int fd = ::accept(_listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        std::lock_guard<std::mutex> guard(_lock);
+        _fds.push_back(fd);
+        _sessions.push_back(std::thread(&mysqlpp_stub_server::session, this, fd));
+    }
+}
+
+void mysqlpp_stub_server::session(int fd) {
+    static uint32_t next_id = 1;  // connection id, only for show
+
+    stub_session s(fd);
+    std::string p;
+
+    // Protocol::HandshakeV10, auth data is fixed, any password is accepted
+    const char scramble[21] = "0123456789abcdefghij";
+
+    p.push_back(10);
+    p.append("5.7.99-mysqlpp-stub");
+    p.push_back('\0');
+    put_int(p, __sync_fetch_and_add(&next_id, 1), 4);
+    p.append(scramble, 8);
+    p.push_back('\0');
+    put_int(p, stub_capabilities & 0xffff, 2);
+    p.push_back((char)stub_charset);
+    put_int(p, stub_status, 2);
+    put_int(p, stub_capabilities >> 16, 2);
+    p.push_back(21);
+    p.append(10, '\0');
+    p.append(scramble + 8, 12);
+    p.push_back('\0');
+    p.append("mysql_native_password");
+    p.push_back('\0');
+
+    s.packet(p);
+
+    bool alive = s.flush() && s.read_packet(p);
+    if (alive) {
+        s.ok(0);
+        alive = s.flush();
+    }
+
+    std::map<uint32_t, stub_stmt_t> stmts;
+    uint32_t next_stmt = 1;
+
+    while (alive && s.read_packet(p)) {
+        if (p.empty()) {
+            break;
+        }
+
+        _commands.fetch_add(1, std::memory_order_relaxed);
+
+        unsigned char cmd = (unsigned char)p[0];
+
+        if (cmd == COM_QUIT) {
+            break;
+        }
+
+        if (cmd == COM_STMT_CLOSE) {
+            if (p.size() >= 5) {
+                uint32_t id;
+                memcpy(&id, p.data() + 1, 4);
+                stmts.erase(id);
+            }
+            continue;  // no response
+        }
+
+        if (_config.latency_usec && (cmd == COM_QUERY || cmd == COM_STMT_EXECUTE)) {
+            usleep(_config.latency_usec);
+        }
+
+        switch (cmd) {
+        case COM_QUERY: {
+            std::string sql(p, 1);
+
+            if (!is_select(sql)) {
+                s.ok(1);
+                break;
+            }
+
+            std::string n;
+            put_lenenc(n, _config.columns);
+            s.packet(n);
+            s.columns(_config.columns, _config.width);
+
+            for (int i = 0; i < _config.rows; i++) {
+                s.packet(_text_row);
+            }
+
+            s.eof();
+            break;
+        }
+
+        case COM_STMT_PREPARE: {
+            std::string sql(p, 1);
+            stub_stmt_t stmt;
+
+            stmt.params = count_params(sql);
+            stmt.columns = is_select(sql) ? _config.columns : 0;
+
+            uint32_t id = next_stmt++;
+            stmts[id] = stmt;
+
+            std::string r;
+            r.push_back(0x00);
+            put_int(r, id, 4);
+            put_int(r, stmt.columns, 2);
+            put_int(r, stmt.params, 2);
+            r.push_back(0);
+            put_int(r, 0, 2);
+            s.packet(r);
+
+            if (stmt.params) {
+                s.columns(stmt.params, 0);
+            }
+
+            if (stmt.columns) {
+                s.columns(stmt.columns, _config.width);
+            }
+            break;
+        }
+
+        case COM_STMT_EXECUTE: {
+            uint32_t id = 0;
+            if (p.size() >= 5) {
+                memcpy(&id, p.data() + 1, 4);
+            }
+
+            std::map<uint32_t, stub_stmt_t>::iterator it = stmts.find(id);
+            if (it == stmts.end()) {
+                s.err(1243, "Unknown prepared statement handler given to mysqld_stmt_execute");
+                break;
+            }
+
+            // parameters are not parsed, the result does not depend on them
+            if (!it->second.columns) {
+                s.ok(1);
+                break;
+            }
+
+            std::string n;
+            put_lenenc(n, it->second.columns);
+            s.packet(n);
+            s.columns(it->second.columns, _config.width);
+
+            for (int i = 0; i < _config.rows; i++) {
+                s.packet(_binary_row);
+            }
+
+            s.eof();
+            break;
+        }
+
+        case COM_INIT_DB:
+        case COM_PING:
+        case COM_STMT_RESET:
+        case COM_RESET_CONNECTION:
+            s.ok(0);
+            break;
+
+        default:
+            s.err(1047, "Unknown command");
+            break;
+        }
+
+        alive = s.flush();
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+    _fds.erase(std::find(_fds.begin(), _fds.end(), fd));
+    ::close(fd);
+}
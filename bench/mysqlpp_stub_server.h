@@ -0,0 +1,78 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 09:00:00
+ * @modify date 2026-10-20 09:00:00
+ * @desc [回环的mysql协议桩服务器, 只实现握手/COM_QUERY/COM_STMT_*, 用于不依赖mysqld的吞吐量测试]
+ */
+
+#ifndef __mysql_stub_server_h__
+#define __mysql_stub_server_h__
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// SELECT返回rows行columns列, 每列width字节的VAR_STRING. 其它语句返回OK, affected_rows为1
+typedef struct stub_config_s {
+    int rows;
+    int columns;
+    int width;
+    uint64_t latency_usec;  // 每个响应之前的延迟, 模拟server执行时间
+} stub_config_t;
+
+/*
+ 每个客户端连接一个线程, 阻塞读写, 不校验密码. 行数据在start()时预先编码好,
+ 响应时只拷贝内存, 服务端的开销尽量小, 测试结果主要反映客户端库本身.
+*/
+class mysqlpp_stub_server {
+public:
+    mysqlpp_stub_server(const stub_config_t &config);
+    ~mysqlpp_stub_server();
+
+    // listen on 127.0.0.1, 0 for an ephemeral port
+    bool start(int port = 0);
+    void stop();
+
+    int get_port() {
+        return _port;
+    }
+
+    const std::string &error() {
+        return _error;
+    }
+
+    uint64_t get_commands() {
+        return _commands.load(std::memory_order_relaxed);
+    }
+
+private:
+    void accept_loop();
+    void session(int fd);
+
+    void build_rows();
+
+private:
+    stub_config_t _config;
+
+    int _listen_fd;
+    int _port;
+    std::string _error;
+
+    std::atomic<bool> _stopping;
+    std::atomic<uint64_t> _commands;
+
+    std::string _text_row;    // payload of a text protocol row
+    std::string _binary_row;  // payload of a binary protocol row
+
+    std::thread _acceptor;
+
+    std::mutex _lock;
+    std::vector<int> _fds;
+    std::vector<std::thread> _sessions;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 10:00:00
+ * @modify date 2026-10-19 10:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_balancer.h"
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+
+mysqlpp_balancer::mysqlpp_balancer() {
+    _seed = (uint32_t)mysqlpp_conn::now_usec() | 1;
+}
+
+mysqlpp_balancer::~mysqlpp_balancer() {
+}
+
+void mysqlpp_balancer::add_pool(mysqlpp_pool *pp) {
+    _pools.push_back(pp);
+}
+
+// xorshift32, 不需要很好的随机性, 只要够快
+uint32_t mysqlpp_balancer::next_random() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+
+    return _seed;
+}
+
+// 从除exclude以外的pool中随机取两个不同的, 返回负载分数低的那个
+mysqlpp_pool *mysqlpp_balancer::pick_excluding(int exclude) {
+    int n = (int)_pools.size() - (exclude >= 0 ? 1 : 0);
+
+    if (n <= 0) {
+        return nullptr;
+    }
+
+    int a = 0, b = 0;
+    if (n > 1) {
+        a = next_random() % n;
+        b = next_random() % (n - 1);
+        if (b >= a) {
+            b++;  // two distinct pools
+        }
+    }
+
+    if (exclude >= 0) {
+        a += a >= exclude ? 1 : 0;
+        b += b >= exclude ? 1 : 0;
+    }
+
+    mysqlpp_pool *pa = _pools[a];
+    mysqlpp_pool *pb = _pools[b];
+
+    if (pa == pb) {
+        return pa;
+    }
+
+    return pa->get_load_score() <= pb->get_load_score() ? pa : pb;
+}
+
+mysqlpp_pool *mysqlpp_balancer::pick() {
+    return pick_excluding(-1);
+}
+
+mysqlpp_pool *mysqlpp_balancer::pick(mysqlpp_pool *exclude) {
+    for (unsigned int i = 0; i < _pools.size(); i++) {
+        if (_pools[i] == exclude) {
+            return pick_excluding((int)i);
+        }
+    }
+
+    return pick_excluding(-1);
+}
+
+mysqlpp_conn *mysqlpp_balancer::get_connection() {
+    mysqlpp_pool *pp = pick();
+
+    if (!pp) {
+        return nullptr;
+    }
+
+    return pp->get_connection();
+}
@@ -0,0 +1,54 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 10:00:00
+ * @modify date 2026-10-19 10:00:00
+ * @desc [多个从库连接池之间的负载均衡: peak ewma延迟 * 在途请求数, power of two choices]
+ */
+
+#ifndef __mysql_balancer_h__
+#define __mysql_balancer_h__
+
+#include <vector>
+#include <stdint.h>
+
+class mysqlpp_pool;
+class mysqlpp_conn;
+
+// 与mysqlpp_pool一样, 每个线程一个实例, 所有pool必须属于同一个event loop
+// balancer不拥有pool, 由用户负责释放
+class mysqlpp_balancer {
+public:
+    mysqlpp_balancer();
+    ~mysqlpp_balancer();
+
+    void add_pool(mysqlpp_pool *pp);
+
+    int size() {
+        return (int)_pools.size();
+    }
+
+    mysqlpp_pool *get_pool(int index) {
+        return _pools[index];
+    }
+
+    // 随机取两个pool, 选择负载分数低的那个; 延迟和在途请求数由mysqlpp_conn自动上报给所属pool
+    mysqlpp_pool *pick();
+
+    // 同上, 但不选择exclude, 用于hedged read选择第二个从库
+    mysqlpp_pool *pick(mysqlpp_pool *exclude);
+
+    // pick() + get_connection()
+    mysqlpp_conn *get_connection();
+
+private:
+    mysqlpp_pool *pick_excluding(int exclude);
+
+    uint32_t next_random();
+
+    std::vector<mysqlpp_pool *> _pools;
+
+    uint32_t _seed;
+};
+
+#endif
@@ -0,0 +1,1280 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 18:00:00
+ * @modify date 2026-10-19 18:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_binlog.h"
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+#include <event.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define COM_BINLOG_DUMP         0x12
+#define COM_REGISTER_SLAVE      0x15
+#define COM_BINLOG_DUMP_GTID    0x1e
+
+#define BINLOG_DUMP_NON_BLOCK   0x01
+#define BINLOG_THROUGH_GTID     0x04
+
+#define QUERY_EVENT             2
+#define ROTATE_EVENT            4
+#define FORMAT_DESCRIPTION_EVENT 15
+#define XID_EVENT               16
+#define TABLE_MAP_EVENT         19
+#define WRITE_ROWS_EVENT_V1     23
+#define UPDATE_ROWS_EVENT_V1    24
+#define DELETE_ROWS_EVENT_V1    25
+#define HEARTBEAT_LOG_EVENT     27
+#define WRITE_ROWS_EVENT        30
+#define UPDATE_ROWS_EVENT       31
+#define DELETE_ROWS_EVENT       32
+#define GTID_LOG_EVENT          33
+#define MARIADB_GTID_EVENT      162
+
+#define EVENT_HEADER_SIZE       19
+#define MAX_PACKET_SIZE         0xffffff
+
+static const int def_read_size = 64 * 1024;
+
+static inline uint32_t le2(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t le3(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t le4(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t le_n(const unsigned char *p, int n) {
+    uint64_t v = 0;
+
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static inline uint64_t be_n(const unsigned char *p, int n) {
+    uint64_t v = 0;
+
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static inline void put_le(std::string &s, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) {
+        s.push_back((char)(v & 0xff));
+        v >>= 8;
+    }
+}
+
+// length encoded integer, return nullptr if out of range
+static const unsigned char *lenenc(const unsigned char *p, const unsigned char *end, uint64_t &v) {
+    if (p >= end)
+        return nullptr;
+
+    int n = 0;
+    if (*p < 0xfb) {
+        v = *p;
+        return p + 1;
+    } else if (*p == 0xfc) {
+        n = 2;
+    } else if (*p == 0xfd) {
+        n = 3;
+    } else if (*p == 0xfe) {
+        n = 8;
+    } else {
+        return nullptr;
+    }
+
+    if (end - p < n + 1)
+        return nullptr;
+
+    v = le_n(p + 1, n);
+
+    return p + 1 + n;
+}
+
+static int bit_count(const unsigned char *bitmap, int bits) {
+    int n = 0;
+
+    for (int i = 0; i < bits; i++) {
+        if (bitmap[i / 8] & (1 << (i % 8)))
+            n++;
+    }
+
+    return n;
+}
+
+mysqlpp_binlog_reader::mysqlpp_binlog_reader(struct event_base *evloop, mysqlpp_pool *pp, uint32_t server_id)
+    : _evloop(evloop),
+      _pp(pp),
+      _server_id(server_id),
+      _cb(nullptr),
+      _argument(nullptr),
+      _conn(nullptr),
+      _fd(-1),
+      _status(STOPPED),
+      _setup_index(0),
+      _non_blocking(false),
+      _heartbeat(30),
+      _failed(false),
+      _eof(false),
+      _mariadb(false),
+      _checksum(false),
+      _table_id_size(6),
+      _use_gtid(false),
+      _pos(4),
+      _commit_pos(4),
+      _gtid_pending(false),
+      _pending_domain(0),
+      _pending_server(0),
+      _pending_seq(0),
+      _pending_gno(0),
+      _rlen(0),
+      _rev_added(false),
+      _wev_added(false) {
+    _rev = new event;
+    memset(_rev, 0, sizeof(struct event));
+
+    _wev = new event;
+    memset(_wev, 0, sizeof(struct event));
+}
+
+mysqlpp_binlog_reader::~mysqlpp_binlog_reader() {
+    stop();
+
+    delete _rev;
+    delete _wev;
+}
+
+void mysqlpp_binlog_reader::start(const std::string &file, uint32_t pos, binlog_callback cb, void *argument) {
+    _file = file;
+    _pos = pos < 4 ? 4 : pos;
+    _commit_file = _file;
+    _commit_pos = _pos;
+    _use_gtid = false;
+
+    begin(cb, argument);
+}
+
+void mysqlpp_binlog_reader::start_gtid(const std::string &gtid, binlog_callback cb, void *argument) {
+    _file.clear();
+    _pos = 4;
+    _commit_file.clear();
+    _commit_pos = 4;
+    _use_gtid = true;
+
+    parse_gtid(gtid);
+
+    begin(cb, argument);
+}
+
+// 第一条语句的结果决定server类型和checksum, 其余的会话设置在拿到结果后再生成
+void mysqlpp_binlog_reader::begin(binlog_callback cb, void *argument) {
+    stop();
+
+    _cb = cb;
+    _argument = argument;
+
+    _failed = false;
+    _eof = false;
+    _error.clear();
+
+    _tables.clear();
+    _gtid_pending = false;
+    _rlen = 0;
+    _big.clear();
+    _wbuf.clear();
+
+    _setup.clear();
+    _setup.push_back("SELECT VERSION(), @@global.binlog_checksum");
+    _setup_index = 0;
+
+    _status = SETUP;
+
+    _conn = _pp->get_connection();
+    _conn->set_user_callback(&mysqlpp_binlog_reader::setup_callback);
+    _conn->set_user_argument(this);
+    _conn->query(_setup[0]);
+}
+
+void mysqlpp_binlog_reader::next_setup() {
+    _setup_index++;
+
+    if (_setup_index >= _setup.size()) {
+        takeover();
+        return;
+    }
+
+    _conn->set_user_callback(&mysqlpp_binlog_reader::setup_callback);
+    _conn->query(_setup[_setup_index]);
+}
+
+bool mysqlpp_binlog_reader::setup_callback(mysqlpp_conn *conn, void *argument) {
+    mysqlpp_binlog_reader *r = (mysqlpp_binlog_reader *)argument;
+
+    if (conn->failed()) {
+        r->fail(std::string("binlog setup: ") + conn->error());
+        return true;
+    }
+
+    if (r->_setup_index == 0 && !conn->result_eof() && conn->get_column_count() >= 2) {
+        char **row = conn->get_column_content();
+
+        r->_mariadb = row[0] && strstr(row[0], "MariaDB") != nullptr;
+        r->_checksum = row[1] && strcmp(row[1], "NONE") != 0;
+
+        return false;  // wait for eof
+    }
+
+    if (r->_setup_index == 0) {
+        char tmp[64];
+
+        r->_setup.push_back("SET @master_binlog_checksum = @@global.binlog_checksum");
+
+        snprintf(tmp, sizeof(tmp), "SET @master_heartbeat_period = %lld", (long long)r->_heartbeat * 1000000000LL);
+        r->_setup.push_back(tmp);
+
+        if (r->_mariadb) {
+            r->_setup.push_back("SET @mariadb_slave_capability = 4");
+
+            if (r->_use_gtid) {
+                r->_setup.push_back("SET @slave_connect_state = '" + r->get_gtid() + "'");
+            }
+        }
+    }
+
+    // 在回调返回之后才切换到下一条语句, 否则会打乱连接的状态机
+    r->next_setup();
+    return true;
+}
+
+// 会话设置完成, 之后直接在socket上按复制协议收发包, 连接不再还给pool
+void mysqlpp_binlog_reader::takeover() {
+    _fd = _conn->get_socket();
+    if (_fd < 0) {
+        fail("binlog setup: no socket");
+        return;
+    }
+
+    ::event_set(_rev, _fd, EV_READ | EV_PERSIST, read_callback, this);
+    ::event_base_set(_evloop, _rev);
+    ::event_add(_rev, NULL);
+    _rev_added = true;
+
+    _status = REGISTERING;
+    send_register();
+}
+
+void mysqlpp_binlog_reader::send_packet(const std::string &payload) {
+    put_le(_wbuf, payload.size(), 3);
+    _wbuf.push_back(0);  // sequence id, every command starts a new sequence
+    _wbuf.append(payload);
+
+    flush_output();
+}
+
+void mysqlpp_binlog_reader::flush_output() {
+    while (!_wbuf.empty()) {
+        ssize_t n = ::send(_fd, _wbuf.data(), _wbuf.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fail(std::string("binlog send: ") + strerror(errno));
+                return;
+            }
+            break;
+        }
+
+        _wbuf.erase(0, n);
+    }
+
+    if (!_wbuf.empty() && !_wev_added) {
+        ::event_set(_wev, _fd, EV_WRITE, write_callback, this);
+        ::event_base_set(_evloop, _wev);
+        ::event_add(_wev, NULL);
+        _wev_added = true;
+    }
+}
+
+void mysqlpp_binlog_reader::write_callback(int sockfd, short event, void *v) {
+    mysqlpp_binlog_reader *r = (mysqlpp_binlog_reader *)v;
+
+    r->_wev_added = false;
+    r->flush_output();
+}
+
+void mysqlpp_binlog_reader::send_register() {
+    std::string p;
+
+    p.push_back(COM_REGISTER_SLAVE);
+    put_le(p, _server_id, 4);
+    p.push_back(0);  // hostname
+    p.push_back(0);  // user
+    p.push_back(0);  // password
+    put_le(p, 0, 2);  // port
+    put_le(p, 0, 4);  // replication rank
+    put_le(p, 0, 4);  // master id
+
+    send_packet(p);
+}
+
+void mysqlpp_binlog_reader::send_dump() {
+    std::string p;
+    uint16_t flags = _non_blocking ? BINLOG_DUMP_NON_BLOCK : 0;
+
+    if (_use_gtid && !_mariadb) {
+        std::string data;
+        encode_gtid(data);
+
+        p.push_back(COM_BINLOG_DUMP_GTID);
+        put_le(p, flags | BINLOG_THROUGH_GTID, 2);
+        put_le(p, _server_id, 4);
+        put_le(p, 0, 4);  // binlog name size
+        put_le(p, 4, 8);  // binlog pos
+        put_le(p, data.size(), 4);
+        p.append(data);
+    } else {
+        // mariadb gtid is passed by @slave_connect_state
+        p.push_back(COM_BINLOG_DUMP);
+        put_le(p, _use_gtid ? 4 : _pos, 4);
+        put_le(p, flags, 2);
+        put_le(p, _server_id, 4);
+        if (!_use_gtid) {
+            p.append(_file);
+        }
+    }
+
+    send_packet(p);
+}
+
+void mysqlpp_binlog_reader::stop() {
+    if (_rev_added) {
+        event_del(_rev);
+        _rev_added = false;
+    }
+
+    if (_wev_added) {
+        event_del(_wev);
+        _wev_added = false;
+    }
+
+    if (_conn) {
+        mysqlpp_conn *conn = _conn;
+        _conn = nullptr;
+
+        conn->cancel();  // the protocol state is unknown to libmysql, never reuse it
+        conn->close();
+    }
+
+    _fd = -1;
+    _status = STOPPED;
+}
+
+void mysqlpp_binlog_reader::fail(const std::string &error) {
+    _failed = true;
+    _error = error;
+
+    finish();
+}
+
+void mysqlpp_binlog_reader::finish() {
+    binlog_callback cb = _cb;
+
+    stop();
+
+    _changes.clear();
+    _values.clear();
+    _images.clear();
+
+    if (cb) {
+        cb(this, nullptr, 0, _argument);
+    }
+}
+
+// 批量回调: 一次读到的所有完整事件, 值直接引用收包缓冲
+void mysqlpp_binlog_reader::deliver() {
+    if (_changes.empty()) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < _changes.size(); i++) {
+        _changes[i].before = _images[i].first >= 0 ? &_values[_images[i].first] : nullptr;
+        _changes[i].after = _images[i].second >= 0 ? &_values[_images[i].second] : nullptr;
+    }
+
+    _cb(this, &_changes[0], (int)_changes.size(), _argument);
+
+    _changes.clear();
+    _values.clear();
+    _images.clear();
+}
+
+void mysqlpp_binlog_reader::read_callback(int sockfd, short event, void *v) {
+    mysqlpp_binlog_reader *r = (mysqlpp_binlog_reader *)v;
+
+    if (r->_rbuf.size() - r->_rlen < (size_t)def_read_size) {
+        r->_rbuf.resize(r->_rlen + def_read_size * 2);
+    }
+
+    ssize_t n = ::recv(r->_fd, &r->_rbuf[r->_rlen], r->_rbuf.size() - r->_rlen, 0);
+    if (n == 0) {
+        r->fail("binlog connection closed by server");
+        return;
+    }
+
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            r->fail(std::string("binlog recv: ") + strerror(errno));
+        }
+        return;
+    }
+
+    r->_rlen += n;
+
+    const unsigned char *buf = &r->_rbuf[0];
+    size_t off = 0;
+
+    while (r->_rlen - off >= 4) {
+        size_t len = le3(buf + off);
+        if (r->_rlen - off < 4 + len)
+            break;
+
+        const unsigned char *payload = buf + off + 4;
+        off += 4 + len;
+
+        // 超过16M的事件被拆成多个包, 拼起来之后马上处理并回调, 以便释放拼接缓冲
+        if (len == MAX_PACKET_SIZE || !r->_big.empty()) {
+            r->_big.append((const char *)payload, len);
+            if (len == MAX_PACKET_SIZE)
+                continue;
+
+            if (!r->handle_packet((const unsigned char *)r->_big.data(), r->_big.size()))
+                return;
+
+            r->deliver();
+            r->_big.clear();
+
+            if (r->_status == STOPPED)
+                return;  // stopped in user callback
+            continue;
+        }
+
+        if (!r->handle_packet(payload, len))
+            return;  // failed or eof, reader is stopped
+    }
+
+    r->deliver();
+
+    if (r->_status == STOPPED)
+        return;  // stopped in user callback
+
+    if (off) {
+        memmove(&r->_rbuf[0], &r->_rbuf[off], r->_rlen - off);
+        r->_rlen -= off;
+    }
+}
+
+// return false if the reader is finished
+bool mysqlpp_binlog_reader::handle_packet(const unsigned char *p, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+
+    if (p[0] == 0xff) {
+        std::string msg = "binlog: ";
+        if (len > 9 && p[3] == '#') {
+            msg.append((const char *)p + 9, len - 9);
+        } else if (len > 3) {
+            msg.append((const char *)p + 3, len - 3);
+        }
+
+        deliver();
+        fail(msg);
+        return false;
+    }
+
+    if (_status == REGISTERING) {
+        _status = STREAMING;
+        send_dump();
+        return _status == STREAMING;
+    }
+
+    if (p[0] == 0xfe && len < 9) {
+        deliver();
+
+        _eof = true;
+        finish();
+        return false;
+    }
+
+    if (!handle_event(p + 1, len - 1)) {
+        deliver();
+        fail("binlog: malformed event");
+        return false;
+    }
+
+    return true;
+}
+
+bool mysqlpp_binlog_reader::handle_event(const unsigned char *e, size_t len) {
+    if (len < EVENT_HEADER_SIZE) {
+        return false;
+    }
+
+    uint32_t timestamp = le4(e);
+    int type = e[4];
+    uint32_t log_pos = le4(e + 13);
+
+    const unsigned char *body = e + EVENT_HEADER_SIZE;
+    size_t body_len = len - EVENT_HEADER_SIZE;
+
+    if (_checksum && type != FORMAT_DESCRIPTION_EVENT) {
+        if (body_len < 4)
+            return false;
+        body_len -= 4;  // crc32, already protected by tcp
+    }
+
+    if (log_pos) {
+        _pos = log_pos;
+    }
+
+    switch (type) {
+    case ROTATE_EVENT:
+        if (body_len < 8)
+            return false;
+        _pos = (uint32_t)le_n(body, 8);
+        _file.assign((const char *)body + 8, body_len - 8);
+        break;
+    case FORMAT_DESCRIPTION_EVENT:
+        handle_format(body, body_len);
+        break;
+    case TABLE_MAP_EVENT:
+        handle_table_map(body, body_len);
+        break;
+    case WRITE_ROWS_EVENT_V1:
+    case UPDATE_ROWS_EVENT_V1:
+    case DELETE_ROWS_EVENT_V1:
+    case WRITE_ROWS_EVENT:
+    case UPDATE_ROWS_EVENT:
+    case DELETE_ROWS_EVENT:
+        return handle_rows(type, body, body_len, timestamp, log_pos);
+    case QUERY_EVENT:
+        handle_query(body, body_len, timestamp, log_pos);
+        break;
+    case XID_EVENT:
+        handle_commit(timestamp, log_pos);
+        break;
+    case GTID_LOG_EVENT:
+        if (body_len >= 25) {
+            static const char digits[] = "0123456789abcdef";
+            std::string uuid;
+            for (int i = 0; i < 16; i++) {
+                if (i == 4 || i == 6 || i == 8 || i == 10)
+                    uuid.push_back('-');
+                uuid.push_back(digits[body[1 + i] >> 4]);
+                uuid.push_back(digits[body[1 + i] & 0x0f]);
+            }
+
+            _gtid_pending = true;
+            _pending_uuid = uuid;
+            _pending_gno = (int64_t)le_n(body + 17, 8);
+        }
+        break;
+    case MARIADB_GTID_EVENT:
+        if (body_len >= 13) {
+            _gtid_pending = true;
+            _pending_seq = le_n(body, 8);
+            _pending_domain = le4(body + 8);
+            _pending_server = le4(e + 5);
+
+            if (body[12] & 0x01) {
+                // FL_STANDALONE: a single statement follows, committed by the QUERY_EVENT
+            }
+        }
+        break;
+    case HEARTBEAT_LOG_EVENT:
+    default:
+        break;
+    }
+
+    return true;
+}
+
+void mysqlpp_binlog_reader::handle_format(const unsigned char *body, size_t len) {
+    // binlog_version(2) server_version(50) create_timestamp(4) header_length(1) post_header_len[]
+    if (len < 57 + TABLE_MAP_EVENT) {
+        return;
+    }
+
+    int post_header = body[57 + TABLE_MAP_EVENT - 1];
+    _table_id_size = post_header == 6 ? 4 : 6;
+}
+
+void mysqlpp_binlog_reader::handle_table_map(const unsigned char *body, size_t len) {
+    const unsigned char *p = body;
+    const unsigned char *end = body + len;
+
+    if (len < (size_t)_table_id_size + 2 + 1)
+        return;
+
+    uint64_t id = le_n(p, _table_id_size);
+    p += _table_id_size + 2;
+
+    binlog_table_t &t = _tables[id];
+    t.id = id;
+
+    int n = *p++;
+    if (end - p < n + 2)
+        return;
+    t.db.assign((const char *)p, n);
+    p += n + 1;
+
+    n = *p++;
+    if (end - p < n + 1)
+        return;
+    t.table.assign((const char *)p, n);
+    p += n + 1;
+
+    uint64_t columns;
+    p = lenenc(p, end, columns);
+    if (!p || (uint64_t)(end - p) < columns)
+        return;
+
+    t.columns = (int)columns;
+    t.types.assign(p, p + columns);
+    t.meta.assign(columns, 0);
+    p += columns;
+
+    uint64_t meta_len;
+    p = lenenc(p, end, meta_len);
+    if (!p || (uint64_t)(end - p) < meta_len)
+        return;
+
+    for (int i = 0; i < t.columns && p < end; i++) {
+        switch (t.types[i]) {
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+        case MYSQL_TYPE_BLOB:
+        case MYSQL_TYPE_GEOMETRY:
+        case MYSQL_TYPE_JSON:
+        case MYSQL_TYPE_TIMESTAMP2:
+        case MYSQL_TYPE_DATETIME2:
+        case MYSQL_TYPE_TIME2:
+            t.meta[i] = *p++;
+            break;
+        case MYSQL_TYPE_VARCHAR:
+        case MYSQL_TYPE_VAR_STRING:
+        case MYSQL_TYPE_BIT:
+            t.meta[i] = (unsigned short)le2(p);
+            p += 2;
+            break;
+        case MYSQL_TYPE_NEWDECIMAL:
+        case MYSQL_TYPE_STRING:
+        case MYSQL_TYPE_ENUM:
+        case MYSQL_TYPE_SET:
+            t.meta[i] = (unsigned short)((p[0] << 8) | p[1]);
+            p += 2;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool mysqlpp_binlog_reader::handle_rows(int type, const unsigned char *body, size_t len, uint32_t timestamp, uint32_t log_pos) {
+    const unsigned char *p = body;
+    const unsigned char *end = body + len;
+
+    if (len < (size_t)_table_id_size + 2)
+        return false;
+
+    uint64_t id = le_n(p, _table_id_size);
+    p += _table_id_size + 2;
+
+    if (type >= WRITE_ROWS_EVENT) {
+        if (end - p < 2)
+            return false;
+        uint32_t extra = le2(p);  // includes itself
+        if (extra < 2 || (size_t)(end - p) < extra)
+            return false;
+        p += extra;
+    }
+
+    std::map<uint64_t, binlog_table_t>::iterator it = _tables.find(id);
+    if (it == _tables.end())
+        return false;
+
+    const binlog_table_t *table = &it->second;
+
+    uint64_t columns;
+    p = lenenc(p, end, columns);
+    if (!p || (int)columns != table->columns)
+        return false;
+
+    int bitmap_size = (int)(columns + 7) / 8;
+    bool update = type == UPDATE_ROWS_EVENT_V1 || type == UPDATE_ROWS_EVENT;
+    binlog_change_kind kind = BINLOG_INSERT;
+
+    if (type == UPDATE_ROWS_EVENT_V1 || type == UPDATE_ROWS_EVENT)
+        kind = BINLOG_UPDATE;
+    else if (type == DELETE_ROWS_EVENT_V1 || type == DELETE_ROWS_EVENT)
+        kind = BINLOG_DELETE;
+
+    if (end - p < bitmap_size * (update ? 2 : 1))
+        return false;
+
+    const unsigned char *present = p;
+    const unsigned char *present_after = update ? p + bitmap_size : p;
+    p += bitmap_size * (update ? 2 : 1);
+
+    while (p < end) {
+        binlog_change_t c;
+        memset(&c, 0, sizeof(c));
+        c.kind = kind;
+        c.table = table;
+        c.timestamp = timestamp;
+        c.log_pos = log_pos;
+
+        int first = (int)_values.size();
+        p = decode_row(table, present, p, end);
+        if (!p)
+            return false;
+
+        int second = -1;
+        if (update) {
+            second = (int)_values.size();
+            p = decode_row(table, present_after, p, end);
+            if (!p)
+                return false;
+        }
+
+        _changes.push_back(c);
+        if (kind == BINLOG_INSERT)
+            _images.push_back(std::make_pair(-1, first));
+        else if (kind == BINLOG_DELETE)
+            _images.push_back(std::make_pair(first, -1));
+        else
+            _images.push_back(std::make_pair(first, second));
+    }
+
+    return true;
+}
+
+const unsigned char *mysqlpp_binlog_reader::decode_row(const binlog_table_t *table, const unsigned char *bitmap,
+                const unsigned char *p, const unsigned char *end) {
+    int columns = table->columns;
+    int present = bit_count(bitmap, columns);
+    int null_size = (present + 7) / 8;
+
+    if (end - p < null_size)
+        return nullptr;
+
+    const unsigned char *nulls = p;
+    p += null_size;
+
+    int k = 0;  // index in present columns
+    for (int i = 0; i < columns; i++) {
+        binlog_value_t v;
+        memset(&v, 0, sizeof(v));
+        v.type = table->types[i];
+        v.meta = table->meta[i];
+
+        if (!(bitmap[i / 8] & (1 << (i % 8)))) {
+            v.null = true;
+            _values.push_back(v);
+            continue;
+        }
+
+        v.present = true;
+
+        if (nulls[k / 8] & (1 << (k % 8))) {
+            v.null = true;
+        } else {
+            p = decode_value(&v, p, end);
+            if (!p)
+                return nullptr;
+        }
+
+        k++;
+        _values.push_back(v);
+    }
+
+    return p;
+}
+
+static void set_datetime(MYSQL_TIME *t, uint64_t ymdhms) {
+    t->second = ymdhms % 100; ymdhms /= 100;
+    t->minute = ymdhms % 100; ymdhms /= 100;
+    t->hour = ymdhms % 100; ymdhms /= 100;
+    t->day = ymdhms % 100; ymdhms /= 100;
+    t->month = ymdhms % 100; ymdhms /= 100;
+    t->year = (unsigned int)ymdhms;
+    t->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+// fractional seconds of TIMESTAMP2/DATETIME2: (fsp + 1) / 2 bytes big endian
+static const unsigned char *read_fsp(const unsigned char *p, int fsp, unsigned long &usec) {
+    int n = (fsp + 1) / 2;
+
+    usec = 0;
+    if (n == 0)
+        return p;
+
+    usec = (unsigned long)be_n(p, n);
+    if (n == 1)
+        usec *= 10000;
+    else if (n == 2)
+        usec *= 100;
+
+    return p + n;
+}
+
+const unsigned char *mysqlpp_binlog_reader::decode_value(binlog_value_t *v, const unsigned char *p, const unsigned char *end) {
+    size_t avail = end - p;
+    size_t need = 0;
+    unsigned int meta = v->meta;
+
+#define NEED(n) do { need = (n); if (avail < need) return nullptr; } while (0)
+
+    switch (v->type) {
+    case MYSQL_TYPE_TINY:
+        NEED(1);
+        v->i = (signed char)p[0];
+        break;
+    case MYSQL_TYPE_SHORT:
+        NEED(2);
+        v->i = (int16_t)le2(p);
+        break;
+    case MYSQL_TYPE_INT24:
+        NEED(3);
+        v->i = ((int32_t)(le3(p) << 8)) >> 8;
+        break;
+    case MYSQL_TYPE_LONG:
+        NEED(4);
+        v->i = (int32_t)le4(p);
+        break;
+    case MYSQL_TYPE_LONGLONG:
+        NEED(8);
+        v->i = (long long)le_n(p, 8);
+        break;
+    case MYSQL_TYPE_FLOAT: {
+        NEED(4);
+        float f;
+        memcpy(&f, p, 4);
+        v->d = f;
+        break;
+    }
+    case MYSQL_TYPE_DOUBLE:
+        NEED(8);
+        memcpy(&v->d, p, 8);
+        break;
+    case MYSQL_TYPE_YEAR:
+        NEED(1);
+        v->i = p[0] ? p[0] + 1900 : 0;
+        break;
+    case MYSQL_TYPE_DATE: {
+        NEED(3);
+        uint32_t d = le3(p);
+        v->t.day = d & 31;
+        v->t.month = (d >> 5) & 15;
+        v->t.year = d >> 9;
+        v->t.time_type = MYSQL_TIMESTAMP_DATE;
+        break;
+    }
+    case MYSQL_TYPE_TIME: {
+        NEED(3);
+        uint32_t d = le3(p);
+        v->t.hour = d / 10000;
+        v->t.minute = (d % 10000) / 100;
+        v->t.second = d % 100;
+        v->t.time_type = MYSQL_TIMESTAMP_TIME;
+        break;
+    }
+    case MYSQL_TYPE_DATETIME:
+        NEED(8);
+        set_datetime(&v->t, le_n(p, 8));
+        break;
+    case MYSQL_TYPE_TIMESTAMP:
+        NEED(4);
+        v->i = le4(p);
+        break;
+    case MYSQL_TYPE_TIMESTAMP2:
+        NEED(4 + (meta + 1) / 2);
+        v->i = (long long)be_n(p, 4);
+        read_fsp(p + 4, meta, v->t.second_part);
+        break;
+    case MYSQL_TYPE_DATETIME2: {
+        NEED(5 + (meta + 1) / 2);
+        int64_t packed = (int64_t)be_n(p, 5) - 0x8000000000LL;
+        int64_t ymd = packed >> 17;
+        int64_t ym = ymd >> 5;
+        int64_t hms = packed % (1 << 17);
+        v->t.year = (unsigned int)(ym / 13);
+        v->t.month = (unsigned int)(ym % 13);
+        v->t.day = (unsigned int)(ymd % (1 << 5));
+        v->t.hour = (unsigned int)(hms >> 12);
+        v->t.minute = (unsigned int)((hms >> 6) % (1 << 6));
+        v->t.second = (unsigned int)(hms % (1 << 6));
+        v->t.time_type = MYSQL_TIMESTAMP_DATETIME;
+        read_fsp(p + 5, meta, v->t.second_part);
+        break;
+    }
+    case MYSQL_TYPE_TIME2: {
+        int fsp_bytes = (meta + 1) / 2;
+        NEED(3 + fsp_bytes);
+        int64_t intpart;
+        int64_t frac = 0;
+        if (fsp_bytes == 3) {
+            int64_t whole = (int64_t)be_n(p, 6) - 0x800000000000LL;
+            intpart = whole >> 24;
+            frac = whole % (1 << 24);
+        } else {
+            intpart = (int64_t)be_n(p, 3) - 0x800000;
+            if (fsp_bytes == 1) {
+                frac = (signed char)p[3];
+                if (intpart < 0 && frac) { intpart++; frac -= 0x100; }
+                frac *= 10000;
+            } else if (fsp_bytes == 2) {
+                frac = (int16_t)be_n(p + 3, 2);
+                if (intpart < 0 && frac) { intpart++; frac -= 0x10000; }
+                frac *= 100;
+            }
+        }
+        v->t.neg = intpart < 0 || frac < 0;
+        if (intpart < 0) intpart = -intpart;
+        if (frac < 0) frac = -frac;
+        v->t.hour = (unsigned int)((intpart >> 12) % (1 << 10));
+        v->t.minute = (unsigned int)((intpart >> 6) % (1 << 6));
+        v->t.second = (unsigned int)(intpart % (1 << 6));
+        v->t.second_part = (unsigned long)frac;
+        v->t.time_type = MYSQL_TIMESTAMP_TIME;
+        break;
+    }
+    case MYSQL_TYPE_NEWDECIMAL: {
+        static const int dig2bytes[10] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+        int precision = meta >> 8, scale = meta & 0xff;
+        int intg = precision - scale;
+        NEED((intg / 9) * 4 + dig2bytes[intg % 9] + (scale / 9) * 4 + dig2bytes[scale % 9]);
+        v->s = (const char *)p;
+        v->len = need;
+        break;
+    }
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_VAR_STRING: {
+        int n = meta < 256 ? 1 : 2;
+        NEED(n);
+        v->len = n == 1 ? p[0] : le2(p);
+        NEED(n + v->len);
+        v->s = (const char *)p + n;
+        break;
+    }
+    case MYSQL_TYPE_BIT: {
+        int bytes = (meta >> 8) + ((meta & 0xff) + 7) / 8;
+        NEED(bytes);
+        v->i = (long long)be_n(p, bytes);
+        break;
+    }
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_GEOMETRY:
+    case MYSQL_TYPE_JSON: {
+        int n = meta;
+        if (n < 1 || n > 4)
+            return nullptr;
+        NEED(n);
+        v->len = (unsigned long)le_n(p, n);
+        NEED(n + v->len);
+        v->s = (const char *)p + n;
+        break;
+    }
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_ENUM:
+    case MYSQL_TYPE_SET: {
+        int real_type = meta >> 8;
+        if (real_type == MYSQL_TYPE_ENUM || real_type == MYSQL_TYPE_SET) {
+            v->type = (unsigned char)real_type;
+            NEED(meta & 0xff);
+            v->i = (long long)le_n(p, need);
+            break;
+        }
+        int max_len = (((real_type & 0x30) ^ 0x30) << 4) | (meta & 0xff);
+        int n = max_len < 256 ? 1 : 2;
+        NEED(n);
+        v->len = n == 1 ? p[0] : le2(p);
+        NEED(n + v->len);
+        v->s = (const char *)p + n;
+        break;
+    }
+    default:
+        return nullptr;  // unknown type, can not skip it
+    }
+
+#undef NEED
+
+    return p + need;
+}
+
+void mysqlpp_binlog_reader::handle_query(const unsigned char *body, size_t len, uint32_t timestamp, uint32_t log_pos) {
+    // thread_id(4) exec_time(4) db_len(1) error_code(2) status_vars_len(2) status_vars db\0 sql
+    if (len < 13)
+        return;
+
+    int db_len = body[8];
+    int vars_len = le2(body + 11);
+
+    if (len < (size_t)(13 + vars_len + db_len + 1))
+        return;
+
+    const char *db = (const char *)body + 13 + vars_len;
+    const char *sql = db + db_len + 1;
+    unsigned long sql_len = (unsigned long)(len - (13 + vars_len + db_len + 1));
+
+    if (sql_len == 5 && strncmp(sql, "BEGIN", 5) == 0) {
+        return;
+    }
+
+    binlog_change_t c;
+    memset(&c, 0, sizeof(c));
+    c.kind = BINLOG_QUERY;
+    c.db = db;  // NUL terminated in the event
+    c.sql = sql;
+    c.sql_len = sql_len;
+    c.timestamp = timestamp;
+    c.log_pos = log_pos;
+
+    _changes.push_back(c);
+    _images.push_back(std::make_pair(-1, -1));
+
+    // DDL或者非事务表的语句自己就是一个事务
+    handle_commit(timestamp, log_pos);
+}
+
+void mysqlpp_binlog_reader::handle_commit(uint32_t timestamp, uint32_t log_pos) {
+    if (_gtid_pending) {
+        _gtid_pending = false;
+
+        if (!_pending_uuid.empty()) {
+            std::vector<std::pair<int64_t, int64_t> > &iv = _mysql_gtid[_pending_uuid];
+            int64_t gno = _pending_gno;
+
+            if (!iv.empty() && iv.back().second == gno) {
+                iv.back().second = gno + 1;  // the common case
+            } else {
+                bool merged = false;
+                for (unsigned int i = 0; i < iv.size(); i++) {
+                    if (gno >= iv[i].first && gno < iv[i].second) {
+                        merged = true;
+                        break;
+                    }
+                }
+                if (!merged) {
+                    iv.push_back(std::make_pair(gno, gno + 1));
+                }
+            }
+
+            _pending_uuid.clear();
+        } else {
+            _maria_gtid[_pending_domain] = std::make_pair(_pending_server, _pending_seq);
+        }
+    }
+
+    _commit_file = _file;
+    _commit_pos = log_pos ? log_pos : _pos;
+
+    binlog_change_t c;
+    memset(&c, 0, sizeof(c));
+    c.kind = BINLOG_COMMIT;
+    c.timestamp = timestamp;
+    c.log_pos = log_pos;
+
+    _changes.push_back(c);
+    _images.push_back(std::make_pair(-1, -1));
+}
+
+void mysqlpp_binlog_reader::parse_gtid(const std::string &gtid) {
+    _maria_gtid.clear();
+    _mysql_gtid.clear();
+
+    size_t start = 0;
+    while (start < gtid.size()) {
+        size_t comma = gtid.find(',', start);
+        if (comma == std::string::npos)
+            comma = gtid.size();
+
+        std::string item = gtid.substr(start, comma - start);
+        start = comma + 1;
+
+        size_t b = item.find_first_not_of(" \t\n");
+        if (b == std::string::npos)
+            continue;
+        item = item.substr(b);
+
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) {
+            // mariadb: domain-server-seq
+            unsigned int domain = 0, server = 0;
+            unsigned long long seq = 0;
+            if (sscanf(item.c_str(), "%u-%u-%llu", &domain, &server, &seq) == 3) {
+                _maria_gtid[domain] = std::make_pair(server, (uint64_t)seq);
+            }
+            continue;
+        }
+
+        // mysql: uuid:1-5:7
+        std::vector<std::pair<int64_t, int64_t> > &iv = _mysql_gtid[item.substr(0, colon)];
+        while (colon != std::string::npos) {
+            size_t next = item.find(':', colon + 1);
+            std::string range = item.substr(colon + 1, next == std::string::npos ? std::string::npos : next - colon - 1);
+            long long a = 0, e = 0;
+            int n = sscanf(range.c_str(), "%lld-%lld", &a, &e);
+            if (n == 1)
+                e = a;
+            if (n >= 1)
+                iv.push_back(std::make_pair((int64_t)a, (int64_t)e + 1));
+            colon = next;
+        }
+    }
+}
+
+std::string mysqlpp_binlog_reader::get_gtid() {
+    std::string out;
+    char tmp[96];
+
+    std::map<uint32_t, std::pair<uint32_t, uint64_t> >::iterator mi;
+    for (mi = _maria_gtid.begin(); mi != _maria_gtid.end(); ++mi) {
+        snprintf(tmp, sizeof(tmp), "%u-%u-%llu", mi->first, mi->second.first, (unsigned long long)mi->second.second);
+        if (!out.empty())
+            out.push_back(',');
+        out.append(tmp);
+    }
+
+    std::map<std::string, std::vector<std::pair<int64_t, int64_t> > >::iterator it;
+    for (it = _mysql_gtid.begin(); it != _mysql_gtid.end(); ++it) {
+        if (!out.empty())
+            out.push_back(',');
+        out.append(it->first);
+
+        for (unsigned int i = 0; i < it->second.size(); i++) {
+            int64_t a = it->second[i].first, e = it->second[i].second - 1;
+            if (a == e)
+                snprintf(tmp, sizeof(tmp), ":%lld", (long long)a);
+            else
+                snprintf(tmp, sizeof(tmp), ":%lld-%lld", (long long)a, (long long)e);
+            out.append(tmp);
+        }
+    }
+
+    return out;
+}
+
+// COM_BINLOG_DUMP_GTID的gtid集合: n_sids, 每个sid: uuid(16) n_intervals [start, end)
+void mysqlpp_binlog_reader::encode_gtid(std::string &out) {
+    put_le(out, _mysql_gtid.size(), 8);
+
+    std::map<std::string, std::vector<std::pair<int64_t, int64_t> > >::iterator it;
+    for (it = _mysql_gtid.begin(); it != _mysql_gtid.end(); ++it) {
+        const std::string &uuid = it->first;
+        int nibble = -1;
+
+        for (unsigned int i = 0; i < uuid.size(); i++) {
+            char c = uuid[i];
+            int x;
+            if (c >= '0' && c <= '9')
+                x = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                x = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                x = c - 'A' + 10;
+            else
+                continue;
+
+            if (nibble < 0) {
+                nibble = x;
+            } else {
+                out.push_back((char)(nibble << 4 | x));
+                nibble = -1;
+            }
+        }
+
+        put_le(out, it->second.size(), 8);
+        for (unsigned int i = 0; i < it->second.size(); i++) {
+            put_le(out, (uint64_t)it->second[i].first, 8);
+            put_le(out, (uint64_t)it->second[i].second, 8);
+        }
+    }
+}
+
+void mysqlpp_binlog_reader::decimal_to_string(const binlog_value_t *v, std::string &out) {
+    static const int dig2bytes[10] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+    int precision = v->meta >> 8, scale = v->meta & 0xff;
+    int intg = precision - scale;
+    int intg0 = intg / 9, intg0x = intg % 9;
+    int frac0 = scale / 9, frac0x = scale % 9;
+    char tmp[16];
+
+    out.clear();
+    if (!v->s || v->len == 0) {
+        return;
+    }
+
+    std::string b(v->s, v->len);
+    bool negative = (b[0] & 0x80) == 0;
+
+    b[0] ^= 0x80;
+    if (negative) {
+        for (unsigned int i = 0; i < b.size(); i++)
+            b[i] = ~b[i];
+        out.push_back('-');
+    }
+
+    const unsigned char *p = (const unsigned char *)b.data();
+    std::string digits;
+
+    if (intg0x) {
+        int n = dig2bytes[intg0x];
+        snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)be_n(p, n));
+        digits.append(tmp);
+        p += n;
+    }
+
+    for (int i = 0; i < intg0; i++) {
+        snprintf(tmp, sizeof(tmp), "%09u", (unsigned int)be_n(p, 4));
+        digits.append(tmp);
+        p += 4;
+    }
+
+    size_t nz = digits.find_first_not_of('0');
+    out.append(nz == std::string::npos ? "0" : digits.substr(nz));
+
+    if (scale == 0) {
+        return;
+    }
+
+    out.push_back('.');
+
+    for (int i = 0; i < frac0; i++) {
+        snprintf(tmp, sizeof(tmp), "%09u", (unsigned int)be_n(p, 4));
+        out.append(tmp);
+        p += 4;
+    }
+
+    if (frac0x) {
+        snprintf(tmp, sizeof(tmp), "%0*llu", frac0x, (unsigned long long)be_n(p, dig2bytes[frac0x]));
+        out.append(tmp);
+    }
+}
@@ -0,0 +1,229 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 18:00:00
+ * @modify date 2026-10-19 18:00:00
+ * @desc [binlog(CDC)异步读取: 注册为从库, 在同一个event loop上流式接收并解码行事件]
+ */
+
+#ifndef __mysql_binlog_h__
+#define __mysql_binlog_h__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "mysql/mysql.h"
+
+struct event;
+struct event_base;
+
+class mysqlpp_pool;
+class mysqlpp_conn;
+class mysqlpp_binlog_reader;
+
+enum binlog_change_kind {
+    BINLOG_INSERT,
+    BINLOG_UPDATE,
+    BINLOG_DELETE,
+    BINLOG_QUERY,   // statement, DDL for example
+    BINLOG_COMMIT   // end of transaction, position and gtid are updated
+};
+
+// 行镜像里的一个值. 字符串, BLOB, JSON(二进制格式)和DECIMAL(二进制格式)直接指向收包缓冲, 只在回调期间有效
+typedef struct binlog_value_s {
+    unsigned char type;    // enum_field_types, real type for ENUM/SET/CHAR
+    unsigned short meta;   // column metadata, precision << 8 | scale for DECIMAL
+    bool present;          // false when the column is not in the image (binlog_row_image=MINIMAL)
+    bool null;
+
+    long long i;           // integer, YEAR, ENUM index, SET/BIT bits, TIMESTAMP seconds
+    double d;              // FLOAT/DOUBLE
+    const char *s;         // string, blob, json, decimal
+    unsigned long len;
+    MYSQL_TIME t;          // DATE/TIME/DATETIME/TIMESTAMP
+} binlog_value_t;
+
+typedef struct binlog_table_s {
+    uint64_t id;
+    std::string db;
+    std::string table;
+
+    int columns;
+    std::vector<unsigned char> types;
+    std::vector<unsigned short> meta;
+} binlog_table_t;
+
+typedef struct binlog_change_s {
+    binlog_change_kind kind;
+
+    const binlog_table_t *table;   // rows
+    const binlog_value_t *before;  // UPDATE/DELETE, table->columns values
+    const binlog_value_t *after;   // INSERT/UPDATE
+
+    const char *db;                // QUERY
+    const char *sql;
+    unsigned long sql_len;
+
+    uint32_t timestamp;
+    uint32_t log_pos;              // end of the event in current binlog file
+} binlog_change_t;
+
+// count为0时表示出错(failed())或者非阻塞模式下读到了末尾(result_eof())
+typedef void (*binlog_callback)(mysqlpp_binlog_reader *reader, const binlog_change_t *changes, int count, void *argument);
+
+// 从pool取一个连接完成认证和会话设置, 之后直接接管它的socket按复制协议收包. 
+// 不支持SSL和压缩协议. 出错后用get_gtid()或者get_binlog_file()/get_binlog_pos()重新start即可续传
+class mysqlpp_binlog_reader {
+public:
+    mysqlpp_binlog_reader(struct event_base *evloop, mysqlpp_pool *pp, uint32_t server_id);
+    ~mysqlpp_binlog_reader();
+
+    // non block: server sends eof at the end of binlog instead of waiting for new events
+    void set_non_blocking(bool non_blocking) {
+        _non_blocking = non_blocking;
+    }
+
+    void set_heartbeat(int seconds) {
+        _heartbeat = seconds;
+    }
+
+    // start from file and position, empty file for the current binlog
+    void start(const std::string &file, uint32_t pos, binlog_callback cb, void *argument);
+
+    // start from gtid set, "uuid:1-100,uuid2:1-5" for mysql or "0-1-100,1-2-5" for mariadb
+    void start_gtid(const std::string &gtid, binlog_callback cb, void *argument);
+
+    void stop();
+
+    bool failed() {
+        return _failed;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    bool result_eof() {
+        return _eof;
+    }
+
+    bool is_mariadb() {
+        return _mariadb;
+    }
+
+    // end of the last BINLOG_COMMIT, like get_gtid(). 事务中间的位置不能续传, 会缺少TABLE_MAP
+    const std::string &get_binlog_file() {
+        return _commit_file;
+    }
+
+    uint32_t get_binlog_pos() {
+        return _commit_pos;
+    }
+
+    // executed gtid set up to the last BINLOG_COMMIT
+    std::string get_gtid();
+
+    // binary decimal of binlog_value_t to string
+    static void decimal_to_string(const binlog_value_t *v, std::string &out);
+
+private:
+    enum Estatus {
+        SETUP,
+        REGISTERING,
+        STREAMING,
+        STOPPED
+    };
+
+    static bool setup_callback(mysqlpp_conn *conn, void *argument);
+    static void read_callback(int sockfd, short event, void *v);
+    static void write_callback(int sockfd, short event, void *v);
+
+    void begin(binlog_callback cb, void *argument);
+    void next_setup();
+    void takeover();
+
+    void send_packet(const std::string &payload);
+    void send_register();
+    void send_dump();
+    void flush_output();
+
+    void fail(const std::string &error);
+    void deliver();
+    void finish();
+
+    bool handle_packet(const unsigned char *p, size_t len);
+    bool handle_event(const unsigned char *e, size_t len);
+    void handle_format(const unsigned char *body, size_t len);
+    void handle_table_map(const unsigned char *body, size_t len);
+    bool handle_rows(int type, const unsigned char *body, size_t len, uint32_t timestamp, uint32_t log_pos);
+    void handle_query(const unsigned char *body, size_t len, uint32_t timestamp, uint32_t log_pos);
+    void handle_commit(uint32_t timestamp, uint32_t log_pos);
+
+    const unsigned char *decode_row(const binlog_table_t *table, const unsigned char *bitmap,
+        const unsigned char *p, const unsigned char *end);
+    const unsigned char *decode_value(binlog_value_t *v, const unsigned char *p, const unsigned char *end);
+
+    void parse_gtid(const std::string &gtid);
+    void encode_gtid(std::string &out);
+
+    struct event_base *_evloop;
+    mysqlpp_pool *_pp;
+    uint32_t _server_id;
+
+    binlog_callback _cb;
+    void *_argument;
+
+    mysqlpp_conn *_conn;
+    int _fd;
+    Estatus _status;
+
+    std::vector<std::string> _setup;  // session setup statements
+    unsigned int _setup_index;
+
+    bool _non_blocking;
+    int _heartbeat;
+
+    bool _failed;
+    bool _eof;
+    std::string _error;
+
+    bool _mariadb;
+    bool _checksum;
+    int _table_id_size;
+    bool _use_gtid;
+
+    std::string _file;  // where the stream is
+    uint32_t _pos;
+    std::string _commit_file;  // where to restart
+    uint32_t _commit_pos;
+
+    // gtid state, mariadb: domain -> (server, seq); mysql: uuid -> [start, end) intervals
+    std::map<uint32_t, std::pair<uint32_t, uint64_t> > _maria_gtid;
+    std::map<std::string, std::vector<std::pair<int64_t, int64_t> > > _mysql_gtid;
+
+    bool _gtid_pending;
+    uint32_t _pending_domain;
+    uint32_t _pending_server;
+    uint64_t _pending_seq;
+    std::string _pending_uuid;
+    int64_t _pending_gno;
+
+    std::map<uint64_t, binlog_table_t> _tables;
+
+    std::vector<unsigned char> _rbuf;  // received bytes
+    size_t _rlen;
+    std::string _big;  // reassembled packet larger than 16M
+    std::string _wbuf;
+
+    std::vector<binlog_change_t> _changes;
+    std::vector<binlog_value_t> _values;
+    std::vector<std::pair<int, int> > _images;  // index of before/after in _values, -1 for none
+
+    struct event *_rev;
+    struct event *_wev;
+    bool _rev_added;
+    bool _wev_added;
+};
+
+#endif
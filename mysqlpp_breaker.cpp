@@ -0,0 +1,98 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 13:00:00
+ * @modify date 2026-10-20 18:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_breaker.h"
+#include "mysqlpp_conn.h"
+
+mysqlpp_breaker::mysqlpp_breaker()
+    : _threshold(0),
+      _backoff(def_breaker_backoff),
+      _max_backoff(def_breaker_max_backoff),
+      _failures(0),
+      _trips(0),
+      _state(BREAKER_CLOSED),
+      _open_until(0),
+      _probing(false) {
+    _seed = (uint32_t)mysqlpp_conn::now_usec() | 1;
+}
+
+// xorshift32, 同mysqlpp_balancer
+uint32_t mysqlpp_breaker::next_random() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+
+    return _seed;
+}
+
+bool mysqlpp_breaker::allow(uint64_t now) {
+    if (!_threshold) {
+        return true;
+    }
+
+    switch (_state) {
+    case BREAKER_CLOSED:
+        return true;
+
+    case BREAKER_OPEN:
+        if (now < _open_until) {
+            return false;
+        }
+
+        _state = BREAKER_HALF_OPEN;
+        _probing = true;
+        return true;
+
+    case BREAKER_HALF_OPEN:
+        if (_probing) {
+            return false;
+        }
+
+        _probing = true;
+        return true;
+    }
+
+    return true;
+}
+
+void mysqlpp_breaker::success() {
+    _failures = 0;
+    _trips = 0;
+    _state = BREAKER_CLOSED;
+    _probing = false;
+}
+
+bool mysqlpp_breaker::failure(uint64_t now, bool probe) {
+    if (_state == BREAKER_HALF_OPEN && !probe) {
+        return false;  // started before it opened, only the probe decides
+    }
+
+    _failures++;
+
+    if (!_threshold || _state == BREAKER_OPEN) {
+        return false;  // connects started before it opened
+    }
+
+    if (_state == BREAKER_CLOSED && _failures < _threshold) {
+        return false;
+    }
+
+    uint64_t window = _max_backoff;
+    if (_trips < 32 && (_backoff << _trips) < _max_backoff) {
+        window = _backoff << _trips;
+    }
+
+    _trips++;
+
+    window = window / 2 + next_random() % (window / 2 + 1);
+
+    _state = BREAKER_OPEN;
+    _open_until = now + window;
+    _probing = false;
+
+    return true;
+}
@@ -0,0 +1,82 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 13:00:00
+ * @modify date 2026-10-20 18:00:00
+ * @desc [连接熔断: 连续建连失败后在退避窗口内直接失败, 窗口结束只放一个探测连接]
+ */
+
+#ifndef __mysql_breaker_h__
+#define __mysql_breaker_h__
+
+#include <stdint.h>
+
+static const int def_breaker_failures = 5;                      // consecutive connect failures to open
+static const uint64_t def_breaker_backoff = 100 * 1000;         // first window 100ms
+static const uint64_t def_breaker_max_backoff = 30 * 1000000;   // 30s
+
+enum breaker_state {
+    BREAKER_CLOSED,     // connecting normally
+    BREAKER_OPEN,       // fail fast until the window elapsed
+    BREAKER_HALF_OPEN   // one probe connection in flight, the others fail fast
+};
+
+/*
+ 每次打开的窗口翻倍直到max_backoff, 取[window/2, window]之间的随机值, 避免多个进程同时重连.
+ 探测连接成功则关闭熔断并清零退避, 失败则以更长的窗口重新打开.
+*/
+class mysqlpp_breaker {
+public:
+    mysqlpp_breaker();
+
+    // failures 0 for off
+    void set(int failures, uint64_t backoff_usec, uint64_t max_backoff_usec) {
+        _threshold = failures;
+        _backoff = backoff_usec;
+        _max_backoff = max_backoff_usec;
+    }
+
+    bool enabled() {
+        return _threshold > 0;
+    }
+
+    // before connecting, true lets the connect go on. the first call after the window is the probe
+    bool allow(uint64_t now);
+
+    void success();
+
+    // true when this failure opened the breaker. probe: the connect allowed in half open
+    bool failure(uint64_t now, bool probe);
+
+    // the probe gave up before the connect finished, let the next one probe
+    void abandon() {
+        _probing = false;
+    }
+
+    breaker_state state() {
+        return _state;
+    }
+
+    // microseconds until the next probe is allowed, 0 unless open
+    uint64_t retry_after(uint64_t now) {
+        return _state == BREAKER_OPEN && _open_until > now ? _open_until - now : 0;
+    }
+
+private:
+    uint32_t next_random();
+
+    int _threshold;
+    uint64_t _backoff;
+    uint64_t _max_backoff;
+
+    int _failures;   // consecutive
+    int _trips;      // opened in a row without a success, the exponent of the window
+
+    breaker_state _state;
+    uint64_t _open_until;
+    bool _probing;
+
+    uint32_t _seed;
+};
+
+#endif
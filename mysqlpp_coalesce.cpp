@@ -0,0 +1,349 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 17:00:00
+ * @modify date 2026-10-20 19:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_coalesce.h"
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+#include <event.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+mysqlpp_insert_queue::mysqlpp_insert_queue(mysqlpp_coalescer *co, const std::string &table, const std::string &columns)
+    : _co(co),
+      _batch(nullptr),
+      _fields(0),
+      _timer_added(false) {
+    _prefix = "INSERT INTO " + table;
+    if (!columns.empty()) {
+        _prefix += " (" + columns + ")";
+    }
+    _prefix += " VALUES ";
+
+    _current.cb = nullptr;
+    _current.argument = nullptr;
+
+    _timer = new event;
+    memset(_timer, 0, sizeof(struct event));
+}
+
+mysqlpp_insert_queue::~mysqlpp_insert_queue() {
+    flush();
+
+    delete _timer;
+}
+
+void mysqlpp_insert_queue::begin(insert_callback cb, void *argument) {
+    if (!_batch) {
+        _batch = new insert_batch_t;
+        _batch->queue = this;
+        _batch->sql = _prefix;
+    } else {
+        _batch->sql.push_back(',');
+    }
+
+    _batch->sql.push_back('(');
+
+    _current.cb = cb;
+    _current.argument = argument;
+    _fields = 0;
+}
+
+void mysqlpp_insert_queue::separate() {
+    if (_fields++) {
+        _batch->sql.push_back(',');
+    }
+}
+
+void mysqlpp_insert_queue::add_hex(const void *x, size_t size) {
+    static const char digits[] = "0123456789ABCDEF";
+    const unsigned char *p = (const unsigned char *)x;
+
+    std::string &sql = _batch->sql;
+
+    sql.append("X'", 2);
+    for (size_t i = 0; i < size; i++) {
+        sql.push_back(digits[p[i] >> 4]);
+        sql.push_back(digits[p[i] & 0x0f]);
+    }
+    sql.push_back('\'');
+}
+
+void mysqlpp_insert_queue::add_string(const char *x) {
+    if (!x) {
+        add_null();
+        return;
+    }
+
+    add_string(x, strlen(x));
+}
+
+// 普通可打印ASCII直接用单引号; 含有引号, 反斜杠, 控制字符或者非ASCII字节时用十六进制,
+// 这样与连接字符集以及NO_BACKSLASH_ESCAPES都无关
+void mysqlpp_insert_queue::add_string(const char *x, size_t size) {
+    separate();
+
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = (unsigned char)x[i];
+        if (c < 0x20 || c >= 0x7f || c == '\'' || c == '\\') {
+            add_hex(x, size);
+            return;
+        }
+    }
+
+    std::string &sql = _batch->sql;
+
+    sql.push_back('\'');
+    sql.append(x, size);
+    sql.push_back('\'');
+}
+
+void mysqlpp_insert_queue::add_blob(const void *x, size_t size) {
+    if (!x) {
+        add_null();
+        return;
+    }
+
+    separate();
+    add_hex(x, size);
+}
+
+void mysqlpp_insert_queue::add_int(long long x) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%lld", x);
+
+    separate();
+    _batch->sql.append(tmp, n);
+}
+
+void mysqlpp_insert_queue::add_double(double x) {
+    if (!isfinite(x)) {
+        add_null();  // SQL has no inf or nan literal
+        return;
+    }
+
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%.17g", x);
+
+    separate();
+    _batch->sql.append(tmp, n);
+}
+
+void mysqlpp_insert_queue::add_null() {
+    separate();
+    _batch->sql.append("NULL", 4);
+}
+
+void mysqlpp_insert_queue::commit() {
+    _batch->sql.push_back(')');
+    _batch->waiters.push_back(_current);
+
+    _co->_rows++;
+
+    if ((int)_batch->waiters.size() >= _co->_max_rows || (int)_batch->sql.size() >= _co->_max_bytes) {
+        flush();
+        return;
+    }
+
+    if (!_timer_added) {
+        struct timeval tv;
+        tv.tv_sec = _co->_max_delay / 1000000;
+        tv.tv_usec = _co->_max_delay % 1000000;
+
+        ::event_set(_timer, -1, 0, timer_callback, this);
+        ::event_base_set(_co->_evloop, _timer);
+        ::event_add(_timer, &tv);
+
+        _timer_added = true;
+    }
+}
+
+void mysqlpp_insert_queue::timer_callback(int sockfd, short event, void *v) {
+    mysqlpp_insert_queue *q = (mysqlpp_insert_queue *)v;
+
+    q->_timer_added = false;
+    q->flush();
+}
+
+void mysqlpp_insert_queue::flush() {
+    if (_timer_added) {
+        event_del(_timer);
+        _timer_added = false;
+    }
+
+    insert_batch_t *batch = _batch;
+    if (!batch || batch->waiters.empty()) {
+        return;
+    }
+
+    _batch = nullptr;
+    _co->_statements++;
+
+    if (_co->_autoinc_lock_mode < 0) {
+        _co->_held.push_back(batch);
+        _co->probe();
+        return;
+    }
+
+    _co->send(batch);
+}
+
+bool mysqlpp_insert_queue::batch_callback(mysqlpp_conn *conn, void *argument) {
+    insert_batch_t *batch = (insert_batch_t *)argument;
+
+    if (!conn->failed() && conn->get_column_count() != 0 && !conn->result_eof()) {
+        return false;  // INSERT ... RETURNING, rows are ignored
+    }
+
+    bool failed = conn->failed();
+    uint64_t first = failed ? 0 : conn->insert_id();
+    std::string error = failed ? conn->error() : "";
+
+    conn->close();
+
+    for (unsigned int i = 0; i < batch->waiters.size(); i++) {
+        uint64_t id = first && batch->increment ? first + (uint64_t)i * batch->increment : 0;
+        batch->waiters[i].cb(failed, error.c_str(), id, batch->waiters[i].argument);
+    }
+
+    delete batch;
+
+    return true;
+}
+
+mysqlpp_coalescer::mysqlpp_coalescer(struct event_base *evloop,
+                mysqlpp_pool *pp,
+                int max_rows,
+                int max_delay,
+                int max_bytes)
+    : _evloop(evloop),
+      _pp(pp),
+      _max_rows(max_rows),
+      _max_delay(max_delay),
+      _max_bytes(max_bytes),
+      _increment(0),
+      _server_increment(1),
+      _rows(0),
+      _statements(0),
+      _autoinc_lock_mode(-1),
+      _probe(nullptr) {
+}
+
+mysqlpp_coalescer::~mysqlpp_coalescer() {
+    std::map<std::string, mysqlpp_insert_queue *>::iterator it;
+
+    for (it = _queues.begin(); it != _queues.end(); ++it) {
+        delete it->second;
+    }
+
+    // the probe outlives us, send the rows without ids
+    if (_probe) {
+        _probe->co = nullptr;
+        _probe = nullptr;
+    }
+
+    if (_autoinc_lock_mode < 0) {
+        _autoinc_lock_mode = 2;
+    }
+
+    send_held();
+}
+
+// 只查一次, 查询期间flush的批次先攒着
+void mysqlpp_coalescer::probe() {
+    if (_probe) {
+        return;
+    }
+
+    _probe = new autoinc_probe_t;
+    _probe->co = this;
+    _probe->mode = 2;  // no ids if the query fails
+    _probe->increment = 1;
+
+    std::string sql = "SELECT @@innodb_autoinc_lock_mode, @@auto_increment_increment";
+
+    mysqlpp_conn *conn = _pp->get_connection();
+    conn->set_user_callback(&mysqlpp_coalescer::probe_callback);
+    conn->set_user_argument(_probe);
+    conn->query(sql);
+}
+
+bool mysqlpp_coalescer::probe_callback(mysqlpp_conn *conn, void *argument) {
+    autoinc_probe_t *p = (autoinc_probe_t *)argument;
+
+    if (!conn->failed() && !conn->result_eof() && conn->get_column_count() >= 2) {
+        char **row = conn->get_column_content();
+
+        if (row[0] && row[1] && atoi(row[1]) > 0) {
+            p->mode = atoi(row[0]);
+            p->increment = atoi(row[1]);
+        }
+
+        return false;  // wait for eof
+    }
+
+    conn->close();
+
+    mysqlpp_coalescer *co = p->co;
+    int mode = p->mode;
+    int increment = p->increment;
+
+    delete p;
+
+    if (co) {
+        co->_probe = nullptr;
+        co->_autoinc_lock_mode = mode;
+        co->_server_increment = increment;
+        co->send_held();
+    }
+
+    return true;
+}
+
+// 2 (interleaved) 时并发的insert会穿插分配id, 不能从第一个id推算
+void mysqlpp_coalescer::send(insert_batch_t *batch) {
+    int increment = _increment > 0 ? _increment : _server_increment;
+
+    batch->increment = _autoinc_lock_mode == 0 || _autoinc_lock_mode == 1 ? increment : 0;
+
+    mysqlpp_conn *conn = _pp->get_connection();
+    conn->set_user_callback(&mysqlpp_insert_queue::batch_callback);
+    conn->set_user_argument(batch);
+    conn->query(batch->sql);
+}
+
+void mysqlpp_coalescer::send_held() {
+    std::vector<insert_batch_t *> held;
+    held.swap(_held);
+
+    for (unsigned int i = 0; i < held.size(); i++) {
+        send(held[i]);
+    }
+}
+
+mysqlpp_insert_queue *mysqlpp_coalescer::get_queue(const std::string &table, const std::string &columns) {
+    std::string key = table + "\n" + columns;
+
+    std::map<std::string, mysqlpp_insert_queue *>::iterator it = _queues.find(key);
+    if (it != _queues.end()) {
+        return it->second;
+    }
+
+    mysqlpp_insert_queue *q = new mysqlpp_insert_queue(this, table, columns);
+    _queues[key] = q;
+
+    return q;
+}
+
+void mysqlpp_coalescer::flush_all() {
+    std::map<std::string, mysqlpp_insert_queue *>::iterator it;
+
+    for (it = _queues.begin(); it != _queues.end(); ++it) {
+        it->second->flush();
+    }
+}
@@ -0,0 +1,165 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 17:00:00
+ * @modify date 2026-10-20 19:00:00
+ * @desc [小写入合并: 同一张表同样列的单行INSERT攒成一条多行INSERT, 每个调用者仍然有自己的回调]
+ */
+
+#ifndef __mysql_coalesce_h__
+#define __mysql_coalesce_h__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <stddef.h>
+
+static const int def_coalesce_rows = 256;
+static const int def_coalesce_delay = 1000;            // usec
+static const int def_coalesce_bytes = 512 * 1024;      // keep below max_allowed_packet
+
+struct event;
+struct event_base;
+
+class mysqlpp_pool;
+class mysqlpp_conn;
+class mysqlpp_coalescer;
+
+// insert_id: auto increment id of this row, derived from the first id of the batch,
+// 0 if no auto increment or the server can't guarantee consecutive ids
+typedef void (*insert_callback)(bool failed, const char *error, uint64_t insert_id, void *argument);
+
+typedef struct insert_waiter_s {
+    insert_callback cb;
+    void *argument;
+} insert_waiter_t;
+
+class mysqlpp_insert_queue;
+
+typedef struct insert_batch_s {
+    mysqlpp_insert_queue *queue;
+
+    std::string sql;
+    std::vector<insert_waiter_t> waiters;
+
+    int increment;  // 0 for no per-row ids
+} insert_batch_t;
+
+typedef struct autoinc_probe_s {
+    mysqlpp_coalescer *co;  // nullptr once the coalescer is gone
+    int mode;
+    int increment;
+} autoinc_probe_t;
+
+// 一个(表, 列)对应一个队列. 用法: begin(cb, arg); add_xxx()按列顺序填值; commit()
+class mysqlpp_insert_queue {
+public:
+    void begin(insert_callback cb, void *argument);
+
+    void add_string(const char *x);
+    void add_string(const char *x, size_t size);
+    void add_blob(const void *x, size_t size);
+    void add_int(long long x);
+    void add_double(double x);  // inf and nan are written as NULL
+    void add_null();
+
+    void commit();
+
+    // send what we have now
+    void flush();
+
+    int get_pending() {
+        return _batch ? (int)_batch->waiters.size() : 0;
+    }
+
+private:
+    friend class mysqlpp_coalescer;
+
+    mysqlpp_insert_queue(mysqlpp_coalescer *co, const std::string &table, const std::string &columns);
+    ~mysqlpp_insert_queue();
+
+    static void timer_callback(int sockfd, short event, void *v);
+    static bool batch_callback(mysqlpp_conn *conn, void *argument);
+
+    void separate();
+    void add_hex(const void *x, size_t size);
+
+    mysqlpp_coalescer *_co;
+
+    std::string _prefix;  // INSERT INTO table (columns) VALUES
+
+    insert_batch_t *_batch;  // being built
+    insert_waiter_t _current;
+    int _fields;
+
+    struct event *_timer;
+    bool _timer_added;
+};
+
+// 每个线程一个实例, pool必须属于evloop. 合并后的语句是原子的, 一行出错整批失败.
+// insert id按auto_increment_increment推算, 要求innodb_autoinc_lock_mode为0或1(简单insert连续分配).
+// 第一批发送前查询一次@@innodb_autoinc_lock_mode和@@auto_increment_increment(Galera, 多主通常不是1),
+// lock mode为2或者查询失败时insert id都是0
+class mysqlpp_coalescer {
+public:
+    mysqlpp_coalescer(struct event_base *evloop,
+        mysqlpp_pool *pp,
+        int max_rows = def_coalesce_rows,
+        int max_delay = def_coalesce_delay,
+        int max_bytes = def_coalesce_bytes);
+
+    ~mysqlpp_coalescer();  // flush all pending rows
+
+    // override the server's auto_increment_increment, 0 to use it
+    void set_auto_increment_increment(int increment) {
+        _increment = increment;
+    }
+
+    // columns like "a,b,c", or empty for all columns
+    mysqlpp_insert_queue *get_queue(const std::string &table, const std::string &columns);
+
+    void flush_all();
+
+    uint64_t get_rows() {
+        return _rows;
+    }
+
+    uint64_t get_statements() {
+        return _statements;
+    }
+
+    // -1 before the probe finished
+    int get_autoinc_lock_mode() {
+        return _autoinc_lock_mode;
+    }
+
+private:
+    friend class mysqlpp_insert_queue;
+
+    static bool probe_callback(mysqlpp_conn *conn, void *argument);
+
+    void probe();
+    void send(insert_batch_t *batch);
+    void send_held();
+
+    struct event_base *_evloop;
+    mysqlpp_pool *_pp;
+
+    int _max_rows;
+    int _max_delay;
+    int _max_bytes;
+    int _increment;         // set by the user, 0 for the server's
+    int _server_increment;
+
+    uint64_t _rows;
+    uint64_t _statements;
+
+    int _autoinc_lock_mode;
+    autoinc_probe_t *_probe;
+    std::vector<insert_batch_t *> _held;  // waiting for the probe
+
+    std::map<std::string, mysqlpp_insert_queue *> _queues;
+};
+
+#endif
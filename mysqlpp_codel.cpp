@@ -0,0 +1,30 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 12:00:00
+ * @modify date 2026-10-20 12:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_codel.h"
+
+mysqlpp_codel::mysqlpp_codel(uint64_t target_usec, uint64_t interval_usec)
+    : _target(target_usec),
+      _interval(interval_usec),
+      _interval_end(0),
+      _min_delay(0),
+      _overloaded(false) {
+}
+
+void mysqlpp_codel::sample(uint64_t now, uint64_t delay) {
+    if (now >= _interval_end) {
+        // the verdict of the last interval holds for the next one
+        _overloaded = _interval_end && _min_delay > _target;
+        _min_delay = delay;
+        _interval_end = now + _interval;
+        return;
+    }
+
+    if (delay < _min_delay) {
+        _min_delay = delay;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 12:00:00
+ * @modify date 2026-10-20 19:00:00
+ * @desc [CoDel排队延迟检测: 一个周期内的最小排队时间超过target认为有持续积压]
+ */
+
+#ifndef __mysql_codel_h__
+#define __mysql_codel_h__
+
+#include <stdint.h>
+
+static const uint64_t def_codel_target = 5 * 1000;      // 5ms
+static const uint64_t def_codel_interval = 100 * 1000;  // 100ms
+
+/*
+ 短暂的突发会在一个周期内排空, 周期内总有请求几乎不用等; 只有最小值也超过target时才是持续积压.
+ 过载期间排队超过2倍target的请求直接丢弃, 新请求不再排队, 让已经接纳的请求按时完成.
+ 队列排空就退出过载, 下一个周期重新开始判断.
+*/
+class mysqlpp_codel {
+public:
+    mysqlpp_codel(uint64_t target_usec = def_codel_target, uint64_t interval_usec = def_codel_interval);
+
+    void set(uint64_t target_usec, uint64_t interval_usec) {
+        _target = target_usec;
+        _interval = interval_usec;
+    }
+
+    // a request has waited delay usec so far (or in total when it leaves the queue)
+    void sample(uint64_t now, uint64_t delay);
+
+    // sample, then whether the request should be shed
+    bool observe(uint64_t now, uint64_t delay) {
+        sample(now, delay);
+        return _overloaded && delay > slough();
+    }
+
+    // the queue is empty: leave the overloaded state and start over
+    void drained() {
+        _overloaded = false;
+        _interval_end = 0;
+    }
+
+    bool overloaded() {
+        return _overloaded;
+    }
+
+    uint64_t target() {
+        return _target;
+    }
+
+    uint64_t slough() {
+        return 2 * _target;
+    }
+
+private:
+    uint64_t _target;
+    uint64_t _interval;
+
+    uint64_t _interval_end;
+    uint64_t _min_delay;
+    bool _overloaded;
+};
+
+#endif
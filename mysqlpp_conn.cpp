@@ -8,8 +8,15 @@
 
 #include "mysqlpp_conn.h"
 #include "mysqlpp_pool.h"
+#include "mysqlpp_stmtstats.h"
+#include "mysqlpp_recorder.h"
+#include <ctype.h>
 #include <event.h>
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/socket.h>
 
 #define NEXT_IMMEDIATE(conn, new_st) do { conn->_status= new_st; goto again; } while (0)
 
@@ -38,6 +45,29 @@ static double parseDouble(const char *s) {
 	return d;
 }
 
+// local infile handler is installed on every connection, only the stream of load_data() can be read,
+// so a server asking for arbitrary local file will be refused
+static int local_infile_init(void **ptr, const char *filename, void *userdata) {
+    *ptr = userdata;
+
+    return ((mysqlpp_conn *)userdata)->get_load_writer() ? 0 : 1;
+}
+
+static int local_infile_read(void *ptr, char *buf, unsigned int buf_len) {
+    return ((mysqlpp_conn *)ptr)->get_load_writer()->read(buf, buf_len);
+}
+
+static void local_infile_end(void *ptr) {
+}
+
+static int local_infile_error(void *ptr, char *error_msg, unsigned int error_msg_len) {
+    mysqlpp_load_writer *w = ((mysqlpp_conn *)ptr)->get_load_writer();
+
+    snprintf(error_msg, error_msg_len, "%s", w ? w->error() : "LOAD DATA LOCAL INFILE is only allowed by load_data()");
+
+    return 2000;  // CR_UNKNOWN_ERROR
+}
+
 static bool str_byte_equal(const char *a, const char *b) {
 	if (a && b) {
         while (*a && *b)
@@ -51,6 +81,8 @@ mysqlpp_bind::mysqlpp_bind(int size) {
     _size = size;
     _bind = new MYSQL_BIND[_size];
     _params = new param_t[_size];
+
+    memset(_bind, 0, sizeof(MYSQL_BIND) * _size);
 }
 
 mysqlpp_bind::~mysqlpp_bind() {
@@ -69,6 +101,10 @@ bool mysqlpp_bind::bind_stmt(MYSQL_STMT *stmt) {
 }
 
 bool mysqlpp_bind::set_string(int parameterIndex, const char *x) {
+    return set_string(parameterIndex, x, x ? strlen(x) : 0);
+}
+
+bool mysqlpp_bind::set_string(int parameterIndex, const char *x, size_t size) {
     int i = parameterIndex - 1;
     
     if (i < 0 || i >= _size) {
@@ -81,7 +117,7 @@ bool mysqlpp_bind::set_string(int parameterIndex, const char *x) {
         _params[i].length = 0;
         _bind[i].is_null = &yes;
     } else {
-        _params[i].length = strlen(x);
+        _params[i].length = size;
         _bind[i].is_null = 0;
     }
     _bind[i].length = &_params[i].length;
@@ -182,27 +218,117 @@ bool mysqlpp_bind::set_blob(int parameterIndex, const void *x, int size) {
 mysqlpp_result::mysqlpp_result(int columnCount, MYSQL_RES *meta, MYSQL_STMT *stmt)
     : _columnCount(columnCount),
       _meta(meta),
+      _fields(mysql_fetch_fields(meta)),
       _stmt(stmt) {
+    _init_columns();
+}
+
+mysqlpp_result::mysqlpp_result(int columnCount, MYSQL_FIELD *fields)
+    : _columnCount(columnCount),
+      _meta(nullptr),
+      _fields(fields),
+      _stmt(nullptr) {
+    _init_columns();
+}
+
+void mysqlpp_result::_init_columns() {
     _needRebind = false;
 
-    _bind = new MYSQL_BIND[columnCount];
-    _columns = new column_t[columnCount];
+    _bind = new MYSQL_BIND[_columnCount];
+    _columns = new column_t[_columnCount];
 
-    for (int i = 0; i < columnCount; i++) {
+    memset(_bind, 0, sizeof(MYSQL_BIND) * _columnCount);
+
+    for (int i = 0; i < _columnCount; i++) {
         _columns[i].buffer = new char[STRLEN + 1];
+        _columns[i].is_null = 1;
+        _columns[i].real_length = 0;
         _bind[i].buffer_type = MYSQL_TYPE_STRING;
         _bind[i].buffer = _columns[i].buffer;
         _bind[i].buffer_length = STRLEN;
         _bind[i].is_null = &_columns[i].is_null;
         _bind[i].length = &_columns[i].real_length;
-        _columns[i].field = mysql_fetch_field_direct(meta, i);
+        _columns[i].field = &_fields[i];
+    }
+}
+
+bool mysqlpp_result::set_value(int columnIndex, const char *value, unsigned long length) {
+    int i = columnIndex - 1;
+
+    if (_stmt || i < 0 || i >= _columnCount) {
+        return false;
+    }
+
+    if (!value) {
+        _columns[i].is_null = 1;
+        _columns[i].real_length = 0;
+        return true;
+    }
+
+    if (length > _bind[i].buffer_length) {
+        delete [] _columns[i].buffer;
+
+        _columns[i].buffer = new char[length + 1];
+
+        _bind[i].buffer = _columns[i].buffer;
+        _bind[i].buffer_length = length;
     }
+
+    memcpy(_columns[i].buffer, value, length);
+    _columns[i].is_null = 0;
+    _columns[i].real_length = length;
+
+    return true;
 }
 
 int mysqlpp_result::bind_stmt_result() {
     return mysql_stmt_bind_result(_stmt, _bind);
 }
 
+int mysqlpp_result::rebind() {
+    if (!_needRebind) {
+        return 0;
+    }
+
+    _needRebind = false;
+
+    return mysql_stmt_bind_result(_stmt, _bind);
+}
+
+MYSQL_FIELD *mysqlpp_result::get_fields() {
+    return _fields;
+}
+
+void mysqlpp_result::get_text_row(std::vector<char *> &row, std::vector<unsigned long> &lengths) {
+    row.resize(_columnCount);
+    lengths.resize(_columnCount);
+
+    for (int i = 0; i < _columnCount; i++) {
+        if (_columns[i].is_null) {
+            row[i] = nullptr;
+            lengths[i] = 0;
+            continue;
+        }
+
+        _ensure_capacity(i);
+        _columns[i].buffer[_columns[i].real_length] = 0;
+
+        row[i] = _columns[i].buffer;
+        lengths[i] = _columns[i].real_length;
+    }
+}
+
+unsigned long mysqlpp_result::get_row_bytes() {
+    unsigned long bytes = 0;
+
+    for (int i = 0; i < _columnCount; i++) {
+        if (!_columns[i].is_null)
+            bytes += _columns[i].real_length;
+    }
+
+    return bytes;
+}
+
 int mysqlpp_result::get_index(const char *name) {
     for (int i = 0; i < _columnCount; i++) {
         if (str_byte_equal(name, _columns[i].field->name)) {
@@ -217,7 +343,7 @@ void mysqlpp_result::_ensure_capacity(int index) {
     if (_columns[index].real_length <= _bind[index].buffer_length) 
         return;
 
-    delete _columns[index].buffer;
+    delete [] _columns[index].buffer;
 
     _columns[index].buffer = new char[_columns[index].real_length + 1];
 
@@ -340,7 +466,9 @@ mysqlpp_result::~mysqlpp_result() {
     delete [] _bind;
     delete [] _columns;
 
-    mysql_free_result(_meta);
+    if (_meta) {
+        mysql_free_result(_meta);
+    }
 }
 
 mysqlpp_conn::mysqlpp_conn(struct event_base *loop,
@@ -356,12 +484,16 @@ mysqlpp_conn::mysqlpp_conn(struct event_base *loop,
       _failed(false),
       _eof(false),
       _closing(false),
+      _paused(false),
+      _in_callback(false),
       _pp(pp),
       _attached(false),
       _connected(false),
       _prepared(false),
       _available(false),
       _bind(nullptr),
+      _loader(nullptr),
+      _load_affected(0),
       _state_machine(nullptr),
       _loop(loop),
       _columns(0),
@@ -373,17 +505,47 @@ mysqlpp_conn::mysqlpp_conn(struct event_base *loop,
       _port(port),
       _err(0),
       _e(false),
+      _req_start(0),
+      _checkout(0),
+      _connect_start(0),
+      _pooled(false),
+      _calling(0),
+      _fp(0),
+      _req_rows(0),
+      _record_id(0),
+      _promoted(false),
+      _shape_hash(0),
+      _stmt_tick(0),
+      _idempotent(false),
+      _attempt(0),
+      _retry_lost(false),
+      _replay(false),
+      _dirty(false),
+      _idle_since(0),
+      _multi(false),
+      _batch_user(0),
+      _batch_pos(0),
+      _batch_multi(false),
+      _batch_eof(false),
+      _batch_affected(0),
+      _batch_insert_id(0),
       _status(CONNECT_START) {
     set_def_option();
 
     _event = new event;
     memset(_event, 0, sizeof(struct event));
+
+    memset(&_trace, 0, sizeof(_trace));
 }
 
 void mysqlpp_conn::set_def_option() {
     mysql_init(&_mysql);
     mysql_options(&_mysql, MYSQL_READ_DEFAULT_GROUP, "mysql++");  // mysql++ for option file
     mysql_options(&_mysql, MYSQL_OPT_NONBLOCK, 0);  // 0 for stack size, 0 is default value
+
+    unsigned int local_infile = 1;
+    mysql_options(&_mysql, MYSQL_OPT_LOCAL_INFILE, &local_infile);
+    mysql_set_local_infile_handler(&_mysql, local_infile_init, local_infile_read, local_infile_end, local_infile_error, this);
 }
 
 
@@ -391,220 +553,825 @@ void mysqlpp_conn::set_def_option() {
 mysqlpp_conn::~mysqlpp_conn() {
     delete _event;
 
+    free_stmt_cache();
+
+    uint64_t start = _pp->_stall_threshold ? now_usec() : 0;
+
     mysql_close(&_mysql);
+
+    if (start) {
+        _pp->observe_stall(this, "mysql_close", _sql, now_usec() - start, false);
+    }
 }
 
 void mysqlpp_conn::init_library(int argc, const char **argv, char **groups) {
     mysql_library_init(argc, (char **)argv, groups);
 }
 
-void mysqlpp_conn::detach_event() {
-    if (_attached) {
-        event_del(_event);;
-    }
+uint64_t mysqlpp_conn::now_usec() {
+    struct timespec ts;
 
-    _attached = false;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    memset(_event, 0, sizeof(struct event));
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-void mysqlpp_conn::free_result() {
-    if (_result) {
-        mysql_free_result(_result); // must be called after fetch all result, otherwise will blocking
+void mysqlpp_conn::request_start() {
+    uint64_t now = now_usec();
+
+    if (!_req_start) {
+        _pp->request_started();
     }
 
-    _result = nullptr;
-    _eof = false;
+    _req_start = now;
+    _req_rows = 0;
+    _attempt = 0;
+    _replay = false;
+
+    // execute()紧跟在prepare()之后时, 沿用prepare开始的记录
+    if (!_exec_flag || !_trace.start || _trace.done) {
+        trace_begin(now);
+    }
 }
 
-void mysqlpp_conn::free_stmt_blocking() {
-    if (_stmt) {
-        mysql_stmt_close(_stmt);
+void mysqlpp_conn::request_done() {
+    if (!_req_start) {
+        return;
     }
 
-    _stmt = nullptr;
-}
+    uint64_t now = now_usec();
+    uint64_t elapsed = now - _req_start;
+    _req_start = 0;
 
-void mysqlpp_conn::unset_callback() {
-    _user_callback = nullptr;
-    _user_argument = nullptr;
+    _pp->request_finished(elapsed);
+
+    if (_pp->_stmt_stats && !_fp_text.empty()) {
+        _pp->_stmt_stats->record(_fp, _fp_text, elapsed, _req_rows, _failed);
+    }
+
+    if (_pp->_recorder) {
+        _pp->_recorder->done(record_id(), elapsed, _req_rows, _failed);
+    }
+
+    if (_trace.start && !_trace.done) {
+        _trace.done = now;
+        _pp->record_trace(_trace);
+    }
 }
 
-void mysqlpp_conn::cleanup() {
+void mysqlpp_conn::count_row() {
+    unsigned long bytes = 0;
+
     if (_exec_result) {
-        delete _exec_result;
-        _exec_result = nullptr;
+        bytes = _exec_result->get_row_bytes();
+    } else {
+        unsigned long *lengths = mysql_fetch_lengths(_result);
+        for (int i = 0; lengths && i < _columns; i++) {
+            bytes += lengths[i];
+        }
     }
 
-    _failed = false;
-    _eof = false;
-    _closing = false;
+    _req_rows++;
 
-    _sb.clear();
+    mysqlpp_metrics::add(_pp->_metrics.rows, 1);
+    mysqlpp_metrics::add(_pp->_metrics.bytes_received, bytes);
 
-    detach_event();
+    if (_trace.start) {
+        _trace.rows++;
+        if (!_trace.first_row)
+            _trace.first_row = now_usec();
+    }
+}
 
-    // _stmt shoule be close in event loop, because mysql_stmt_close will blocking
+void mysqlpp_conn::fingerprint_sql() {
+    if (!_pp->_stmt_stats) {
+        _fp_text.clear();
+        return;
+    }
 
-    free_result();
-    free_stmt_blocking();
+    _fp = mysqlpp_stmt_stats::fingerprint(_sql.data(), _sql.size(), _fp_text);
+}
 
-    if (_bind) {
-        delete _bind;
-        _bind = nullptr;
+uint32_t mysqlpp_conn::record_id() {
+    if (!_record_id) {
+        _record_id = _pp->_recorder->next_conn();
     }
 
-    _state_machine = nullptr;
-    _columns = 0;
-    _exec_flag = false;
-    _err = 0;
-    _e = false;
+    return _record_id;
+}
 
-    _sql.clear();
+void mysqlpp_conn::trace_begin(uint64_t now) {
+    memset(&_trace, 0, sizeof(_trace));
 
-    _status = CONNECT_START;
+    if (_pp->_phase_timing) {
+        _trace.start = now;
+    }
 }
 
-void mysqlpp_conn::next_event(Estatus new_status, int status) {
-    short wait_event= 0;
-    struct timeval tv, *ptv;
-    int fd;
+// stall检测开启时给用户回调计时. 回调里发起的新请求会覆盖_sql, 旧语句由cleanup交换到_stall_sql里保留
+bool mysqlpp_conn::call_user(const char *what) {
+    if (!_pp->_stall_threshold) {
+        return _user_callback(this, _user_argument);
+    }
 
-    detach_event();  // first detach event
+    uint64_t start = now_usec();
 
-    if (status & MYSQL_WAIT_READ)
-        wait_event |= EV_READ;
-    if (status & MYSQL_WAIT_WRITE)
-        wait_event |= EV_WRITE;
-    if (wait_event)
-        fd= mysql_get_socket(&_mysql);
-    else
-        fd= -1;
+    _calling++;
+    bool done = _user_callback(this, _user_argument);
+    _calling--;
 
-    if (status & MYSQL_WAIT_TIMEOUT) {
-        tv.tv_sec= mysql_get_timeout_value(&_mysql);
-        tv.tv_usec= 0;
-        ptv= &tv;
-    } else {
-        ptv= NULL;
+    _pp->observe_stall(this, what, _stall_sql.empty() ? _sql : _stall_sql, now_usec() - start, true);
+
+    if (!_calling) {
+        _stall_sql.clear();
     }
 
-    ::event_set(_event, fd, wait_event, this->_state_machine, this);
-    ::event_base_set(_loop, _event);
-    ::event_add(_event, ptv);
+    return done;
+}
 
-    _attached = true;
+// 只有不带用户变量的普通DML和只读语句不会留下会话状态, 其它的(SET, USE, LOCK, CREATE TEMPORARY,
+// CALL, BEGIN...)都认为改变了会话. 事务由归还时的server_status判断
+static bool leaves_session_state(const std::string &sql) {
+    static const char *clean[] = {"SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE", "SHOW", "DESCRIBE", "DESC", "EXPLAIN", "WITH", nullptr};
 
-    _status = new_status;
+    const char *p = sql.c_str();
+
+    for (;;) {
+        while (isspace((unsigned char)*p) || *p == '(')
+            p++;
+
+        if (p[0] == '/' && p[1] == '*') {
+            const char *end = strstr(p + 2, "*/");
+            if (!end)
+                return true;
+            p = end + 2;
+            continue;
+        }
+
+        break;
+    }
+
+    size_t n = 0;
+    while (isalpha((unsigned char)p[n]))
+        n++;
+
+    bool known = false;
+    for (int i = 0; clean[i]; i++) {
+        if (strlen(clean[i]) == n && strncasecmp(p, clean[i], n) == 0) {
+            known = true;
+            break;
+        }
+    }
+
+    // SELECT @a := 1, SELECT ... INTO @a, SELECT GET_LOCK(...)
+    return !known || sql.find('@') != std::string::npos || strcasestr(p, "GET_LOCK") != nullptr;
 }
 
-int mysqlpp_conn::mysql_status(short event) {
-    int status= 0;
-    if (event & EV_READ)
-        status|= MYSQL_WAIT_READ;
-    if (event & EV_WRITE)
-        status|= MYSQL_WAIT_WRITE;
-    if (event & EV_TIMEOUT)
-        status|= MYSQL_WAIT_TIMEOUT;
-    return status;
+void mysqlpp_conn::mark_dirty() {
+    if (!_dirty && _pp->_reset_on_return && leaves_session_state(_sql)) {
+        _dirty = true;
+    }
 }
 
-const char *mysqlpp_conn::error() {
-    if (!_sb.empty()) {
-        return _sb.c_str();
+// 多条语句一个packet发送(连接有CLIENT_MULTI_STATEMENTS时), 否则逐条发送, 结果的处理相同
+void mysqlpp_conn::query_batch(std::vector<std::string> &statements, size_t user) {
+    cleanup();
+
+    _batch.swap(statements);
+    _batch_user = user;
+
+    // "UPDATE ...;" would become "UPDATE ...;; COMMIT", an empty query for the server
+    for (size_t i = 0; i < _batch.size(); i++) {
+        std::string &s = _batch[i];
+        size_t n = s.size();
+
+        while (n && (s[n - 1] == ';' || isspace((unsigned char)s[n - 1])))
+            n--;
+        s.resize(n);
     }
+    _batch_pos = 0;
+    _exec_flag = false;
 
-    return mysql_error(&_mysql);
-}
+    // stats and dirty tracking see the user's statement only
+    _sql = _batch[_batch_user];
 
-void mysqlpp_conn::conn_done() {
-    if (!_ret) {
-        _failed = true;
-        _user_callback(this, _user_argument);  // user close and destroy it!
-        return;
+    fingerprint_sql();
+    mark_dirty();
+
+    if (_pp->_recorder) {
+        for (size_t i = 0; i < _batch.size(); i++) {
+            _pp->_recorder->query(record_id(), _batch[i]);
+        }
     }
 
-    _connected = true;
+    _batch_multi = _pp->_multi_statements;
 
-    if (_exec_flag) {
-        _status = PREPARE_START;
-        _state_machine = &prepare_state_machine;
-    } else {
-        _status = QUERY_START;
-        _state_machine = &query_state_machine;
+    if (_batch_multi) {
+        _sql.clear();
+        for (size_t i = 0; i < _batch.size(); i++) {
+            if (i)
+                _sql += "; ";
+            _sql += _batch[i];
+        }
     }
 
-    _state_machine(-1, -1, this);
-}
+    request_start();
 
-void mysqlpp_conn::query_done() {
-    if (mysql_errno(&_mysql)) {
-        _failed = true;
-        _user_callback(this, _user_argument);
-        return;
+    for (size_t i = 0; i < _batch.size(); i++) {
+        mysqlpp_metrics::add(_pp->_metrics.bytes_sent, _batch[i].size());
     }
 
-    if (!_result) {
-        _user_callback(this, _user_argument);
+    if (!_connected) {
+        connect();
         return;
     }
 
-    _columns = mysql_field_count(&_mysql);
+    _status = QUERY_START;
+    _state_machine = &query_state_machine;
 
-    _status = FETCH_ROW_START;
-    _state_machine = &fetch_state_machine;
     _state_machine(-1, -1, this);
 }
 
-int mysqlpp_conn::row_done() {
-    int ret = 0;
-
-    if (mysql_errno(&_mysql)) {
-        _failed = true;
-        ret = 1;
+// 用户的语句结束, 还有COMMIT要执行时, 保留结果状态, 最后一条结束才回调
+bool mysqlpp_conn::batch_continue() {
+    if (_batch.empty() || _batch_pos + 1 >= _batch.size()) {
+        return false;
     }
 
-    if (ret == 0 && _row == nullptr) {
-        _eof = true;
-        ret = 1;
-    }
+    _batch_eof = _eof;
+    _batch_affected = mysql_affected_rows(&_mysql);
+    _batch_insert_id = mysql_insert_id(&_mysql);
 
-    bool done = _user_callback(this, this->_user_argument);
-    if (done || _closing) {
-        ret = 1;
-    }
+    next_statement();
 
-    return ret;
+    return true;
 }
 
-void mysqlpp_conn::prepare_done() {
-    if (_err) {
-        _failed = true;
-        _user_callback(this, _user_argument);
-        return;
-    }
+void mysqlpp_conn::next_statement() {
+    free_result();  // read to the end, does not block
 
-    _prepared = true;
+    _batch_pos++;
 
-    int size = mysql_stmt_param_count(_stmt);
-    if (size) {
-        _bind = new mysqlpp_bind(size);
+    if (_batch_multi) {
+        _status = NEXT_RESULT_START;
+        _state_machine = &next_result_state_machine;
+    } else {
+        _status = QUERY_START;
+        _state_machine = &query_state_machine;
     }
 
-    _user_callback(this, _user_argument);  // bind input argument in this calling. user calling execute
-    return;
+    _state_machine(-1, -1, this);
 }
 
-void mysqlpp_conn::close_stmt_done() {
-    _stmt = nullptr;
+// 死锁, 锁等待超时: 语句已经回滚, 连接可用. 连接断开: 重连之后再执行
+static bool transient_error(unsigned int err, bool &lost) {
+    switch (err) {
+    case 1213:  // ER_LOCK_DEADLOCK
+    case 1205:  // ER_LOCK_WAIT_TIMEOUT
+        lost = false;
+        return true;
+    case 2006:  // CR_SERVER_GONE_ERROR
+    case 2013:  // CR_SERVER_LOST
+        lost = true;
+        return true;
+    default:
+        return false;
+    }
+}
 
-    if (_user_callback) {  // user calling close stmt or stmt error
-        cleanup();
-        _user_callback(this, _user_argument);
-        return;
+// 只重试库返回的错误, 并且用户还没有收到任何行; LOAD DATA的数据源不能重放
+bool mysqlpp_conn::retry() {
+    if (!_idempotent || _attempt >= _pp->_retry_attempts || _req_rows || _closing || _loader || !_sb.empty() || !_batch.empty()) {
+        return false;
     }
 
-    add_to_connection_pool();
+    unsigned int err = _stmt ? mysql_stmt_errno(_stmt) : 0;
+    if (!err) {
+        err = mysql_errno(&_mysql);
+    }
+
+    if (!transient_error(err, _retry_lost)) {
+        return false;
+    }
+
+    // only an execute() of the user's statement, an auto prepared query() is retried as text
+    if (_exec_flag && _prepared && !_promoted) {
+        _replay = true;  // stays set if the re-prepare fails and is retried too
+    }
+
+    uint64_t wait = _pp->_retry_backoff << (_attempt < 20 ? _attempt : 20);
+    _attempt++;
+
+    mysqlpp_metrics::add(_pp->_metrics.retries, 1);
+
+    detach_event();
+
+    struct timeval tv;
+    tv.tv_sec = wait / 1000000;
+    tv.tv_usec = wait % 1000000;
+
+    ::event_set(_event, -1, 0, retry_callback, this);
+    ::event_base_set(_loop, _event);
+    ::event_add(_event, &tv);
+
+    _attached = true;
+
+    return true;
+}
+
+void mysqlpp_conn::retry_callback(int sockfd, short event, void *v) {
+    mysqlpp_conn *conn = (mysqlpp_conn *)v;
+
+    conn->_attached = false;
+    conn->retry_now();
+}
+
+// 丢弃失败的结果, 从头执行同一个请求. 请求计时和行数接着算, 用户只看到最终结果
+void mysqlpp_conn::retry_now() {
+    if (_exec_result) {
+        delete _exec_result;
+        _exec_result = nullptr;
+    }
+
+    free_result();
+
+    if (_promoted) {
+        if (_stmt) {
+            mysql_stmt_free_result(_stmt);  // owned by the cache, the retry goes through the text protocol
+        }
+
+        _stmt = nullptr;
+        _promoted = false;
+        _exec_flag = false;  // it was a query()
+        _prow.clear();
+        _plengths.clear();
+    }
+
+    if (_retry_lost) {
+        free_stmt_blocking();
+        free_stmt_cache();  // server side statements died with the connection
+
+        uint64_t start = _pp->_stall_threshold ? now_usec() : 0;
+
+        mysql_close(&_mysql);
+
+        if (start) {
+            _pp->observe_stall(this, "mysql_close", _sql, now_usec() - start, false);
+        }
+
+        set_def_option();
+
+        _connected = false;
+        _prepared = false;
+        _dirty = false;  // a new session
+    }
+
+    _failed = false;
+    _eof = false;
+    _err = 0;
+    _columns = 0;
+
+    if (!_connected) {
+        connect();  // conn_done goes on with prepare or query by _exec_flag
+        return;
+    }
+
+    if (_exec_flag) {
+        _status = _replay ? EXECUTE_START : PREPARE_START;
+        _state_machine = _replay ? &execute_state_machine : &prepare_state_machine;
+    } else {
+        _status = QUERY_START;
+        _state_machine = &query_state_machine;
+    }
+
+    _state_machine(-1, -1, this);
+}
+
+// producer暂时没有数据, 本条LOAD DATA已经结束: 等resume()之后再发下一条, 不回调用户
+bool mysqlpp_conn::load_continue() {
+    if (!_loader || _failed || !_loader->more()) {
+        return false;
+    }
+
+    _load_affected += mysql_affected_rows(&_mysql);
+
+    if (!_loader->suspend()) {
+        load_resumed(this);  // resumed while the statement was finishing
+    }
+
+    return true;
+}
+
+// 不直接跑状态机: resume()可能是在别的连接的回调里调用的
+void mysqlpp_conn::load_resumed(void *v) {
+    mysqlpp_conn *conn = (mysqlpp_conn *)v;
+
+    conn->detach_event();
+
+    struct timeval tv = {0, 0};
+
+    ::event_set(conn->_event, -1, 0, load_callback, conn);
+    ::event_base_set(conn->_loop, conn->_event);
+    ::event_add(conn->_event, &tv);
+
+    conn->_attached = true;
+}
+
+void mysqlpp_conn::load_callback(int sockfd, short event, void *v) {
+    mysqlpp_conn *conn = (mysqlpp_conn *)v;
+
+    conn->_attached = false;
+
+    mysqlpp_metrics::add(conn->_pp->_metrics.bytes_sent, conn->_sql.size());
+
+    conn->_status = QUERY_START;
+    conn->_state_machine = &query_state_machine;
+
+    conn->_state_machine(-1, -1, conn);
+}
+
+// 请求的最后一次回调: 先结算本次请求, 因为用户可能在回调里发起下一个请求
+bool mysqlpp_conn::final_callback() {
+    if (load_continue()) {
+        return true;  // stop the state machine, load_callback sends the next statement
+    }
+
+    if (_failed && retry()) {
+        return true;  // stop the state machine, retry_callback starts over
+    }
+
+    if (_failed) {
+        mysqlpp_metrics::add(_pp->_metrics.query_failures, 1);
+    }
+
+    request_done();
+
+    return call_user("final callback");
+}
+
+// 逐行回调: 用户返回true提前结束时, 如果回调里没有发起新请求, 则结算本次请求
+bool mysqlpp_conn::row_callback() {
+    uint64_t start = _req_start;
+
+    _in_callback = true;
+    bool done = call_user("row callback");
+    _in_callback = false;
+
+    if (done && !_paused && _req_start == start) {
+        request_done();
+    }
+
+    return done;
+}
+
+void mysqlpp_conn::detach_event() {
+    if (_attached) {
+        event_del(_event);;
+    }
+
+    _attached = false;
+
+    memset(_event, 0, sizeof(struct event));
+}
+
+void mysqlpp_conn::free_result() {
+    if (_result) {
+        uint64_t start = _pp->_stall_threshold ? now_usec() : 0;
+
+        mysql_free_result(_result); // must be called after fetch all result, otherwise will blocking
+
+        if (start) {
+            _pp->observe_stall(this, "mysql_free_result", _sql, now_usec() - start, false);
+        }
+    }
+
+    _result = nullptr;
+    _eof = false;
+}
+
+void mysqlpp_conn::close_stmt_blocking(MYSQL_STMT *stmt) {
+    uint64_t start = _pp->_stall_threshold ? now_usec() : 0;
+
+    mysql_stmt_close(stmt);
+
+    if (start) {
+        _pp->observe_stall(this, "mysql_stmt_close", _sql, now_usec() - start, false);
+    }
+}
+
+void mysqlpp_conn::free_stmt_blocking() {
+    if (_stmt) {
+        close_stmt_blocking(_stmt);
+    }
+
+    _stmt = nullptr;
+}
+
+void mysqlpp_conn::free_stmt_cache() {
+    std::unordered_map<std::string, cached_stmt_t>::iterator it;
+
+    for (it = _stmt_cache.begin(); it != _stmt_cache.end(); ++it) {
+        close_stmt_blocking(it->second.stmt);
+    }
+
+    _stmt_cache.clear();
+}
+
+void mysqlpp_conn::unset_callback() {
+    _user_callback = nullptr;
+    _user_argument = nullptr;
+}
+
+void mysqlpp_conn::cleanup() {
+    if (_exec_result) {
+        delete _exec_result;
+        _exec_result = nullptr;
+    }
+
+    _failed = false;
+    _eof = false;
+    _closing = false;
+    _paused = false;
+
+    _sb.clear();
+
+    detach_event();
+
+    // _stmt shoule be close in event loop, because mysql_stmt_close will blocking
+
+    free_result();
+
+    if (_promoted) {
+        if (_stmt) {
+            uint64_t start = _pp->_stall_threshold ? now_usec() : 0;
+
+            mysql_stmt_free_result(_stmt);  // keep the statement in cache
+
+            if (start) {
+                _pp->observe_stall(this, "mysql_stmt_free_result", _sql, now_usec() - start, false);
+            }
+        }
+
+        _stmt = nullptr;
+        _promoted = false;
+        _prow.clear();
+        _plengths.clear();
+    }
+
+    free_stmt_blocking();
+    _prepared = false;
+
+    if (_bind) {
+        delete _bind;
+        _bind = nullptr;
+    }
+
+    if (_loader) {
+        delete _loader;
+        _loader = nullptr;
+    }
+
+    _state_machine = nullptr;
+    _columns = 0;
+    _exec_flag = false;
+    _err = 0;
+    _e = false;
+
+    _batch.clear();
+    _batch_user = 0;
+    _batch_pos = 0;
+
+    if (_calling && _stall_sql.empty()) {
+        _stall_sql.swap(_sql);  // keep the statement for stall report
+    }
+
+    _sql.clear();
+
+    _status = CONNECT_START;
+}
+
+void mysqlpp_conn::next_event(Estatus new_status, int status) {
+    short wait_event= 0;
+    struct timeval tv, *ptv;
+    int fd;
+
+    detach_event();  // first detach event
+
+    if (status & MYSQL_WAIT_READ)
+        wait_event |= EV_READ;
+    if (status & MYSQL_WAIT_WRITE)
+        wait_event |= EV_WRITE;
+    if (wait_event)
+        fd= mysql_get_socket(&_mysql);
+    else
+        fd= -1;
+
+    if (status & MYSQL_WAIT_TIMEOUT) {
+        tv.tv_sec= mysql_get_timeout_value(&_mysql);
+        tv.tv_usec= 0;
+        ptv= &tv;
+    } else {
+        ptv= NULL;
+    }
+
+    ::event_set(_event, fd, wait_event, this->_state_machine, this);
+    ::event_base_set(_loop, _event);
+    ::event_add(_event, ptv);
+
+    _attached = true;
+
+    _status = new_status;
+}
+
+int mysqlpp_conn::mysql_status(short event) {
+    int status= 0;
+    if (event & EV_READ)
+        status|= MYSQL_WAIT_READ;
+    if (event & EV_WRITE)
+        status|= MYSQL_WAIT_WRITE;
+    if (event & EV_TIMEOUT)
+        status|= MYSQL_WAIT_TIMEOUT;
+    return status;
+}
+
+const char *mysqlpp_conn::error() {
+    if (!_sb.empty()) {
+        return _sb.c_str();
+    }
+
+    return mysql_error(&_mysql);
+}
+
+void mysqlpp_conn::conn_done() {
+    _pp->connect_finished(this, _ret != nullptr);
+
+    if (!_ret) {
+        mysqlpp_metrics::add(_pp->_metrics.connect_failures, 1);
+
+        _failed = true;
+        final_callback();  // user close and destroy it!
+        return;
+    }
+
+    _connected = true;
+
+    mysqlpp_metrics::add(_pp->_metrics.acquire_wait_usec, now_usec() - _connect_start);
+
+    if (_exec_flag) {
+        _status = PREPARE_START;
+        _state_machine = &prepare_state_machine;
+    } else {
+        _status = QUERY_START;
+        _state_machine = &query_state_machine;
+    }
+
+    _state_machine(-1, -1, this);
+}
+
+void mysqlpp_conn::query_done() {
+    if (mysql_errno(&_mysql)) {
+        _failed = true;
+        final_callback();
+        return;
+    }
+
+    if (!_batch.empty() && _batch_pos != _batch_user) {
+        // BEGIN, SAVEPOINT, COMMIT: just an OK packet
+        if (_batch_pos + 1 < _batch.size()) {
+            next_statement();
+            return;
+        }
+
+        if (_batch_pos > _batch_user) {
+            _eof = _batch_eof;
+        }
+
+        final_callback();
+        return;
+    }
+
+    if (!_result) {
+        if (batch_continue())
+            return;
+
+        final_callback();
+        return;
+    }
+
+    _columns = mysql_field_count(&_mysql);
+
+    _status = FETCH_ROW_START;
+    _state_machine = &fetch_state_machine;
+    _state_machine(-1, -1, this);
+}
+
+int mysqlpp_conn::row_done() {
+    int ret = 0;
+
+    if (mysql_errno(&_mysql)) {
+        _failed = true;
+        ret = 1;
+    }
+
+    if (ret == 0 && _row == nullptr) {
+        _eof = true;
+
+        if (batch_continue())
+            return 1;
+
+        ret = 1;
+    }
+
+    if (ret) {
+        final_callback();
+        return ret;
+    }
+
+    count_row();
+
+    bool done = row_callback();
+    if (done || _closing || _paused) {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+void mysqlpp_conn::prepare_done() {
+    if (_promoted) {
+        if (_err) {
+            // server side error like ER_UNSUPPORTED_PS, never try the shape again
+            bool reject = mysql_stmt_errno(_stmt) < 2000;
+
+            free_stmt_blocking();
+            unpromote(reject);
+            return;
+        }
+
+        if ((int)_stmt_cache.size() >= _pp->_auto_prepare_cache) {
+            std::unordered_map<std::string, cached_stmt_t>::iterator it, lru = _stmt_cache.begin();
+
+            for (it = _stmt_cache.begin(); it != _stmt_cache.end(); ++it) {
+                if (it->second.used < lru->second.used)
+                    lru = it;
+            }
+
+            close_stmt_blocking(lru->second.stmt);
+            _stmt_cache.erase(lru);
+        }
+
+        cached_stmt_t cached;
+        cached.stmt = _stmt;
+        cached.used = ++_stmt_tick;
+        _stmt_cache[_shape] = cached;
+
+        execute_promoted();
+        return;
+    }
+
+    if (_err) {
+        _failed = true;
+        final_callback();
+        return;
+    }
+
+    _prepared = true;
+
+    if (_replay) {
+        _replay = false;
+
+        // prepared again on a new connection, the parameters set by the user are kept in _bind
+        if (_bind && _bind->bind_stmt(_stmt)) {
+            _failed = true;
+            final_callback();
+            return;
+        }
+
+        _status = EXECUTE_START;
+        _state_machine = &execute_state_machine;
+        _state_machine(-1, -1, this);
+        return;
+    }
+
+    int size = mysql_stmt_param_count(_stmt);
+    if (size) {
+        _bind = new mysqlpp_bind(size);
+    }
+
+    call_user("prepare callback");  // bind input argument in this calling. user calling execute
+    return;
+}
+
+void mysqlpp_conn::close_stmt_done() {
+    _stmt = nullptr;
+
+    if (_user_callback) {  // user calling close stmt or stmt error
+        cleanup();
+        call_user("close stmt callback");
+        return;
+    }
+
+    add_to_connection_pool();
 
     return;
 }
@@ -624,10 +1391,12 @@ void mysqlpp_conn::execute_done() {
 
     columns = mysql_stmt_field_count(_stmt);
     if (!columns) {
-        _user_callback(this, _user_argument);
+        final_callback();
         return;
     }
 
+    _columns = columns;
+
     meta = mysql_stmt_result_metadata(_stmt);
     if (!meta)
         goto failed;
@@ -646,7 +1415,7 @@ void mysqlpp_conn::execute_done() {
 
 failed:
     _failed = true;
-    _user_callback(this, _user_argument);
+    final_callback();
     return;
 }
 
@@ -659,15 +1428,60 @@ bool mysqlpp_conn::stmt_fetch_done() {
         _eof = true;
     }
 
-    return _user_callback(this, this->_user_argument);
+    if (_failed || _eof) {
+        _prow.clear();
+        return final_callback();
+    }
+
+    if (_promoted) {
+        _exec_result->get_text_row(_prow, _plengths);
+    }
+
+    count_row();
+
+    return row_callback();
 }
 
 uint64_t mysqlpp_conn::affected_rows() {
+    if (_loader) {
+        return _load_affected + mysql_affected_rows(&_mysql);
+    }
+
+    if (!_batch.empty() && _batch_pos > _batch_user) {
+        return _batch_affected;  // not the trailing COMMIT's
+    }
+
+    if (_promoted && _stmt) {
+        return mysql_stmt_affected_rows(_stmt);
+    }
+
     return mysql_affected_rows(&_mysql);
 }
 
-uint64_t mysqlpp_conn::insert_id() {
-    return mysql_insert_id(&_mysql);
+uint64_t mysqlpp_conn::insert_id() {
+    if (!_batch.empty() && _batch_pos > _batch_user) {
+        return _batch_insert_id;
+    }
+
+    if (_promoted && _stmt) {
+        return mysql_stmt_insert_id(_stmt);
+    }
+
+    return mysql_insert_id(&_mysql);
+}
+
+int mysqlpp_conn::get_socket() {
+    return _connected ? (int)mysql_get_socket(&_mysql) : -1;
+}
+
+const char *mysqlpp_conn::info() {
+    const char *s = mysql_info(&_mysql);
+
+    return s ? s : "";
+}
+
+unsigned long mysqlpp_conn::thread_id() {
+    return _connected ? mysql_thread_id(&_mysql) : 0;
 }
 
 void mysqlpp_conn::stmt_fetch_state_machine(int sockfd, short event, void *v) {
@@ -678,6 +1492,8 @@ void mysqlpp_conn::stmt_fetch_state_machine(int sockfd, short event, void *v) {
 again:
     switch (conn->_status) {
     case STMT_FETCH_START:
+        if (conn->_exec_result)
+            conn->_exec_result->rebind();
         status = mysql_stmt_fetch_start(&conn->_err, conn->_stmt);
         if (status)
             conn->next_event(STMT_FETCH_WAITING, status);
@@ -693,7 +1509,7 @@ again:
         break;
     case STMT_FETCH_DONE:
         done = conn->stmt_fetch_done();
-        if (done || conn->_closing) 
+        if (done || conn->_closing || conn->_paused) 
             break;
         else 
             NEXT_IMMEDIATE(conn, STMT_FETCH_START);
@@ -729,6 +1545,7 @@ again:
         break;
 
     case CONNECT_DONE:
+        conn->trace_mark(conn->_trace.connected);
         conn->conn_done();  // set state machine function pointer and conn->_status
         break;
     default:
@@ -780,7 +1597,10 @@ void mysqlpp_conn::prepare_state_machine(int sockfd, short event, void *v) {
 again:
     switch (conn->_status) {
     case PREPARE_START:
-        status = mysql_stmt_prepare_start(&conn->_err, conn->_stmt, conn->_sql.c_str(), conn->_sql.size());
+        if (conn->_promoted)
+            status = mysql_stmt_prepare_start(&conn->_err, conn->_stmt, conn->_shape.c_str(), conn->_shape.size());
+        else
+            status = mysql_stmt_prepare_start(&conn->_err, conn->_stmt, conn->_sql.c_str(), conn->_sql.size());
         if (status)
             conn->next_event(PREPARE_WAITING, status);
         else 
@@ -796,6 +1616,7 @@ again:
         break;
 
     case PREPARE_DONE:
+        conn->trace_mark(conn->_trace.prepared);
         conn->prepare_done();
         break;
     default:
@@ -812,7 +1633,20 @@ void mysqlpp_conn::query_state_machine(int sockfd, short event, void *v) {
 again:
     switch (conn->_status) {
     case QUERY_START:
-        status = mysql_real_query_start(&conn->_err, &conn->_mysql, conn->_sql.c_str(), conn->_sql.size());
+        // 多语句只对事务的批次打开, 其它语句之前关掉
+        if (conn->_multi != (!conn->_batch.empty() && conn->_batch_multi)) {
+            NEXT_IMMEDIATE(conn, QUERY_OPTION_START);
+        }
+
+        conn->trace_mark(conn->_trace.issued);
+        if (!conn->_batch.empty() && !conn->_batch_multi) {
+            const std::string &s = conn->_batch[conn->_batch_pos];
+            status = mysql_real_query_start(&conn->_err, &conn->_mysql, s.c_str(), s.size());
+        } else {
+            status = mysql_real_query_start(&conn->_err, &conn->_mysql, conn->_sql.c_str(), conn->_sql.size());
+        }
+        if (status & MYSQL_WAIT_READ)
+            conn->trace_mark(conn->_trace.sent);  // request written, waiting for server
         if (status)
             conn->next_event(QUERY_WAITING, status);
         else 
@@ -821,16 +1655,46 @@ again:
 
     case QUERY_WAITING:
         status = mysql_real_query_cont(&conn->_err, &conn->_mysql, mysql_status(event));
+        if (status & MYSQL_WAIT_READ)
+            conn->trace_mark(conn->_trace.sent);
         if (status)
             conn->next_event(QUERY_WAITING, status);
         else
             NEXT_IMMEDIATE(conn, QUERY_RESULT_READY);
         break;
     case QUERY_RESULT_READY:
+        conn->trace_mark(conn->_trace.sent);
+        conn->trace_mark(conn->_trace.result);
         conn->_result = mysql_use_result(&conn->_mysql);
 
         conn->query_done();
         break;
+
+    case QUERY_OPTION_START:
+        status = mysql_set_server_option_start(&conn->_err, &conn->_mysql,
+            conn->_multi ? MYSQL_OPTION_MULTI_STATEMENTS_OFF : MYSQL_OPTION_MULTI_STATEMENTS_ON);
+        if (status)
+            conn->next_event(QUERY_OPTION_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, QUERY_OPTION_DONE);
+        break;
+    case QUERY_OPTION_WAITING:
+        status = mysql_set_server_option_cont(&conn->_err, &conn->_mysql, mysql_status(event));
+        if (status)
+            conn->next_event(QUERY_OPTION_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, QUERY_OPTION_DONE);
+        break;
+    case QUERY_OPTION_DONE:
+        if (conn->_err) {
+            conn->_failed = true;
+            conn->final_callback();  // error() is the option's
+            break;
+        }
+
+        conn->_multi = !conn->_multi;
+        NEXT_IMMEDIATE(conn, QUERY_START);
+        break;
     default:
         break;
     }
@@ -911,7 +1775,10 @@ void mysqlpp_conn::execute_state_machine(int sockfd, short event, void *v) {
 again:
     switch (conn->_status) {
     case EXECUTE_START:
+        conn->trace_mark(conn->_trace.issued);
         status = mysql_stmt_execute_start(&conn->_err, conn->_stmt);
+        if (status & MYSQL_WAIT_READ)
+            conn->trace_mark(conn->_trace.sent);
         if (status)
             conn->next_event(EXECUTE_WAITING, status);
         else 
@@ -919,12 +1786,16 @@ again:
         break;
     case EXECUTE_WAITING:
         status = mysql_stmt_execute_cont(&conn->_err, conn->_stmt, mysql_status(event));
+        if (status & MYSQL_WAIT_READ)
+            conn->trace_mark(conn->_trace.sent);
         if (status)
             conn->next_event(EXECUTE_WAITING, status);
         else 
             NEXT_IMMEDIATE(conn, EXECUTE_DONE);
         break;
     case EXECUTE_DONE:
+        conn->trace_mark(conn->_trace.sent);
+        conn->trace_mark(conn->_trace.result);
         conn->execute_done();
         break;
     default:
@@ -934,7 +1805,127 @@ again:
     return;
 }
 
+void mysqlpp_conn::reset_state_machine(int sockfd, short event, void *v) {
+    int status;
+    mysqlpp_conn *conn = (mysqlpp_conn *)v;
+
+again:
+    switch (conn->_status) {
+    case RESET_START:
+        status = mysql_reset_connection_start(&conn->_err, &conn->_mysql);
+        if (status)
+            conn->next_event(RESET_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, RESET_DONE);
+        break;
+    case RESET_WAITING:
+        status = mysql_reset_connection_cont(&conn->_err, &conn->_mysql, mysql_status(event));
+        if (status)
+            conn->next_event(RESET_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, RESET_DONE);
+        break;
+    case CHANGE_USER_START:
+        status = mysql_change_user_start(&conn->_e, &conn->_mysql, conn->_user.c_str(), conn->_passwd.c_str(), conn->_dbname.c_str());
+        if (status)
+            conn->next_event(CHANGE_USER_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, CHANGE_USER_DONE);
+        break;
+    case CHANGE_USER_WAITING:
+        status = mysql_change_user_cont(&conn->_e, &conn->_mysql, mysql_status(event));
+        if (status)
+            conn->next_event(CHANGE_USER_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, CHANGE_USER_DONE);
+        break;
+    case RESET_DONE:
+    case CHANGE_USER_DONE:
+        conn->reset_done();
+        break;
+    default:
+        break;
+    }
+
+    return;
+}
+
+void mysqlpp_conn::ping_state_machine(int sockfd, short event, void *v) {
+    int status;
+    mysqlpp_conn *conn = (mysqlpp_conn *)v;
+
+again:
+    switch (conn->_status) {
+    case PING_START:
+        status = mysql_ping_start(&conn->_err, &conn->_mysql);
+        if (status)
+            conn->next_event(PING_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, PING_DONE);
+        break;
+    case PING_WAITING:
+        status = mysql_ping_cont(&conn->_err, &conn->_mysql, mysql_status(event));
+        if (status)
+            conn->next_event(PING_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, PING_DONE);
+        break;
+    case PING_DONE:
+        conn->ping_done();
+        break;
+    default:
+        break;
+    }
+
+    return;
+}
+
+void mysqlpp_conn::next_result_state_machine(int sockfd, short event, void *v) {
+    int status;
+    mysqlpp_conn *conn = (mysqlpp_conn *)v;
+
+again:
+    switch (conn->_status) {
+    case NEXT_RESULT_START:
+        status = mysql_next_result_start(&conn->_err, &conn->_mysql);
+        if (status)
+            conn->next_event(NEXT_RESULT_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, NEXT_RESULT_DONE);
+        break;
+    case NEXT_RESULT_WAITING:
+        status = mysql_next_result_cont(&conn->_err, &conn->_mysql, mysql_status(event));
+        if (status)
+            conn->next_event(NEXT_RESULT_WAITING, status);
+        else
+            NEXT_IMMEDIATE(conn, NEXT_RESULT_DONE);
+        break;
+    case NEXT_RESULT_DONE:
+        conn->_result = conn->_err == 0 ? mysql_use_result(&conn->_mysql) : nullptr;
+        conn->query_done();  // an error is in mysql_errno
+        break;
+    default:
+        break;
+    }
+
+    return;
+}
+
 void mysqlpp_conn::connect() {
+    _connect_start = now_usec();
+    _multi = false;
+
+    if (!_pp->connect_allowed(this, _connect_start)) {
+        char tmp[128];
+        snprintf(tmp, sizeof(tmp), "circuit breaker open after repeated connect failures, retry in %llu ms",
+            (unsigned long long)(_pp->_breaker.retry_after(_connect_start) / 1000));
+
+        _sb = tmp;
+        _failed = true;
+        final_callback();  // the connection is destroyed by close(), a later query() on it tries again
+        return;
+    }
+
     _status = CONNECT_START;
     _state_machine = &conn_state_machine;
 
@@ -945,6 +1936,76 @@ void mysqlpp_conn::add_to_connection_pool() {
     cleanup();
     unset_callback();
 
+    _idempotent = false;
+    _replay = false;
+
+    if (_connected && _pp->_reset_on_return && (_dirty || (_mysql.server_status & SERVER_STATUS_IN_TRANS))) {
+        reset_session();  // add_connection when done
+        return;
+    }
+
+    _pp->add_connection(this);
+}
+
+// 空闲连接的健康检查, 已经从idle列表里取出, 用户拿不到. 结束后经add_connection放回或者销毁
+void mysqlpp_conn::keepalive() {
+    mysqlpp_metrics::add(_pp->_metrics.keepalive_pings, 1);
+
+    _status = PING_START;
+    _state_machine = &ping_state_machine;
+
+    _state_machine(-1, -1, this);
+}
+
+void mysqlpp_conn::ping_done() {
+    if (_err) {
+        mysqlpp_metrics::add(_pp->_metrics.keepalive_evictions, 1);
+        _connected = false;  // server restarted or network broken
+    }
+
+    detach_event();
+
+    _err = 0;
+    _status = CONNECT_START;
+    _state_machine = nullptr;
+
+    _pp->add_connection(this);
+}
+
+// 一个往返清掉会话状态并回滚未提交的事务, 代替断开重连. server端的预处理语句也一起失效
+void mysqlpp_conn::reset_session() {
+    free_stmt_cache();
+
+    mysqlpp_metrics::add(_pp->_metrics.session_resets, 1);
+
+    _status = _pp->_reset_unsupported ? CHANGE_USER_START : RESET_START;
+    _state_machine = &reset_state_machine;
+
+    _state_machine(-1, -1, this);
+}
+
+void mysqlpp_conn::reset_done() {
+    if (_status == RESET_DONE && _err && mysql_errno(&_mysql) == 1047) {  // ER_UNKNOWN_COM_ERROR, before MySQL 5.7
+        _pp->_reset_unsupported = true;
+
+        _err = 0;
+        _status = CHANGE_USER_START;
+        _state_machine(-1, -1, this);
+        return;
+    }
+
+    if (_err || _e) {
+        _connected = false;  // unknown session state, add_connection will destroy it
+    }
+
+    detach_event();
+
+    _err = 0;
+    _e = false;
+    _dirty = false;
+    _status = CONNECT_START;
+    _state_machine = nullptr;
+
     _pp->add_connection(this);
 }
 
@@ -957,6 +2018,12 @@ void mysqlpp_conn::close_callback(int sockfd, short event, void *v) {
 }
 
 void mysqlpp_conn::close() {
+    request_done();  // user abandon the request
+
+    if (_pp->_recorder) {
+        _pp->_recorder->close(record_id());
+    }
+
     _user_callback = nullptr;
     _user_argument = nullptr;
 
@@ -967,6 +2034,65 @@ void mysqlpp_conn::close() {
     event_base_once(_loop, -1, EV_TIMEOUT, close_callback, this, NULL);
 }
 
+void mysqlpp_conn::cancel() {
+    request_done();  // the elapsed time is a lower bound of the real latency, still worth to report
+
+    // paused or half read result must not be freed on a live socket, mysql_free_result would read all rows
+    int fd = mysql_get_socket(&_mysql);
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+    _idempotent = false;  // a cancelled request is never retried
+    _connected = false;  // add_connection will destroy it
+}
+
+void mysqlpp_conn::resume() {
+    if (!_paused) {
+        return;
+    }
+
+    _paused = false;
+
+    if (_in_callback) {
+        return;  // the running state machine will fetch next row after the callback returned
+    }
+
+    if (_exec_flag) {
+        _status = STMT_FETCH_START;
+        _state_machine = &stmt_fetch_state_machine;
+    } else {
+        _status = FETCH_ROW_START;
+        _state_machine = &fetch_state_machine;
+    }
+
+    _state_machine(-1, -1, this);
+}
+
+unsigned long *mysqlpp_conn::get_column_lengths() {
+    if (_promoted) {
+        return _plengths.empty() || _prow.empty() ? nullptr : &_plengths[0];
+    }
+
+    if (!_result || !_row) {
+        return nullptr;
+    }
+
+    return mysql_fetch_lengths(_result);
+}
+
+MYSQL_FIELD *mysqlpp_conn::get_fields() {
+    if (_promoted) {
+        return _exec_result ? _exec_result->get_fields() : nullptr;
+    }
+
+    if (!_result) {
+        return nullptr;
+    }
+
+    return mysql_fetch_fields(_result);
+}
+
 // interface for user calling
 
 void mysqlpp_conn::query(std::string &sql) {
@@ -975,11 +2101,120 @@ void mysqlpp_conn::query(std::string &sql) {
     _sql = sql;
     _exec_flag = false;
 
+    fingerprint_sql();
+    mark_dirty();
+
+    if (_pp->_recorder) {
+        _pp->_recorder->query(record_id(), _sql);
+    }
+
+    request_start();
+
+    mysqlpp_metrics::add(_pp->_metrics.bytes_sent, _sql.size());
+
     if (!_connected) {
         connect();
         return;
     }
 
+    if (_pp->_auto_prepare && promote()) {
+        return;
+    }
+
+    _status = QUERY_START;
+    _state_machine = &query_state_machine;
+
+    _state_machine(-1, -1, this);
+}
+
+// 热点形状改为预处理语句执行: 已缓存则直接execute, 否则先prepare. 返回false时按普通query执行
+bool mysqlpp_conn::promote() {
+    if (!mysqlpp_stmt_stats::parameterize(_sql.data(), _sql.size(), _shape, _literals)) {
+        return false;
+    }
+
+    _shape_hash = std::hash<std::string>()(_shape);
+
+    if (!_pp->promotion_hot(_shape_hash)) {
+        return false;
+    }
+
+    _promoted = true;
+
+    std::unordered_map<std::string, cached_stmt_t>::iterator it = _stmt_cache.find(_shape);
+    if (it != _stmt_cache.end()) {
+        it->second.used = ++_stmt_tick;
+        _stmt = it->second.stmt;
+
+        execute_promoted();
+        return true;
+    }
+
+    _stmt = mysql_stmt_init(&_mysql);
+    if (!_stmt) {
+        _promoted = false;
+        return false;
+    }
+
+    _status = PREPARE_START;
+    _state_machine = &prepare_state_machine;
+
+    _state_machine(-1, -1, this);
+    return true;
+}
+
+void mysqlpp_conn::execute_promoted() {
+    int count = (int)mysql_stmt_param_count(_stmt);
+
+    if (count != (int)_literals.size()) {
+        std::unordered_map<std::string, cached_stmt_t>::iterator it = _stmt_cache.find(_shape);
+        if (it != _stmt_cache.end()) {
+            close_stmt_blocking(it->second.stmt);
+            _stmt_cache.erase(it);
+        }
+
+        unpromote(true);
+        return;
+    }
+
+    if (count) {
+        _bind = new mysqlpp_bind(count);
+
+        for (int i = 0; i < count; i++) {
+            if (_literals[i].integer)
+                _bind->set_llong(i + 1, _literals[i].value);
+            else
+                _bind->set_string(i + 1, _literals[i].text.c_str());
+        }
+
+        if (_bind->bind_stmt(_stmt)) {
+            delete _bind;
+            _bind = nullptr;
+
+            unpromote(false);
+            return;
+        }
+    }
+
+    mysqlpp_metrics::add(_pp->_metrics.promoted, 1);
+
+    _exec_flag = true;
+
+    _status = EXECUTE_START;
+    _state_machine = &execute_state_machine;
+
+    _state_machine(-1, -1, this);
+}
+
+// fall back to text protocol, the statement is closed or still owned by the cache
+void mysqlpp_conn::unpromote(bool reject) {
+    if (reject) {
+        _pp->promotion_reject(_shape_hash);
+    }
+
+    _promoted = false;
+    _stmt = nullptr;
+
     _status = QUERY_START;
     _state_machine = &query_state_machine;
 
@@ -991,6 +2226,19 @@ void mysqlpp_conn::prepare(std::string &sql) {
 
     _sql = sql;
     _exec_flag = true;
+    _attempt = 0;
+    _replay = false;
+
+    fingerprint_sql();
+    mark_dirty();
+
+    if (_pp->_recorder) {
+        _pp->_recorder->prepare(record_id(), _sql);
+    }
+
+    trace_begin(now_usec());
+
+    mysqlpp_metrics::add(_pp->_metrics.bytes_sent, _sql.size());
 
     if (!_connected) {
         connect();
@@ -1003,17 +2251,56 @@ void mysqlpp_conn::prepare(std::string &sql) {
     _state_machine(-1, -1, this);
 }
 
+void mysqlpp_conn::load_data(const std::string &table, const std::string &columns,
+                load_producer producer, void *argument, load_format format) {
+    cleanup();
+
+    _loader = new mysqlpp_load_writer(format, producer, argument);
+    _loader->set_wakeup(load_resumed, this);
+    _load_affected = 0;
+
+    _sql = "LOAD DATA LOCAL INFILE 'mysqlpp.stream' INTO TABLE " + table + " ";
+    _sql += _loader->format_clause();
+    if (!columns.empty()) {
+        _sql += " (" + columns + ")";
+    }
+
+    fingerprint_sql();
+
+    _exec_flag = false;
+
+    request_start();
+
+    mysqlpp_metrics::add(_pp->_metrics.bytes_sent, _sql.size());
+
+    if (!_connected) {
+        connect();
+        return;
+    }
+
+    _status = QUERY_START;
+    _state_machine = &query_state_machine;
+
+    _state_machine(-1, -1, this);
+}
+
 void mysqlpp_conn::execute() {
+    if (_pp->_recorder) {
+        _pp->_recorder->execute(record_id(), _bind);
+    }
+
+    request_start();
+
     if (!_connected || !_prepared) {
         _failed = true;
         _sb = "execute should prepared first";
-        _user_callback(this, _user_argument);
+        final_callback();
         return;
     }
 
     if (_bind && _bind->bind_stmt(_stmt)) {
         _failed = true;
-        _user_callback(this, _user_argument);
+        final_callback();
         return;
     }
 
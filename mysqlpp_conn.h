@@ -10,8 +10,12 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <unordered_map>
 #include "mysql/mysql.h"
 #include "mysqlpp_pool.h"
+#include "mysqlpp_load.h"
+#include "mysqlpp_stmtstats.h"
 
 /*
  mysql_close/mysql_stmt_close这两个api只是简单的发送COM_QUIT/COM_STMT_CLOSE给server, 并且不等待响应，所以几乎是不会阻塞的(除非写buffer满).
@@ -28,6 +32,7 @@ struct event;
 struct event_base;
 
 class mysqlpp_pool;
+class mysqlpp_transaction;
 
 typedef struct param_s {
     union {
@@ -46,6 +51,7 @@ public:
     ~mysqlpp_bind();
 
     bool set_string(int parameterIndex, const char *x);
+    bool set_string(int parameterIndex, const char *x, size_t size);  // may contain '\0'
     bool set_int(int parameterIndex, int x);
     bool set_llong(int parameterIndex, long long x);
     bool set_double(int parameterIndex, double x);
@@ -55,6 +61,8 @@ public:
     bool bind_stmt(MYSQL_STMT *stmt);
 
 private:
+    friend class mysqlpp_recorder;
+
     param_t *_params;
     int _size;
     MYSQL_BIND *_bind;
@@ -70,12 +78,34 @@ typedef struct column_s {
 class mysqlpp_result {
 public:
     mysqlpp_result(int columnCount, MYSQL_RES *meta, MYSQL_STMT *stmt);
+
+    // 不属于预处理语句的结果, 值由set_value逐列拷贝进来, 例如让文本行也能用类型化和按列名的getter.
+    // fields由调用者持有, 至少columnCount个
+    mysqlpp_result(int columnCount, MYSQL_FIELD *fields);
+
     ~mysqlpp_result();
 
+    // detached result only, value nullptr for NULL
+    bool set_value(int columnIndex, const char *value, unsigned long length);
+
     int bind_stmt_result();
 
+    // 取值时扩大过缓冲区的列, 在下一次fetch之前重新绑定
+    int rebind();
+
+    MYSQL_FIELD *get_fields();
+
+    // current row as text, nullptr for NULL
+    void get_text_row(std::vector<char *> &row, std::vector<unsigned long> &lengths);
+
+    int get_column_count() {
+        return _columnCount;
+    }
+
     int get_index(const char *name);
 
+    unsigned long get_row_bytes();  // payload of current row
+
     const char *get_string(int columnIndex);
     const void *get_blob(int columnIndex, int &size);
     int get_int(int columnIndex, bool &is_null);
@@ -91,12 +121,14 @@ public:
     // time_t get_timestamp_by_name(const char *columnName);
 
 private:
+    void _init_columns();
     void _ensure_capacity(int index);
 
     bool _needRebind;
     int _columnCount;
     int _currentRow;
     MYSQL_RES *_meta;
+    MYSQL_FIELD *_fields;
     MYSQL_BIND *_bind;
     MYSQL_STMT *_stmt;
 
@@ -133,6 +165,9 @@ public:
         QUERY_START,
         QUERY_WAITING,
         QUERY_RESULT_READY,
+        QUERY_OPTION_START,
+        QUERY_OPTION_WAITING,
+        QUERY_OPTION_DONE,
 
         FETCH_ROW_START,
         FETCH_ROW_WAITING,
@@ -142,14 +177,35 @@ public:
         CLOSE_WAITING,
         CLOSE_DONE,
 
+        RESET_START,
+        RESET_WAITING,
+        RESET_DONE,
+        CHANGE_USER_START,
+        CHANGE_USER_WAITING,
+        CHANGE_USER_DONE,
+
+        PING_START,
+        PING_WAITING,
+        PING_DONE,
+
+        NEXT_RESULT_START,
+        NEXT_RESULT_WAITING,
+        NEXT_RESULT_DONE,
+
         NOTHING
     };
 
 public:
     static void init_library(int argc, const char **argv, char **groups);
 
+    static uint64_t now_usec();  // monotonic clock in microsecond
+
     void close();  // return back to connection pool or close it
 
+    // 中止正在执行的请求: shutdown socket, 挂起的非阻塞调用会立即出错返回, 不会阻塞event loop.
+    // 连接不会再被复用, close()之后由连接池释放
+    void cancel();
+
     bool is_available() {
         return _available;
     }
@@ -164,11 +220,39 @@ public:
 
     const char *error();
 
+    // 在逐行回调里调用: 回调返回后不再读取下一行, 当前行一直有效, 直到resume()
+    void pause() {
+        _paused = true;
+    }
+
+    void resume();
+
+    // 之后的query()/execute()可以安全地重复执行, 遇到暂时性错误时按pool的retry policy自动重试.
+    // 一直有效直到连接归还. 显式事务里不要设置: 死锁时server已经回滚了整个事务
+    void set_idempotent(bool idempotent) {
+        _idempotent = idempotent;
+    }
+
+    // 会话状态改变了但是从sql看不出来(例如存储过程里SET), 归还时需要reset, 见mysqlpp_pool::set_reset_on_return
+    void set_session_dirty() {
+        _dirty = true;
+    }
+
     void query(std::string &sql);
     void prepare(std::string &sql);
     void execute();
     void execute_query();
 
+    // LOAD DATA LOCAL INFILE from producer, columns like "a,b,c" or empty for all columns.
+    // 结束时回调一次, affected_rows()为导入的行数, info()为server返回的Records/Skipped/Warnings.
+    // producer每次LOAD_WOULD_BLOCK都会分成多条语句, affected_rows()是合计, info()只是最后一条的
+    void load_data(const std::string &table, const std::string &columns,
+        load_producer producer, void *argument, load_format format = LOAD_TSV);
+
+    mysqlpp_load_writer *get_load_writer() {
+        return _loader;
+    }
+
     bool result_eof() {
         return _eof;
     }
@@ -176,6 +260,12 @@ public:
     uint64_t affected_rows();
     uint64_t insert_id();
 
+    unsigned long thread_id();  // server side connection id, for KILL
+
+    const char *info();  // mysql_info of last statement
+
+    int get_socket();
+
     void set_user_callback(const user_callback &cb) {
         _user_callback = cb;
     }
@@ -201,9 +291,22 @@ public:
     }
 
     char **get_column_content() {
+        if (_promoted) {
+            return _prow.empty() ? nullptr : &_prow[0];
+        }
+
         return _row;
     }
 
+    unsigned long *get_column_lengths();  // lengths of current text row
+
+    MYSQL_FIELD *get_fields();  // column metadata of current text result, get_column_count() entries
+
+    // 当前请求的各阶段时间点, 在回调里读取, 最后一次回调时done已经设置. pool关闭计时时为nullptr
+    const query_trace_t *get_trace() {
+        return _trace.start ? &_trace : nullptr;
+    }
+
 private:
     mysqlpp_conn(struct event_base *loop,  
             const std::string &host, 
@@ -219,6 +322,9 @@ private:
     friend mysqlpp_conn *mysqlpp_pool::get_connection();
     friend void mysqlpp_pool::add_connection(mysqlpp_conn *conn);
     friend mysqlpp_pool::~mysqlpp_pool();
+    friend void mysqlpp_pool::keepalive_tick();
+
+    friend class mysqlpp_transaction;
 
     static void conn_state_machine(int sockfd, short event, void *v);
     static void query_state_machine(int sockfd, short event, void *v);
@@ -228,8 +334,14 @@ private:
     static void close_stmt_state_machine(int sockfd, short event, void *v);    
     static void stmt_fetch_state_machine(int sockfd, short event, void *v);
     static void execute_state_machine(int sockfd, short event, void *v);
+    static void reset_state_machine(int sockfd, short event, void *v);
+    static void ping_state_machine(int sockfd, short event, void *v);
+    static void next_result_state_machine(int sockfd, short event, void *v);
 
     static void close_callback(int sockfd, short event, void *v);
+    static void retry_callback(int sockfd, short event, void *v);
+    static void load_resumed(void *v);
+    static void load_callback(int sockfd, short event, void *v);
 
     void unset_callback();
 
@@ -243,6 +355,36 @@ private:
 
     void next_event(Estatus new_status, int status);
 
+    // 请求计时: query()/execute()开始, 到最后一次用户回调(或close)结束
+    void request_start();
+    void request_done();
+
+    void trace_begin(uint64_t now);
+
+    void trace_mark(uint64_t &slot) {
+        if (_trace.start && !slot)
+            slot = now_usec();
+    }
+
+    void count_row();
+
+    void fingerprint_sql();
+
+    uint32_t record_id();
+
+    bool promote();
+    void execute_promoted();
+    void unpromote(bool reject);
+    void close_stmt_blocking(MYSQL_STMT *stmt);
+
+    bool retry();
+    void retry_now();
+    bool load_continue();
+
+    bool call_user(const char *what);
+    bool final_callback();
+    bool row_callback();
+
     void conn_done();
     void query_done();
     int  row_done();
@@ -252,10 +394,22 @@ private:
     bool stmt_fetch_done();
     void close_done();
     void close_stmt_done();
+    void reset_done();
+    void ping_done();
+
+    void mark_dirty();
+    void reset_session();
+    void keepalive();
+
+    // statements[user]的结果交给用户, 其它的(BEGIN, SAVEPOINT, COMMIT)只检查是否出错
+    void query_batch(std::vector<std::string> &statements, size_t user);
+    bool batch_continue();
+    void next_statement();
 
     void detach_event();
     void free_result();  // 必须读完在free_result, 否则会阻塞
     void free_stmt_blocking();
+    void free_stmt_cache();
 
     static int mysql_status(short event);
 
@@ -272,6 +426,9 @@ private:
 
     bool _closing;
 
+    bool _paused;
+    bool _in_callback;  // inside a row callback
+
     std::string _sb;
 
     mysqlpp_pool *_pp;
@@ -292,6 +449,9 @@ private:
 
     mysqlpp_bind *_bind;
 
+    mysqlpp_load_writer *_loader;
+    uint64_t _load_affected;  // rows of the statements before the producer would block
+
     state_machine _state_machine;
 
     struct event_base *_loop;
@@ -312,6 +472,55 @@ private:
 
     std::string _sql;
 
+    uint64_t _req_start;  // 0 means no request outstanding
+
+    query_trace_t _trace;
+
+    uint64_t _checkout;       // handed out by pool
+    uint64_t _connect_start;
+    bool _pooled;             // in mysqlpp_pool::_conns
+
+    int _calling;             // depth of user callbacks being timed
+    std::string _stall_sql;   // statement replaced inside a timed callback
+
+    uint64_t _fp;             // fingerprint of _sql when statement stats is on
+    std::string _fp_text;     // normalized _sql, empty for none
+    uint64_t _req_rows;
+
+    uint32_t _record_id;      // connection number in the recorder's log, 0 for not yet
+
+    typedef struct cached_stmt_s {
+        MYSQL_STMT *stmt;
+        uint64_t used;
+    } cached_stmt_t;
+
+    bool _promoted;           // query() running as a cached prepared statement, _stmt is owned by _stmt_cache
+    std::string _shape;
+    size_t _shape_hash;
+    std::vector<stmt_literal_t> _literals;
+    std::unordered_map<std::string, cached_stmt_t> _stmt_cache;  // shape -> statement
+    uint64_t _stmt_tick;
+    std::vector<char *> _prow;
+    std::vector<unsigned long> _plengths;
+
+    bool _idempotent;
+    int _attempt;             // retries of the current request
+    bool _retry_lost;         // the connection is gone, reconnect before retrying
+    bool _replay;             // re-prepare, then execute with the kept _bind
+
+    bool _dirty;              // session state may be left behind: variables, temporary tables, locks
+
+    uint64_t _idle_since;     // back in the idle list, or last verified by a keepalive ping
+
+    bool _multi;              // multi statements may be on, switched only around pipelined batches
+
+    std::vector<std::string> _batch;  // statements of a transaction step, empty for none
+    size_t _batch_user;       // the statement whose result goes to the user
+    size_t _batch_pos;        // the statement whose result is being read
+    bool _batch_multi;        // sent in one packet, otherwise one by one
+    bool _batch_eof;          // of the user's statement, kept while the trailing ones run
+    uint64_t _batch_affected;
+    uint64_t _batch_insert_id;
 
     Estatus _status;
 };
@@ -0,0 +1,190 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 11:30:00
+ * @modify date 2026-10-19 11:30:00
+ * @desc [description]
+ */
+#include "mysqlpp_hedge.h"
+#include "mysqlpp_balancer.h"
+#include "mysqlpp_pool.h"
+#include <event.h>
+#include <string.h>
+
+mysqlpp_hedger::mysqlpp_hedger(struct event_base *evloop,
+                mysqlpp_balancer *balancer,
+                double percentile,
+                int min_delay,
+                int max_delay)
+    : _evloop(evloop),
+      _balancer(balancer),
+      _percentile(percentile),
+      _min_delay(min_delay),
+      _max_delay(max_delay),
+      _delay(max_delay),
+      _kill(true),
+      _requests(0),
+      _hedged(0),
+      _hedge_wins(0) {
+}
+
+mysqlpp_hedger::~mysqlpp_hedger() {
+}
+
+void mysqlpp_hedger::observe(uint64_t usec) {
+    _first_row.record(usec);
+
+    if (_first_row.count() < (uint64_t)def_hedge_window) {
+        return;
+    }
+
+    uint64_t delay = _first_row.percentile(_percentile);
+    if (delay < (uint64_t)_min_delay)
+        delay = _min_delay;
+    if (delay > (uint64_t)_max_delay)
+        delay = _max_delay;
+
+    _delay = (int)delay;
+    _first_row.reset();
+}
+
+void mysqlpp_hedger::issue(hedge_request_t *req, int side, mysqlpp_pool *pp) {
+    mysqlpp_conn *conn = pp->get_connection();
+
+    req->conns[side] = conn;
+    req->pools[side] = pp;
+    req->start[side] = mysqlpp_conn::now_usec();
+
+    conn->set_user_callback(&mysqlpp_hedger::request_callback);
+    conn->set_user_argument(req);
+
+    conn->query(req->sql);  // req may be finished and freed in this calling
+}
+
+void mysqlpp_hedger::query(std::string &sql, user_callback cb, void *argument) {
+    mysqlpp_pool *pp = _balancer->pick();
+
+    hedge_request_t *req = new hedge_request_t;
+    req->hedger = this;
+    req->cb = cb;
+    req->argument = argument;
+    req->sql = sql;
+    req->conns[0] = req->conns[1] = nullptr;
+    req->pools[0] = req->pools[1] = nullptr;
+    req->start[0] = req->start[1] = 0;
+
+    req->timer = new event;
+    memset(req->timer, 0, sizeof(struct event));
+    req->timer_added = false;
+
+    _requests++;
+
+    if (_balancer->size() > 1) {
+        struct timeval tv;
+        tv.tv_sec = _delay / 1000000;
+        tv.tv_usec = _delay % 1000000;
+
+        ::event_set(req->timer, -1, 0, timer_callback, req);
+        ::event_base_set(_evloop, req->timer);
+        ::event_add(req->timer, &tv);
+
+        req->timer_added = true;
+    }
+
+    issue(req, 0, pp);
+}
+
+void mysqlpp_hedger::timer_callback(int sockfd, short event, void *v) {
+    hedge_request_t *req = (hedge_request_t *)v;
+    mysqlpp_hedger *hedger = req->hedger;
+
+    req->timer_added = false;
+
+    mysqlpp_pool *pp = hedger->_balancer->pick(req->pools[0]);
+    if (!pp || pp == req->pools[0]) {
+        return;
+    }
+
+    hedger->_hedged++;
+    hedger->issue(req, 1, pp);
+}
+
+bool mysqlpp_hedger::kill_callback(mysqlpp_conn *conn, void *argument) {
+    conn->close();  // result of KILL QUERY is not interesting, thread may already gone
+
+    return true;
+}
+
+void mysqlpp_hedger::cancel(hedge_request_t *req, int side) {
+    mysqlpp_conn *conn = req->conns[side];
+    unsigned long id = conn->thread_id();
+
+    req->conns[side] = nullptr;
+
+    conn->cancel();
+    conn->close();
+
+    if (!_kill || !id) {
+        return;
+    }
+
+    std::string sql = "KILL QUERY " + std::to_string(id);
+
+    mysqlpp_conn *killer = req->pools[side]->get_connection();
+    killer->set_user_callback(&mysqlpp_hedger::kill_callback);
+    killer->query(sql);
+}
+
+// 把胜出的连接交给用户, 释放请求
+bool mysqlpp_hedger::finish(hedge_request_t *req, int winner) {
+    mysqlpp_conn *conn = req->conns[winner];
+    user_callback cb = req->cb;
+    void *argument = req->argument;
+
+    if (req->timer_added) {
+        event_del(req->timer);
+    }
+
+    if (req->conns[1 - winner]) {
+        cancel(req, 1 - winner);
+    }
+
+    if (!conn->failed()) {
+        observe(mysqlpp_conn::now_usec() - req->start[winner]);
+
+        if (winner == 1) {
+            _hedge_wins++;
+        }
+    }
+
+    delete req->timer;
+    delete req;
+
+    conn->set_user_callback(cb);
+    conn->set_user_argument(argument);
+
+    return cb(conn, argument);
+}
+
+// 两个查询的第一次回调(首行, 结果结束或者出错)都会到这里
+bool mysqlpp_hedger::request_callback(mysqlpp_conn *conn, void *argument) {
+    hedge_request_t *req = (hedge_request_t *)argument;
+    int side = conn == req->conns[0] ? 0 : 1;
+    int other = 1 - side;
+
+    if (conn->failed() && req->conns[other]) {
+        // 另一个查询还在执行, 等它的结果
+        req->conns[side] = nullptr;
+
+        conn->close();
+        return true;
+    }
+
+    if (conn->failed() && req->timer_added) {
+        // primary failed before hedging, no need to hedge any more
+        event_del(req->timer);
+        req->timer_added = false;
+    }
+
+    return req->hedger->finish(req, side);
+}
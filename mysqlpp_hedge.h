@@ -0,0 +1,109 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 11:30:00
+ * @modify date 2026-10-19 11:30:00
+ * @desc [hedged read: 首行在延迟阈值内没有返回时, 在第二个从库上发出同样的查询, 先返回的胜出]
+ */
+
+#ifndef __mysql_hedge_h__
+#define __mysql_hedge_h__
+
+#include <string>
+#include <stdint.h>
+#include "mysqlpp_conn.h"
+#include "mysqlpp_histogram.h"
+
+static const double def_hedge_percentile = 95.0;
+static const int def_hedge_min_delay = 1000;     // usec
+static const int def_hedge_max_delay = 200000;   // usec, also used before enough samples collected
+static const int def_hedge_window = 1024;        // recompute delay every window samples
+
+struct event;
+struct event_base;
+
+class mysqlpp_balancer;
+class mysqlpp_pool;
+
+class mysqlpp_hedger;
+
+typedef struct hedge_request_s {
+    mysqlpp_hedger *hedger;
+
+    user_callback cb;
+    void *argument;
+
+    std::string sql;
+
+    mysqlpp_conn *conns[2];  // 0 for primary, 1 for hedge
+    mysqlpp_pool *pools[2];
+    uint64_t start[2];
+
+    struct event *timer;
+    bool timer_added;
+} hedge_request_t;
+
+// hedger必须比它发出的请求活得更久, 所有pool必须属于evloop
+class mysqlpp_hedger {
+public:
+    mysqlpp_hedger(struct event_base *evloop,
+        mysqlpp_balancer *balancer,
+        double percentile = def_hedge_percentile,
+        int min_delay = def_hedge_min_delay,
+        int max_delay = def_hedge_max_delay);
+
+    ~mysqlpp_hedger();
+
+    // 取消落败的查询时, 另外发送KILL QUERY让server停止执行
+    void set_kill_on_cancel(bool kill) {
+        _kill = kill;
+    }
+
+    // 只能用于幂等的SELECT. 回调约定与mysqlpp_conn::query相同, 
+    // 胜出的连接和回调一起交给用户, 之后的行直接回调用户, 用户负责close
+    void query(std::string &sql, user_callback cb, void *argument);
+
+    int get_delay() {
+        return _delay;
+    }
+
+    uint64_t get_requests() {
+        return _requests;
+    }
+
+    uint64_t get_hedged() {
+        return _hedged;
+    }
+
+    uint64_t get_hedge_wins() {
+        return _hedge_wins;
+    }
+
+private:
+    static bool request_callback(mysqlpp_conn *conn, void *argument);
+    static bool kill_callback(mysqlpp_conn *conn, void *argument);
+    static void timer_callback(int sockfd, short event, void *v);
+
+    void issue(hedge_request_t *req, int side, mysqlpp_pool *pp);
+    bool finish(hedge_request_t *req, int winner);
+    void cancel(hedge_request_t *req, int side);
+    void observe(uint64_t usec);
+
+    struct event_base *_evloop;
+    mysqlpp_balancer *_balancer;
+
+    double _percentile;
+    int _min_delay;
+    int _max_delay;
+    int _delay;
+
+    bool _kill;
+
+    mysqlpp_histogram _first_row;  // time to first row of winners in current window
+
+    uint64_t _requests;
+    uint64_t _hedged;
+    uint64_t _hedge_wins;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 11:00:00
+ * @modify date 2026-10-19 11:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_histogram.h"
+#include <string.h>
+
+mysqlpp_histogram::mysqlpp_histogram() {
+    reset();
+}
+
+void mysqlpp_histogram::reset() {
+    memset(_counts, 0, sizeof(_counts));
+
+    _count = 0;
+    _sum = 0;
+    _min = UINT64_MAX;
+    _max = 0;
+}
+
+int mysqlpp_histogram::bucket_index(uint64_t value) {
+    if (value < (uint64_t)hist_sub_count) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= hist_max_bits) {
+        return hist_bucket_count - 1;
+    }
+
+    int shift = msb - hist_sub_bits;
+
+    return (shift + 1) * hist_sub_count + (int)((value >> shift) - hist_sub_count);
+}
+
+uint64_t mysqlpp_histogram::bucket_upper(int index) {
+    if (index < hist_sub_count) {
+        return (uint64_t)index;
+    }
+
+    int shift = index / hist_sub_count - 1;
+    uint64_t sub = (uint64_t)(index % hist_sub_count + hist_sub_count);
+
+    return ((sub + 1) << shift) - 1;
+}
+
+void mysqlpp_histogram::record(uint64_t value) {
+    _counts[bucket_index(value)]++;
+
+    _count++;
+    _sum += value;
+
+    if (value < _min)
+        _min = value;
+    if (value > _max)
+        _max = value;
+}
+
+void mysqlpp_histogram::merge(const mysqlpp_histogram &other) {
+    for (int i = 0; i < hist_bucket_count; i++) {
+        _counts[i] += other._counts[i];
+    }
+
+    _count += other._count;
+    _sum += other._sum;
+
+    if (other._count && other._min < _min)
+        _min = other._min;
+    if (other._max > _max)
+        _max = other._max;
+}
+
+uint64_t mysqlpp_histogram::percentile(double p) const {
+    if (!_count) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * _count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > _count)
+        rank = _count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < hist_bucket_count; i++) {
+        seen += _counts[i];
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper(i);
+            return upper < _max ? upper : _max;
+        }
+    }
+
+    return _max;
+}
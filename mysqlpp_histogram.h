@@ -0,0 +1,61 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 11:00:00
+ * @modify date 2026-10-19 11:00:00
+ * @desc [HDR风格的对数-线性直方图, 固定内存, 相对误差约3%]
+ */
+
+#ifndef __mysql_histogram_h__
+#define __mysql_histogram_h__
+
+#include <stdint.h>
+
+// 每个2的幂区间再线性切分为32个子桶
+static const int hist_sub_bits = 5;
+static const int hist_sub_count = 1 << hist_sub_bits;
+static const int hist_max_bits = 40;  // 超过2^40的值(微秒约12天)记入最后一个桶
+static const int hist_bucket_count = (hist_max_bits - hist_sub_bits + 1) * hist_sub_count;
+
+class mysqlpp_histogram {
+public:
+    mysqlpp_histogram();
+
+    void record(uint64_t value);
+
+    void reset();
+
+    void merge(const mysqlpp_histogram &other);
+
+    // percentile in [0, 100], return the upper bound of the bucket
+    uint64_t percentile(double p) const;
+
+    uint64_t count() const {
+        return _count;
+    }
+
+    uint64_t min() const {
+        return _count ? _min : 0;
+    }
+
+    uint64_t max() const {
+        return _max;
+    }
+
+    double mean() const {
+        return _count ? (double)_sum / _count : 0;
+    }
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_upper(int index);
+
+private:
+    uint64_t _counts[hist_bucket_count];
+
+    uint64_t _count;
+    uint64_t _sum;
+    uint64_t _min;
+    uint64_t _max;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 16:00:00
+ * @modify date 2026-10-19 18:30:00
+ * @desc [description]
+ */
+#include "mysqlpp_load.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+mysqlpp_load_writer::mysqlpp_load_writer(load_format format, load_producer producer, void *argument)
+    : _format(format),
+      _producer(producer),
+      _argument(argument),
+      _wakeup(nullptr),
+      _wakeup_argument(nullptr),
+      _pos(0),
+      _fields(0),
+      _rows(0),
+      _eof(false),
+      _blocked(false),
+      _more(false),
+      _parked(false),
+      _aborted(false) {
+}
+
+mysqlpp_load_writer::~mysqlpp_load_writer() {
+}
+
+const char *mysqlpp_load_writer::format_clause() {
+    if (_format == LOAD_CSV) {
+        return "FIELDS TERMINATED BY ',' OPTIONALLY ENCLOSED BY '\"' ESCAPED BY '\\\\' LINES TERMINATED BY '\\n'";
+    }
+
+    return "FIELDS TERMINATED BY '\\t' ESCAPED BY '\\\\' LINES TERMINATED BY '\\n'";
+}
+
+void mysqlpp_load_writer::separate() {
+    if (_fields++) {
+        _buf.push_back(_format == LOAD_CSV ? ',' : '\t');
+    }
+}
+
+void mysqlpp_load_writer::add_string(const char *x) {
+    if (!x) {
+        add_null();
+        return;
+    }
+
+    add_string(x, strlen(x));
+}
+
+// 两种格式都用反斜杠转义, CSV另外用双引号包围
+void mysqlpp_load_writer::add_string(const char *x, size_t size) {
+    separate();
+
+    if (_format == LOAD_CSV)
+        _buf.push_back('"');
+
+    const char *start = x;
+    const char *end = x + size;
+
+    for (const char *p = x; p < end; p++) {
+        char esc = 0;
+
+        switch (*p) {
+        case '\\': esc = '\\'; break;
+        case '\n': esc = 'n'; break;
+        case '\r': esc = 'r'; break;
+        case '\0': esc = '0'; break;
+        case '\t': esc = _format == LOAD_TSV ? 't' : 0; break;
+        case '"':  esc = _format == LOAD_CSV ? '"' : 0; break;
+        default: break;
+        }
+
+        if (!esc)
+            continue;
+
+        _buf.append(start, p - start);
+        _buf.push_back('\\');
+        _buf.push_back(esc);
+        start = p + 1;
+    }
+
+    _buf.append(start, end - start);
+
+    if (_format == LOAD_CSV)
+        _buf.push_back('"');
+}
+
+void mysqlpp_load_writer::add_int(long long x) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%lld", x);
+
+    separate();
+    _buf.append(tmp, n);
+}
+
+void mysqlpp_load_writer::add_double(double x) {
+    if (!isfinite(x)) {
+        add_null();  // LOAD DATA would read inf and nan as 0 with a warning
+        return;
+    }
+
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%.17g", x);
+
+    separate();
+    _buf.append(tmp, n);
+}
+
+void mysqlpp_load_writer::add_null() {
+    separate();
+    _buf.append("\\N", 2);
+}
+
+void mysqlpp_load_writer::end_row() {
+    _buf.push_back('\n');
+
+    _fields = 0;
+    _rows++;
+}
+
+void mysqlpp_load_writer::abort(const char *reason) {
+    _aborted = true;
+    _error = reason ? reason : "load aborted by producer";
+}
+
+void mysqlpp_load_writer::set_wakeup(load_wakeup wakeup, void *argument) {
+    _wakeup = wakeup;
+    _wakeup_argument = argument;
+}
+
+// 语句还没结束时resume只是清掉标记, read()接着在同一条语句里取数据
+void mysqlpp_load_writer::resume() {
+    _blocked = false;
+
+    if (_parked) {
+        _parked = false;
+
+        if (_wakeup) {
+            _wakeup(_wakeup_argument);
+        }
+    }
+}
+
+bool mysqlpp_load_writer::suspend() {
+    _more = false;
+
+    if (_blocked) {
+        _parked = true;
+        return true;
+    }
+
+    return false;
+}
+
+// libmysql每次要一个网络包大小的数据, 只在缓冲不够时才调用producer, 所以内存占用与数据总量无关.
+// socket写满时libmysql会挂起协程回到event loop, 这就是背压.
+// 协程里没法等producer的数据, 所以LOAD_WOULD_BLOCK时把缓冲发完就结束本条语句
+int mysqlpp_load_writer::read(char *buf, unsigned int size) {
+    while (!_eof && !_blocked && !_aborted && _buf.size() - _pos < size) {
+        load_status s = _producer(this, _argument);
+
+        if (s == LOAD_DONE) {
+            _eof = true;
+
+            if (_fields) {
+                end_row();  // last row without end_row()
+            }
+        } else if (s == LOAD_WOULD_BLOCK) {
+            if (_fields) {
+                abort("producer would block inside a row");
+            } else {
+                _blocked = true;
+            }
+        }
+    }
+
+    if (_aborted) {
+        return -1;
+    }
+
+    size_t n = _buf.size() - _pos;
+    if (n > size)
+        n = size;
+
+    if (!n && !_eof) {
+        _more = true;  // end of this statement only
+    }
+
+    memcpy(buf, _buf.data() + _pos, n);
+    _pos += n;
+
+    if (_pos == _buf.size()) {
+        _buf.clear();
+        _pos = 0;
+    } else if (_pos >= size) {
+        _buf.erase(0, _pos);  // keep the unsent tail only
+        _pos = 0;
+    }
+
+    return (int)n;
+}
@@ -0,0 +1,104 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 16:00:00
+ * @modify date 2026-10-19 18:30:00
+ * @desc [LOAD DATA LOCAL INFILE的数据源: 按需调用用户的producer, 实时编码为TSV/CSV, 不落临时文件]
+ */
+
+#ifndef __mysql_load_h__
+#define __mysql_load_h__
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+class mysqlpp_load_writer;
+
+enum load_status {
+    LOAD_MORE,         // call again when the buffer runs low
+    LOAD_DONE,         // no more data, rows written in this call are still loaded
+    LOAD_WOULD_BLOCK   // no data for now, call w->resume() when data arrives
+};
+
+// 每次调用写入0到多行. 返回LOAD_WOULD_BLOCK时必须停在行边界, 已写入的行作为一条LOAD DATA提交,
+// 回到event loop, resume()之后用下一条LOAD DATA继续导入.
+// producer在libmysql非阻塞调用的协程栈上运行, 栈空间很小, 不要做重的事情
+typedef load_status (*load_producer)(mysqlpp_load_writer *w, void *argument);
+
+typedef void (*load_wakeup)(void *argument);
+
+enum load_format {
+    LOAD_TSV,  // LOAD DATA default: tab separated, backslash escaped
+    LOAD_CSV   // comma separated, strings enclosed by '"'
+};
+
+class mysqlpp_load_writer {
+public:
+    mysqlpp_load_writer(load_format format, load_producer producer, void *argument);
+    ~mysqlpp_load_writer();
+
+    void add_string(const char *x);
+    void add_string(const char *x, size_t size);
+    void add_int(long long x);
+    void add_double(double x);  // inf and nan are written as NULL
+    void add_null();
+
+    void end_row();
+
+    // stop loading, the whole statement fails with reason
+    void abort(const char *reason);
+
+    // data arrived after LOAD_WOULD_BLOCK, may be called from any event callback
+    void resume();
+
+    uint64_t get_rows() {
+        return _rows;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    // LOAD DATA clause of the format
+    const char *format_clause();
+
+    // for local infile handler: fill buf, return bytes, 0 for eof, -1 for error
+    int read(char *buf, unsigned int size);
+
+    // for the connection: called by resume() when it is waiting
+    void set_wakeup(load_wakeup wakeup, void *argument);
+
+    // the statement ended because the producer would block, the load goes on with another one
+    bool more() {
+        return _more;
+    }
+
+    // true to wait for resume(), false if resumed already
+    bool suspend();
+
+private:
+    void separate();
+
+    load_format _format;
+    load_producer _producer;
+    void *_argument;
+
+    load_wakeup _wakeup;
+    void *_wakeup_argument;
+
+    std::string _buf;  // encoded but not yet sent
+    size_t _pos;
+
+    int _fields;  // fields in current row
+    uint64_t _rows;
+
+    bool _eof;
+    bool _blocked;  // producer would block, end the statement once the buffer is sent
+    bool _more;
+    bool _parked;   // the connection waits for resume()
+    bool _aborted;
+    std::string _error;
+};
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 21:00:00
+ * @modify date 2026-10-19 21:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_metrics.h"
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct metric_desc_s {
+    const char *name;
+    const char *help;
+    bool counter;
+    size_t offset;
+} metric_desc_t;
+
+static const metric_desc_t metric_table[] = {
+    {"mysqlpp_pool_checkouts_total", "Connections handed out by get_connection", true, offsetof(pool_metrics_t, checkouts)},
+    {"mysqlpp_pool_creations_total", "Connections created", true, offsetof(pool_metrics_t, creations)},
+    {"mysqlpp_pool_destructions_total", "Connections destroyed", true, offsetof(pool_metrics_t, destructions)},
+    {"mysqlpp_pool_connect_failures_total", "Failed connection attempts", true, offsetof(pool_metrics_t, connect_failures)},
+    {"mysqlpp_pool_acquire_wait_microseconds_total", "Time spent waiting for a usable connection", true, offsetof(pool_metrics_t, acquire_wait_usec)},
+    {"mysqlpp_pool_in_use_microseconds_total", "Time connections spent checked out", true, offsetof(pool_metrics_t, in_use_usec)},
+    {"mysqlpp_pool_queries_total", "Requests started", true, offsetof(pool_metrics_t, queries)},
+    {"mysqlpp_pool_query_failures_total", "Requests finished with an error", true, offsetof(pool_metrics_t, query_failures)},
+    {"mysqlpp_pool_rows_total", "Rows delivered to callbacks", true, offsetof(pool_metrics_t, rows)},
+    {"mysqlpp_pool_sent_bytes_total", "SQL text bytes sent", true, offsetof(pool_metrics_t, bytes_sent)},
+    {"mysqlpp_pool_received_bytes_total", "Row payload bytes received", true, offsetof(pool_metrics_t, bytes_received)},
+    {"mysqlpp_pool_stalls_total", "Callbacks or blocking calls over the stall threshold", true, offsetof(pool_metrics_t, stalls)},
+    {"mysqlpp_pool_promoted_queries_total", "Text queries executed as auto prepared statements", true, offsetof(pool_metrics_t, promoted)},
+    {"mysqlpp_pool_acquire_shed_total", "Acquires rejected by admission control", true, offsetof(pool_metrics_t, acquire_shed)},
+    {"mysqlpp_pool_acquire_timeouts_total", "Acquires timed out in the queue", true, offsetof(pool_metrics_t, acquire_timeouts)},
+    {"mysqlpp_pool_queue_wait_microseconds_total", "Time spent in the acquire queue", true, offsetof(pool_metrics_t, queue_wait_usec)},
+    {"mysqlpp_pool_breaker_trips_total", "Times the circuit breaker opened", true, offsetof(pool_metrics_t, breaker_trips)},
+    {"mysqlpp_pool_breaker_rejects_total", "Connects failed fast by the open circuit breaker", true, offsetof(pool_metrics_t, breaker_rejects)},
+    {"mysqlpp_pool_retries_total", "Idempotent requests issued again after a transient error", true, offsetof(pool_metrics_t, retries)},
+    {"mysqlpp_pool_session_resets_total", "Dirty connections reset on return", true, offsetof(pool_metrics_t, session_resets)},
+    {"mysqlpp_pool_keepalive_pings_total", "Idle connections pinged in the background", true, offsetof(pool_metrics_t, keepalive_pings)},
+    {"mysqlpp_pool_keepalive_evictions_total", "Idle connections found dead by a keepalive ping", true, offsetof(pool_metrics_t, keepalive_evictions)},
+    {"mysqlpp_pool_connections", "Connections alive, idle and in use", false, offsetof(pool_metrics_t, connections)},
+    {"mysqlpp_pool_idle_connections", "Connections idle in the pool", false, offsetof(pool_metrics_t, idle)},
+    {"mysqlpp_pool_outstanding_requests", "Requests in flight", false, offsetof(pool_metrics_t, outstanding)},
+    {"mysqlpp_pool_acquire_queue", "Acquires waiting for a connection", false, offsetof(pool_metrics_t, acquire_queue)},
+    {"mysqlpp_pool_breaker_state", "Circuit breaker state, 0 closed, 1 open, 2 half open", false, offsetof(pool_metrics_t, breaker_state)},
+};
+
+static const int metric_count = sizeof(metric_table) / sizeof(metric_table[0]);
+
+static inline uint64_t &field(pool_metrics_t &m, int i) {
+    return *(uint64_t *)((char *)&m + metric_table[i].offset);
+}
+
+static inline uint64_t field(const pool_metrics_t &m, int i) {
+    return *(const uint64_t *)((const char *)&m + metric_table[i].offset);
+}
+
+mysqlpp_metrics::mysqlpp_metrics()
+    : checkouts(0),
+      creations(0),
+      destructions(0),
+      connect_failures(0),
+      acquire_wait_usec(0),
+      in_use_usec(0),
+      queries(0),
+      query_failures(0),
+      rows(0),
+      bytes_sent(0),
+      bytes_received(0),
+      stalls(0),
+      promoted(0),
+      acquire_shed(0),
+      acquire_timeouts(0),
+      queue_wait_usec(0),
+      breaker_trips(0),
+      breaker_rejects(0),
+      retries(0),
+      session_resets(0),
+      keepalive_pings(0),
+      keepalive_evictions(0),
+      connections(0),
+      idle(0),
+      outstanding(0),
+      acquire_queue(0),
+      breaker_state(0) {
+}
+
+pool_metrics_t mysqlpp_metrics::snapshot() const {
+    pool_metrics_t m;
+
+    m.checkouts = checkouts.load(std::memory_order_relaxed);
+    m.creations = creations.load(std::memory_order_relaxed);
+    m.destructions = destructions.load(std::memory_order_relaxed);
+    m.connect_failures = connect_failures.load(std::memory_order_relaxed);
+    m.acquire_wait_usec = acquire_wait_usec.load(std::memory_order_relaxed);
+    m.in_use_usec = in_use_usec.load(std::memory_order_relaxed);
+    m.queries = queries.load(std::memory_order_relaxed);
+    m.query_failures = query_failures.load(std::memory_order_relaxed);
+    m.rows = rows.load(std::memory_order_relaxed);
+    m.bytes_sent = bytes_sent.load(std::memory_order_relaxed);
+    m.bytes_received = bytes_received.load(std::memory_order_relaxed);
+    m.stalls = stalls.load(std::memory_order_relaxed);
+    m.promoted = promoted.load(std::memory_order_relaxed);
+    m.acquire_shed = acquire_shed.load(std::memory_order_relaxed);
+    m.acquire_timeouts = acquire_timeouts.load(std::memory_order_relaxed);
+    m.queue_wait_usec = queue_wait_usec.load(std::memory_order_relaxed);
+    m.breaker_trips = breaker_trips.load(std::memory_order_relaxed);
+    m.breaker_rejects = breaker_rejects.load(std::memory_order_relaxed);
+    m.retries = retries.load(std::memory_order_relaxed);
+    m.session_resets = session_resets.load(std::memory_order_relaxed);
+    m.keepalive_pings = keepalive_pings.load(std::memory_order_relaxed);
+    m.keepalive_evictions = keepalive_evictions.load(std::memory_order_relaxed);
+
+    m.connections = connections.load(std::memory_order_relaxed);
+    m.idle = idle.load(std::memory_order_relaxed);
+    m.outstanding = outstanding.load(std::memory_order_relaxed);
+    m.acquire_queue = acquire_queue.load(std::memory_order_relaxed);
+    m.breaker_state = breaker_state.load(std::memory_order_relaxed);
+
+    return m;
+}
+
+pool_metrics_t mysqlpp_metrics::diff(const pool_metrics_t &now, const pool_metrics_t &before) {
+    pool_metrics_t d = now;
+
+    for (int i = 0; i < metric_count; i++) {
+        if (metric_table[i].counter) {
+            field(d, i) = field(now, i) - field(before, i);
+        }
+    }
+
+    return d;
+}
+
+void mysqlpp_metrics::expose(const pool_metrics_t &m, const std::string &labels, std::string &out) {
+    char tmp[64];
+
+    for (int i = 0; i < metric_count; i++) {
+        const metric_desc_t &desc = metric_table[i];
+
+        out.append("# HELP ").append(desc.name).append(" ").append(desc.help).append("\n");
+        out.append("# TYPE ").append(desc.name).append(desc.counter ? " counter\n" : " gauge\n");
+
+        out.append(desc.name);
+        if (!labels.empty()) {
+            out.append("{").append(labels).append("}");
+        }
+
+        snprintf(tmp, sizeof(tmp), " %llu\n", (unsigned long long)field(m, i));
+        out.append(tmp);
+    }
+}
+
+std::string mysqlpp_metrics::expose(const std::string &labels) const {
+    std::string out;
+
+    expose(snapshot(), labels, out);
+
+    return out;
+}
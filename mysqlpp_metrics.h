@@ -0,0 +1,107 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 21:00:00
+ * @modify date 2026-10-19 21:00:00
+ * @desc [连接池指标: event loop线程单写, 其它线程随时读取快照或者导出文本, 不需要停止loop]
+ */
+
+#ifndef __mysql_metrics_h__
+#define __mysql_metrics_h__
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// 某一时刻的指标, 普通整数. 两个快照相减得到区间内的增量(gauge保留新值)
+typedef struct pool_metrics_s {
+    // counters
+    uint64_t checkouts;
+    uint64_t creations;
+    uint64_t destructions;
+    uint64_t connect_failures;
+    uint64_t acquire_wait_usec;  // connect of new connections
+    uint64_t in_use_usec;        // checkout -> back to pool
+    uint64_t queries;
+    uint64_t query_failures;
+    uint64_t rows;
+    uint64_t bytes_sent;         // sql text
+    uint64_t bytes_received;     // row payload
+    uint64_t stalls;             // callbacks or blocking calls over the stall threshold
+    uint64_t promoted;           // query() executed as an auto prepared statement
+    uint64_t acquire_shed;       // acquire() rejected by admission control
+    uint64_t acquire_timeouts;
+    uint64_t queue_wait_usec;    // time spent in the acquire queue
+    uint64_t breaker_trips;      // circuit breaker opened
+    uint64_t breaker_rejects;    // connects failed fast while the breaker is open
+    uint64_t retries;            // idempotent requests issued again after a transient error
+    uint64_t session_resets;     // dirty connections reset on return instead of reconnecting
+    uint64_t keepalive_pings;    // idle connections checked in the background
+    uint64_t keepalive_evictions;  // idle connections found dead and destroyed
+
+    // gauges
+    uint64_t connections;        // all connections, idle and in use
+    uint64_t idle;
+    uint64_t outstanding;        // requests in flight
+    uint64_t acquire_queue;      // acquire() waiting for a connection
+    uint64_t breaker_state;      // 0 closed, 1 open, 2 half open
+} pool_metrics_t;
+
+class mysqlpp_metrics {
+public:
+    mysqlpp_metrics();
+
+    // 只在event loop线程调用: 单写者, relaxed读加relaxed写, 不需要lock前缀的原子指令
+    static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static void set(std::atomic<uint64_t> &gauge, uint64_t v) {
+        gauge.store(v, std::memory_order_relaxed);
+    }
+
+    // any thread
+    pool_metrics_t snapshot() const;
+
+    static pool_metrics_t diff(const pool_metrics_t &now, const pool_metrics_t &before);
+
+    // prometheus text format, labels like pool="db1"
+    static void expose(const pool_metrics_t &m, const std::string &labels, std::string &out);
+
+    std::string expose(const std::string &labels) const;
+
+    std::atomic<uint64_t> checkouts;
+    std::atomic<uint64_t> creations;
+    std::atomic<uint64_t> destructions;
+    std::atomic<uint64_t> connect_failures;
+    std::atomic<uint64_t> acquire_wait_usec;
+    std::atomic<uint64_t> in_use_usec;
+    std::atomic<uint64_t> queries;
+    std::atomic<uint64_t> query_failures;
+    std::atomic<uint64_t> rows;
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> bytes_received;
+    std::atomic<uint64_t> stalls;
+    std::atomic<uint64_t> promoted;
+    std::atomic<uint64_t> acquire_shed;
+    std::atomic<uint64_t> acquire_timeouts;
+    std::atomic<uint64_t> queue_wait_usec;
+    std::atomic<uint64_t> breaker_trips;
+    std::atomic<uint64_t> breaker_rejects;
+    std::atomic<uint64_t> retries;
+    std::atomic<uint64_t> session_resets;
+    std::atomic<uint64_t> keepalive_pings;
+    std::atomic<uint64_t> keepalive_evictions;
+
+    std::atomic<uint64_t> connections;
+    std::atomic<uint64_t> idle;
+    std::atomic<uint64_t> outstanding;
+    std::atomic<uint64_t> acquire_queue;
+    std::atomic<uint64_t> breaker_state;
+
+private:
+    mysqlpp_metrics(const mysqlpp_metrics &);
+    mysqlpp_metrics &operator=(const mysqlpp_metrics &);
+};
+
+#endif
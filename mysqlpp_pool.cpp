@@ -7,6 +7,10 @@
  */
 #include "mysqlpp_pool.h"
 #include "mysqlpp_conn.h"
+#include <event.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
 
 static const char *groups[]= {"mysql++", NULL};
 
@@ -25,10 +29,60 @@ mysqlpp_pool::mysqlpp_pool(struct event_base *evloop,
       _passwd(passwd),
       _dbname(dbname),
       _max_idle(max_idle),
-      _max_conn(max_conn) {
+      _max_conn(max_conn),
+      _all(0),
+      _outstanding(0),
+      _cost(0),
+      _decay_usec(def_latency_decay_usec),
+      _cost_stamp(0),
+      _phase_timing(true),
+      _stall_threshold(0),
+      _stall_cb(nullptr),
+      _stall_argument(nullptr),
+      _stmt_stats(nullptr),
+      _recorder(nullptr),
+      _auto_prepare(0),
+      _auto_prepare_cache(def_auto_prepare_cache),
+      _retry_attempts(0),
+      _retry_backoff(def_retry_backoff),
+      _reset_on_return(false),
+      _reset_unsupported(false),
+      _keepalive(0),
+      _keepalive_timer(nullptr),
+      _multi_statements(false),
+      _acquire_timer(nullptr),
+      _admission(false),
+      _codel_target(def_codel_target),
+      _codel_interval(def_codel_interval),
+      _probe(nullptr) {
+    _classes.resize(1);
+    _classes[0].reserved = 0;
+    _classes[0].cap = 0;
+    _classes[0].held = 0;
 }
 
 mysqlpp_pool::~mysqlpp_pool() {
+    if (_acquire_timer) {
+        event_free(_acquire_timer);
+        _acquire_timer = nullptr;
+    }
+
+    if (_keepalive_timer) {
+        event_free(_keepalive_timer);
+        _keepalive_timer = nullptr;
+    }
+
+    for (size_t i = 0; i < _classes.size(); i++) {
+        std::deque<acquire_waiter_t> &waiters = _classes[i].waiters;
+
+        while (!waiters.empty()) {
+            acquire_waiter_t w = waiters.front();
+            waiters.pop_front();
+
+            w.cb(nullptr, ACQUIRE_CLOSED, w.argument);
+        }
+    }
+
     for (unsigned int i = 0; i < _conns.size(); i++) {
         delete _conns[i];
     }
@@ -41,18 +95,26 @@ void mysqlpp_pool::init_library(int argc, const char **argv) {
 }
 
 mysqlpp_conn *mysqlpp_pool::get_connection() {
-    for (unsigned int i = 0; i < _conns.size(); i++) {
-        if (!_conns[i]->is_available()) {
-            continue;
-        }
+    mysqlpp_conn *conn;
+
+    if (!_idle.empty()) {
+        conn = _idle.back();
+        _idle.pop_back();
 
-        _conns[i]->set_available(false);
-        return _conns[i];
+        conn->set_available(false);
+    } else {
+        _all++;
+        mysqlpp_metrics::add(_metrics.creations, 1);
+
+        conn = new mysqlpp_conn(_evloop, _host, _port, _user, _passwd, _dbname, this);
     }
 
-    _all++;
+    conn->_checkout = mysqlpp_conn::now_usec();
+
+    mysqlpp_metrics::add(_metrics.checkouts, 1);
+    update_gauges();
 
-    return new mysqlpp_conn(_evloop, _host, _port, _user, _passwd, _dbname, this);
+    return conn;
 }
 
 int mysqlpp_pool::get_all_active() {
@@ -60,39 +122,624 @@ int mysqlpp_pool::get_all_active() {
 }
 
 int mysqlpp_pool::get_pool_active() {
-    int active = 0;
+    return (int)(_conns.size() - _idle.size());
+}
 
-    for (unsigned int i = 0; i < _conns.size(); i++) {
-        if (_conns[i]->is_available()) {
-            continue;
+int mysqlpp_pool::get_available() {
+    return (int)_idle.size();
+}
+
+void mysqlpp_pool::add_connection(mysqlpp_conn *conn) {
+    release_class(conn);
+
+    if (conn == _probe) {
+        _probe = nullptr;  // closed before the connect finished
+        _breaker.abandon();
+    }
+
+    if (conn->_checkout) {
+        mysqlpp_metrics::add(_metrics.in_use_usec, mysqlpp_conn::now_usec() - conn->_checkout);
+        conn->_checkout = 0;
+    }
+
+    if (!conn->_pooled && conn->_connected && _conns.size() < (unsigned int)_max_conn) {
+        conn->_pooled = true;
+        _conns.push_back(conn);
+    }
+
+    if (!conn->_pooled || !conn->_connected) {
+        if (conn->_pooled) {
+            _conns.erase(std::find(_conns.begin(), _conns.end(), conn));  // broken connection, rare
         }
 
-        active++;
+        _all--;
+        mysqlpp_metrics::add(_metrics.destructions, 1);
+        update_gauges();
+
+        delete conn;
+
+        drain_waiters();  // room for a new connection
+        return;
     }
 
-    return active;
+    conn->set_available(true);
+    conn->_idle_since = mysqlpp_conn::now_usec();
+    _idle.push_back(conn);
+
+    update_gauges();
+
+    drain_waiters();
 }
 
-int mysqlpp_pool::get_available() {
-    int available = 0;
+void mysqlpp_pool::set_circuit_breaker(int failures, uint64_t backoff_usec, uint64_t max_backoff_usec) {
+    _breaker.set(failures, backoff_usec, max_backoff_usec);
+}
 
-    for (unsigned int i = 0; i < _conns.size(); i++) {
-        if (_conns[i]->is_available()) {
-            available++;
+bool mysqlpp_pool::connect_allowed(mysqlpp_conn *conn, uint64_t now) {
+    if (!_breaker.enabled()) {
+        return true;
+    }
+
+    breaker_state before = _breaker.state();
+
+    if (!_breaker.allow(now)) {
+        mysqlpp_metrics::add(_metrics.breaker_rejects, 1);
+        return false;
+    }
+
+    if (_breaker.state() == BREAKER_HALF_OPEN) {
+        _probe = conn;
+    }
+
+    if (_breaker.state() != before) {
+        mysqlpp_metrics::set(_metrics.breaker_state, _breaker.state());
+    }
+
+    return true;
+}
+
+void mysqlpp_pool::connect_finished(mysqlpp_conn *conn, bool ok) {
+    if (!_breaker.enabled()) {
+        return;
+    }
+
+    bool probe = conn == _probe;
+    if (probe) {
+        _probe = nullptr;
+    }
+
+    if (ok) {
+        _breaker.success();
+    } else if (_breaker.failure(mysqlpp_conn::now_usec(), probe)) {
+        mysqlpp_metrics::add(_metrics.breaker_trips, 1);
+    }
+
+    mysqlpp_metrics::set(_metrics.breaker_state, _breaker.state());
+}
+
+void mysqlpp_pool::set_keepalive(uint64_t interval_usec) {
+    _keepalive = interval_usec;
+
+    if (_keepalive_timer) {
+        event_del(_keepalive_timer);
+    }
+
+    if (!interval_usec) {
+        return;
+    }
+
+    if (!_keepalive_timer) {
+        _keepalive_timer = event_new(_evloop, -1, EV_PERSIST, &mysqlpp_pool::keepalive_timer_callback, this);
+    }
+
+    uint64_t tick = interval_usec / def_keepalive_slices;
+
+    struct timeval tv;
+    tv.tv_sec = tick / 1000000;
+    tv.tv_usec = tick % 1000000;
+
+    event_add(_keepalive_timer, &tv);
+}
+
+void mysqlpp_pool::keepalive_timer_callback(int fd, short which, void *v) {
+    ((mysqlpp_pool *)v)->keepalive_tick();
+}
+
+// _idle的前面是最久没用的. 先全部取出再ping, ping可能同步结束并放回_idle
+void mysqlpp_pool::keepalive_tick() {
+    uint64_t now = mysqlpp_conn::now_usec();
+    size_t budget = (_idle.size() + def_keepalive_slices - 1) / def_keepalive_slices;
+
+    std::vector<mysqlpp_conn *> due;
+
+    for (size_t i = 0; i < _idle.size() && due.size() < budget; i++) {
+        if (now - _idle[i]->_idle_since >= _keepalive) {
+            due.push_back(_idle[i]);
         }
     }
 
-    return available;
+    if (due.empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < due.size(); i++) {
+        _idle.erase(std::find(_idle.begin(), _idle.end(), due[i]));
+        due[i]->set_available(false);
+    }
+
+    update_gauges();
+
+    for (size_t i = 0; i < due.size(); i++) {
+        due[i]->keepalive();
+    }
 }
 
-void mysqlpp_pool::add_connection(mysqlpp_conn *conn) {
-    if (_conns.size() > (unsigned int)_max_conn || !conn->_connected) {
-        _all--;
-        delete conn;
+acquire_class_t &mysqlpp_pool::acquire_class(int priority) {
+    if (priority < 0) {
+        priority = 0;
+    }
 
+    while ((int)_classes.size() <= priority) {
+        _classes.push_back(acquire_class_t());
+
+        acquire_class_t &c = _classes.back();
+        c.reserved = 0;
+        c.cap = 0;
+        c.held = 0;
+        c.codel.set(_codel_target, _codel_interval);
+    }
+
+    return _classes[priority];
+}
+
+void mysqlpp_pool::set_priority_class(int priority, int reserved, int cap) {
+    acquire_class_t &c = acquire_class(priority);
+
+    c.reserved = reserved;
+    c.cap = cap;
+
+    drain_waiters();  // a larger cap may let waiters in
+}
+
+int mysqlpp_pool::get_acquire_queue() {
+    size_t n = 0;
+
+    for (size_t i = 0; i < _classes.size(); i++) {
+        n += _classes[i].waiters.size();
+    }
+
+    return (int)n;
+}
+
+int mysqlpp_pool::get_acquire_queue(int priority) {
+    return priority >= 0 && priority < (int)_classes.size() ? (int)_classes[priority].waiters.size() : 0;
+}
+
+int mysqlpp_pool::get_class_held(int priority) {
+    return priority >= 0 && priority < (int)_classes.size() ? _classes[priority].held : 0;
+}
+
+const mysqlpp_histogram &mysqlpp_pool::get_queue_histogram(int priority) {
+    if (priority >= 0 && priority < (int)_classes.size()) {
+        return _classes[priority].queue_hist;
+    }
+
+    return _queue_hist;
+}
+
+// 本类未到上限, 并且拿走一个连接之后剩下的仍然够其它类别未用完的预留
+bool mysqlpp_pool::can_grant(int priority) {
+    acquire_class_t &c = _classes[priority];
+
+    if (!can_checkout() || (c.cap && c.held >= c.cap)) {
+        return false;
+    }
+
+    if (c.held < c.reserved) {
+        return true;
+    }
+
+    int idle = (int)_idle.size();
+    int free = std::max(idle, _max_conn - (_all - idle));
+    int unmet = 0;
+
+    for (size_t i = 0; i < _classes.size(); i++) {
+        if ((int)i != priority && _classes[i].held < _classes[i].reserved) {
+            unmet += _classes[i].reserved - _classes[i].held;
+        }
+    }
+
+    return free > unmet;
+}
+
+void mysqlpp_pool::grant(int priority, const acquire_waiter_t &w) {
+    mysqlpp_conn *conn = get_connection();
+
+    _classes[priority].held++;
+    _holders[conn] = priority;
+
+    w.cb(conn, ACQUIRE_OK, w.argument);  // may acquire again or give back synchronously
+}
+
+void mysqlpp_pool::release_class(mysqlpp_conn *conn) {
+    if (_holders.empty()) {
         return;
     }
 
-    conn->set_available(true);
-    _conns.push_back(conn);
+    std::unordered_map<mysqlpp_conn *, int>::iterator it = _holders.find(conn);
+    if (it == _holders.end()) {
+        return;  // from get_connection()
+    }
+
+    _classes[it->second].held--;
+    _holders.erase(it);
+}
+
+void mysqlpp_pool::acquire(acquire_callback cb, void *argument, uint64_t timeout_usec, int priority) {
+    uint64_t now = mysqlpp_conn::now_usec();
+
+    acquire_class_t &c = acquire_class(priority);
+    priority = (int)(&c - &_classes[0]);
+
+    acquire_waiter_t w;
+    w.cb = cb;
+    w.argument = argument;
+    w.enqueued = now;
+    w.deadline = timeout_usec ? now + timeout_usec : 0;
+
+    if (c.waiters.empty() && can_grant(priority)) {
+        _queue_hist.record(0);
+        c.queue_hist.record(0);
+
+        if (_admission) {
+            c.codel.sample(now, 0);
+        }
+
+        grant(priority, w);
+        return;
+    }
+
+    if (_admission) {
+        if (c.waiters.empty()) {
+            // nothing queued means no standing queue, whatever the last interval said.
+            // otherwise a busy pool would shed everything: no waiters, no samples to clear the verdict
+            c.codel.drained();
+        } else {
+            // the head has waited at least this long, a lower bound of its sojourn
+            c.codel.sample(now, now - c.waiters.front().enqueued);
+
+            if (c.codel.overloaded()) {
+                reject(w, ACQUIRE_OVERLOADED);  // fail fast, queueing would only time out later
+                return;
+            }
+        }
+    }
+
+    c.waiters.push_back(w);
+    mysqlpp_metrics::set(_metrics.acquire_queue, get_acquire_queue());
+
+    arm_acquire_timer();
+}
+
+void mysqlpp_pool::set_admission(uint64_t target_usec, uint64_t interval_usec) {
+    _admission = target_usec > 0;
+    _codel_target = target_usec;
+    _codel_interval = interval_usec;
+
+    for (size_t i = 0; i < _classes.size(); i++) {
+        _classes[i].codel.set(target_usec, interval_usec);
+    }
+}
+
+const char *mysqlpp_pool::acquire_error(acquire_status status) {
+    switch (status) {
+    case ACQUIRE_OK: return "ok";
+    case ACQUIRE_OVERLOADED: return "connection pool overloaded, request shed by admission control";
+    case ACQUIRE_TIMEOUT: return "timed out waiting for a connection";
+    case ACQUIRE_CLOSED: return "connection pool closed";
+    }
+
+    return "unknown";
+}
+
+void mysqlpp_pool::reject(const acquire_waiter_t &w, acquire_status status) {
+    if (status == ACQUIRE_OVERLOADED) {
+        mysqlpp_metrics::add(_metrics.acquire_shed, 1);
+    } else if (status == ACQUIRE_TIMEOUT) {
+        mysqlpp_metrics::add(_metrics.acquire_timeouts, 1);
+    }
+
+    w.cb(nullptr, status, w.argument);
+}
+
+// 连接归还或者销毁之后, 按优先级从高到低, 类别内FIFO把连接交给排队的请求.
+// 被上限挡住的类别让给低优先级类别; 过期的和过载时排队过久的直接拒绝
+void mysqlpp_pool::drain_waiters() {
+    bool progress = true;
+
+    while (progress && can_checkout()) {
+        progress = false;
+
+        for (size_t i = 0; i < _classes.size() && can_checkout(); i++) {
+            int priority = (int)i;
+
+            while (!_classes[i].waiters.empty() && can_grant(priority)) {
+                acquire_class_t &c = _classes[i];
+                acquire_waiter_t w = c.waiters.front();
+                c.waiters.pop_front();
+
+                uint64_t now = mysqlpp_conn::now_usec();
+                uint64_t sojourn = now - w.enqueued;
+
+                _queue_hist.record(sojourn);
+                c.queue_hist.record(sojourn);
+                mysqlpp_metrics::add(_metrics.queue_wait_usec, sojourn);
+
+                progress = true;
+
+                if (w.deadline && now >= w.deadline) {
+                    reject(w, ACQUIRE_TIMEOUT);
+                    continue;
+                }
+
+                if (_admission && c.codel.observe(now, sojourn)) {
+                    reject(w, ACQUIRE_OVERLOADED);
+                    continue;
+                }
+
+                grant(priority, w);
+            }
+        }
+    }
+
+    mysqlpp_metrics::set(_metrics.acquire_queue, get_acquire_queue());
+
+    arm_acquire_timer();
+}
+
+// 没有连接归还时也要让超时和过载的请求及时失败
+void mysqlpp_pool::sweep_waiters() {
+    uint64_t now = mysqlpp_conn::now_usec();
+    std::deque<acquire_waiter_t> expired;
+
+    for (size_t i = 0; i < _classes.size(); i++) {
+        acquire_class_t &c = _classes[i];
+
+        if (_admission && !c.waiters.empty()) {
+            c.codel.sample(now, now - c.waiters.front().enqueued);
+        }
+
+        std::deque<acquire_waiter_t>::iterator it = c.waiters.begin();
+
+        while (it != c.waiters.end()) {
+            uint64_t sojourn = now - it->enqueued;
+
+            if ((it->deadline && now >= it->deadline) || (_admission && c.codel.overloaded() && sojourn > c.codel.slough())) {
+                c.queue_hist.record(sojourn);
+                expired.push_back(*it);
+                it = c.waiters.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    mysqlpp_metrics::set(_metrics.acquire_queue, get_acquire_queue());
+
+    // callbacks last, they may touch the queues
+    for (size_t i = 0; i < expired.size(); i++) {
+        const acquire_waiter_t &w = expired[i];
+
+        _queue_hist.record(now - w.enqueued);
+        mysqlpp_metrics::add(_metrics.queue_wait_usec, now - w.enqueued);
+
+        reject(w, w.deadline && now >= w.deadline ? ACQUIRE_TIMEOUT : ACQUIRE_OVERLOADED);
+    }
+
+    arm_acquire_timer();
+}
+
+void mysqlpp_pool::acquire_timer_callback(int fd, short which, void *v) {
+    ((mysqlpp_pool *)v)->sweep_waiters();
+}
+
+void mysqlpp_pool::arm_acquire_timer() {
+    uint64_t now = mysqlpp_conn::now_usec();
+    uint64_t next = 0;
+    bool waiting = false;
+
+    for (size_t i = 0; i < _classes.size(); i++) {
+        const std::deque<acquire_waiter_t> &waiters = _classes[i].waiters;
+
+        for (size_t j = 0; j < waiters.size(); j++) {
+            waiting = true;
+
+            if (waiters[j].deadline && (!next || waiters[j].deadline < next))
+                next = waiters[j].deadline;
+        }
+    }
+
+    if (!waiting) {
+        if (_acquire_timer) {
+            event_del(_acquire_timer);
+        }
+        return;
+    }
+
+    // keep sampling the heads while the queues stand
+    if (_admission && (!next || now + _codel_target < next)) {
+        next = now + _codel_target;
+    }
+
+    if (!next) {
+        return;
+    }
+
+    if (!_acquire_timer) {
+        _acquire_timer = event_new(_evloop, -1, 0, &mysqlpp_pool::acquire_timer_callback, this);
+    }
+
+    uint64_t wait = next > now ? next - now : 0;
+
+    struct timeval tv;
+    tv.tv_sec = wait / 1000000;
+    tv.tv_usec = wait % 1000000;
+
+    event_add(_acquire_timer, &tv);
+}
+
+void mysqlpp_pool::update_gauges() {
+    mysqlpp_metrics::set(_metrics.connections, _all);
+    mysqlpp_metrics::set(_metrics.idle, _idle.size());
+}
+
+void mysqlpp_pool::request_started() {
+    _outstanding++;
+
+    mysqlpp_metrics::add(_metrics.queries, 1);
+    mysqlpp_metrics::set(_metrics.outstanding, _outstanding);
+}
+
+void mysqlpp_pool::request_finished(uint64_t usec) {
+    _outstanding--;
+
+    mysqlpp_metrics::set(_metrics.outstanding, _outstanding);
+
+    observe_latency((double)usec);
+}
+
+void mysqlpp_pool::observe_latency(double usec) {
+    uint64_t now = mysqlpp_conn::now_usec();
+    double elapsed = now > _cost_stamp ? (double)(now - _cost_stamp) : 0;
+    double w = exp(-elapsed / _decay_usec);
+
+    _cost_stamp = now;
+
+    if (usec > _cost) {
+        _cost = usec;  // peak sensitive, react to slow host immediately
+    } else {
+        _cost = _cost * w + usec * (1.0 - w);
+    }
+}
+
+double mysqlpp_pool::get_latency_cost() {
+    observe_latency(0);
+
+    return _cost;
+}
+
+double mysqlpp_pool::get_load_score() {
+    if (_breaker.state() == BREAKER_OPEN) {
+        return HUGE_VAL;  // new connections would fail fast
+    }
+
+    return (get_latency_cost() + 1.0) * (_outstanding + 1);
+}
+
+void mysqlpp_pool::record_trace(const query_trace_t &t) {
+    if (t.connected) {
+        _phases[PHASE_CONNECT].record(t.connected - t.start);
+    }
+
+    if (t.prepared) {
+        _phases[PHASE_PREPARE].record(t.prepared - (t.connected ? t.connected : t.start));
+    }
+
+    if (t.issued && t.sent) {
+        _phases[PHASE_SEND].record(t.sent - t.issued);
+    }
+
+    if (t.sent && t.result) {
+        _phases[PHASE_SERVER].record(t.result - t.sent);
+    }
+
+    if (t.result && t.first_row) {
+        _phases[PHASE_FIRST_ROW].record(t.first_row - t.result);
+    }
+
+    if (t.first_row && t.done) {
+        _phases[PHASE_STREAM].record(t.done - t.first_row);
+    }
+
+    if (t.done) {
+        _phases[PHASE_TOTAL].record(t.done - t.start);
+    }
+}
+
+void mysqlpp_pool::reset_phase_histograms() {
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        _phases[i].reset();
+    }
+}
+
+const char *mysqlpp_pool::phase_name(query_phase phase) {
+    static const char *names[PHASE_COUNT] = {
+        "connect", "prepare", "send", "server", "first_row", "stream", "total"
+    };
+
+    return phase >= 0 && phase < PHASE_COUNT ? names[phase] : "unknown";
+}
+
+void mysqlpp_pool::set_stall_detector(uint64_t threshold_usec, stall_callback cb, void *argument) {
+    _stall_threshold = threshold_usec;
+    _stall_cb = cb;
+    _stall_argument = argument;
+}
+
+void mysqlpp_pool::observe_stall(mysqlpp_conn *conn, const char *what, const std::string &sql, uint64_t usec, bool callback) {
+    if (callback) {
+        _callback_hist.record(usec);
+    } else {
+        _blocking_hist.record(usec);
+    }
+
+    if (!_stall_threshold || usec < _stall_threshold) {
+        return;
+    }
+
+    mysqlpp_metrics::add(_metrics.stalls, 1);
+
+    if (_stall_cb) {
+        _stall_cb(conn, what, sql, usec, _stall_argument);
+        return;
+    }
+
+    fprintf(stderr, "mysqlpp stall: %s blocked the event loop for %llu us, host %s:%d, sql: %.512s\n",
+        what, (unsigned long long)usec, _host.c_str(), _port, sql.c_str());
+}
+
+bool mysqlpp_pool::promotion_hot(size_t shape) {
+    std::unordered_map<size_t, int>::iterator it = _shapes.find(shape);
+
+    if (it == _shapes.end()) {
+        if (_shapes.size() >= def_auto_prepare_shapes) {
+            // forget the cold shapes, literals interpolated into identifiers make endless shapes
+            for (it = _shapes.begin(); it != _shapes.end(); ) {
+                if (it->second >= 0 && it->second < _auto_prepare)
+                    it = _shapes.erase(it);
+                else
+                    ++it;
+            }
+
+            if (_shapes.size() >= def_auto_prepare_shapes) {
+                _shapes.clear();
+            }
+        }
+
+        it = _shapes.insert(std::make_pair(shape, 0)).first;
+    }
+
+    if (it->second < 0) {
+        return false;
+    }
+
+    if (it->second < _auto_prepare) {
+        it->second++;
+    }
+
+    return it->second >= _auto_prepare;
+}
+
+void mysqlpp_pool::promotion_reject(size_t shape) {
+    _shapes[shape] = -1;
 }
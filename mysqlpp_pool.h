@@ -13,15 +13,90 @@
 // #include "mysql++/mysql_conn.h"
 // #include "mysqlpp/mysqlpp_result.h"
 
+#include <deque>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include "mysqlpp_breaker.h"
+#include "mysqlpp_codel.h"
+#include "mysqlpp_histogram.h"
+#include "mysqlpp_metrics.h"
 
 static const int def_max_idle = 120;
 static const int def_max_conn = 20;
 
+static const int def_auto_prepare_cache = 32;     // prepared statements cached per connection
+static const size_t def_auto_prepare_shapes = 4096;  // shapes counted per pool
+
+static const uint64_t def_retry_backoff = 10 * 1000;  // first retry after 10ms, doubled every attempt
+
+static const int def_keepalive_slices = 8;  // a keepalive interval is covered by this many ticks
+
+static const double def_latency_decay_usec = 10 * 1000 * 1000.0;  // peak ewma decay window
+
+struct event;
 struct event_base;
 
 class mysqlpp_conn; 
+class mysqlpp_stmt_stats;
+class mysqlpp_recorder;
+
+// 请求的各个阶段, 由query_trace_t的相邻时间点相减得到
+enum query_phase {
+    PHASE_CONNECT,    // start -> connected, only for new connection
+    PHASE_PREPARE,    // -> prepared
+    PHASE_SEND,       // issued -> request written, waiting for response
+    PHASE_SERVER,     // written -> response header, server execution and network
+    PHASE_FIRST_ROW,  // response header -> first row
+    PHASE_STREAM,     // first row -> last row
+    PHASE_TOTAL,      // start -> done
+    PHASE_COUNT
+};
+
+// 一次请求各阶段的时间点(mysqlpp_conn::now_usec), 0表示没有经过这个阶段
+typedef struct query_trace_s {
+    uint64_t start;      // query()/prepare()/execute() called
+    uint64_t connected;
+    uint64_t prepared;
+    uint64_t issued;     // statement handed to libmysql
+    uint64_t sent;
+    uint64_t result;
+    uint64_t first_row;
+    uint64_t done;       // last callback, or abandoned by close()/cancel()
+    uint64_t rows;
+} query_trace_t;
+
+// 用户回调或者阻塞的libmysql调用超过阈值, what为"row callback", "mysql_stmt_close"等, sql为当时正在执行的语句
+typedef void (*stall_callback)(mysqlpp_conn *conn, const char *what, const std::string &sql, uint64_t usec, void *argument);
+
+enum acquire_status {
+    ACQUIRE_OK,
+    ACQUIRE_OVERLOADED,  // shed by admission control, the database is not keeping up
+    ACQUIRE_TIMEOUT,     // waited longer than the timeout given to acquire()
+    ACQUIRE_CLOSED       // pool destroyed while waiting
+};
+
+// conn is nullptr unless status is ACQUIRE_OK
+typedef void (*acquire_callback)(mysqlpp_conn *conn, acquire_status status, void *argument);
+
+typedef struct acquire_waiter_s {
+    acquire_callback cb;
+    void *argument;
+    uint64_t enqueued;
+    uint64_t deadline;  // 0 for none
+} acquire_waiter_t;
+
+// 优先级类别: reserved个连接只留给本类, 其它类不能占用; cap为本类最多持有的连接数, 0不限制
+typedef struct acquire_class_s {
+    int reserved;
+    int cap;
+    int held;  // connections granted by acquire() and not given back yet
+
+    std::deque<acquire_waiter_t> waiters;
+    mysqlpp_codel codel;
+    mysqlpp_histogram queue_hist;
+} acquire_class_t;
 
 // every thread shoule hava a mysqlpp instance and a evloop
 class mysqlpp_pool {
@@ -45,12 +120,181 @@ public:
 
     mysqlpp_conn *get_connection();
 
+    // 异步获取连接: 有空闲连接或者连接数小于max_conn时立即回调(在acquire返回之前), 否则排队等待归还.
+    // 开启准入控制后, 排队延迟持续超过target时新请求立即以ACQUIRE_OVERLOADED拒绝, 不再排队到超时.
+    // priority为类别编号, 0最高; 归还的连接先交给高优先级类别
+    void acquire(acquire_callback cb, void *argument, uint64_t timeout_usec = 0, int priority = 0);
+
+    // CoDel admission control on the acquire queue of every class, target 0 for off (default)
+    void set_admission(uint64_t target_usec, uint64_t interval_usec = def_codel_interval);
+
+    // 例如交互请求为0类reserved 4, 批处理为1类cap max_conn/2. 未设置的类别没有预留也不限制
+    void set_priority_class(int priority, int reserved, int cap);
+
+    int get_acquire_queue();
+    int get_acquire_queue(int priority);
+
+    int get_class_held(int priority);
+
+    // time spent in the acquire queue, immediate grants included. priority -1 for all classes
+    const mysqlpp_histogram &get_queue_histogram(int priority = -1);
+
+    static const char *acquire_error(acquire_status status);
+
     int get_all_active();
     int get_pool_active();
     int get_available();
 
+    // counters and gauges, safe to read from any thread
+    mysqlpp_metrics &get_metrics() {
+        return _metrics;
+    }
+
     void add_connection(mysqlpp_conn *conn);
 
+    void set_latency_decay(double usec) {
+        _decay_usec = usec;
+    }
+
+    int get_outstanding() {
+        return _outstanding;
+    }
+
+    // peak ewma of request latency in microsecond, decays towards 0 while no request finished,
+    // so a slow host will be probed again later
+    double get_latency_cost();
+
+    // lower is better, used by mysqlpp_balancer
+    double get_load_score();
+
+    // per phase timing, default on. off: no clock reading in the state machines, get_trace() returns nullptr
+    void set_phase_timing(bool on) {
+        _phase_timing = on;
+    }
+
+    const mysqlpp_histogram &get_phase_histogram(query_phase phase) {
+        return _phases[phase];
+    }
+
+    void reset_phase_histograms();
+
+    static const char *phase_name(query_phase phase);
+
+    // 0 for off (default). cb nullptr: report to stderr
+    void set_stall_detector(uint64_t threshold_usec, stall_callback cb = nullptr, void *argument = nullptr);
+
+    // durations of user callbacks and blocking calls, recorded while the detector is on
+    const mysqlpp_histogram &get_callback_histogram() {
+        return _callback_hist;
+    }
+
+    const mysqlpp_histogram &get_blocking_histogram() {
+        return _blocking_hist;
+    }
+
+    // 按语句指纹聚合统计, nullptr关闭(默认). 同一个线程的多个pool可以共用一个stats
+    void set_statement_stats(mysqlpp_stmt_stats *stats) {
+        _stmt_stats = stats;
+    }
+
+    mysqlpp_stmt_stats *get_statement_stats() {
+        return _stmt_stats;
+    }
+
+    // 录制query/prepare/execute到二进制日志, 由mysqlpp_replay回放. nullptr关闭(默认)
+    void set_recorder(mysqlpp_recorder *recorder) {
+        _recorder = recorder;
+    }
+
+    mysqlpp_recorder *get_recorder() {
+        return _recorder;
+    }
+
+    // query()的sql去掉单引号字符串和整数字面量之后得到语句形状, 同一形状执行threshold次之后
+    // 改为预处理语句加参数绑定执行, 每个连接最多缓存cache_size个. 行仍然通过get_column_content()返回,
+    // 值由客户端转换为文本. 0关闭(默认)
+    void set_auto_prepare(int threshold, int cache_size = def_auto_prepare_cache) {
+        _auto_prepare = threshold;
+        _auto_prepare_cache = cache_size;
+    }
+
+    // 连续failures次建连失败后熔断: 退避窗口内新连接的query/prepare直接失败(回调在调用返回之前),
+    // 窗口从backoff开始每次翻倍直到max_backoff, 带随机抖动; 窗口结束后只放一个连接去探测. 0关闭(默认)
+    void set_circuit_breaker(int failures, uint64_t backoff_usec = def_breaker_backoff,
+        uint64_t max_backoff_usec = def_breaker_max_backoff);
+
+    breaker_state get_breaker_state() {
+        return _breaker.state();
+    }
+
+    // 标记为幂等(mysqlpp_conn::set_idempotent)的query()/execute()遇到死锁, 锁等待超时, 连接断开时,
+    // 在loop上等待backoff(每次翻倍)后重新执行, 最多attempts次, 必要时重连并重新prepare和绑定参数.
+    // 已经回调过行的请求不会重试. 0关闭(默认)
+    void set_retry_policy(int attempts, uint64_t backoff_usec = def_retry_backoff) {
+        _retry_attempts = attempts;
+        _retry_backoff = backoff_usec;
+    }
+
+    // 归还的连接如果改变过会话状态(变量, 临时表, 锁, 未提交的事务), 先异步COM_RESET_CONNECTION再放回池里,
+    // server不支持时改用COM_CHANGE_USER. 干净的连接直接放回. 失败则销毁. 默认关闭
+    void set_reset_on_return(bool on) {
+        _reset_on_return = on;
+    }
+
+    // 空闲超过interval的连接在后台mysql_ping, 失败的在被取用之前销毁. 检查分散在interval内的
+    // def_keepalive_slices次定时器上, 每次最多检查1/slices的空闲连接, 最久没用的优先. 0关闭(默认)
+    void set_keepalive(uint64_t interval_usec);
+
+    // mysqlpp_transaction把BEGIN, SAVEPOINT, COMMIT和语句放在一个packet里发送. 只在事务的批次之前
+    // 用mysql_set_server_option打开多语句, 其它query()之前再关掉, 所以普通的query()不受影响;
+    // 连接在两种用法之间切换时多一个往返. 默认关闭, 关闭时事务的语句逐条发送
+    void set_pipelined_transactions(bool on) {
+        _multi_statements = on;
+    }
+
+    bool get_pipelined_transactions() {
+        return _multi_statements;
+    }
+
+private:
+    friend class mysqlpp_conn;
+
+    void request_started();
+    void request_finished(uint64_t usec);
+
+    void observe_latency(double usec);
+
+    void record_trace(const query_trace_t &trace);
+
+    void update_gauges();
+
+    void observe_stall(mysqlpp_conn *conn, const char *what, const std::string &sql, uint64_t usec, bool callback);
+
+    bool can_checkout() {
+        return !_idle.empty() || _all < _max_conn;
+    }
+
+    acquire_class_t &acquire_class(int priority);
+    bool can_grant(int priority);
+    void grant(int priority, const acquire_waiter_t &w);
+    void release_class(mysqlpp_conn *conn);
+
+    void drain_waiters();
+    void sweep_waiters();
+    void reject(const acquire_waiter_t &w, acquire_status status);
+    void arm_acquire_timer();
+
+    static void acquire_timer_callback(int fd, short which, void *v);
+
+    void keepalive_tick();
+    static void keepalive_timer_callback(int fd, short which, void *v);
+
+    bool connect_allowed(mysqlpp_conn *conn, uint64_t now);
+    void connect_finished(mysqlpp_conn *conn, bool ok);
+
+    bool promotion_hot(size_t shape);
+    void promotion_reject(size_t shape);
+
 private:
     struct event_base *_evloop; // for async mysql operation
 
@@ -65,7 +309,55 @@ private:
 
     int _all;
 
-    std::vector<mysqlpp_conn *> _conns;
+    int _outstanding;  // requests in flight
+
+    double _cost;
+    double _decay_usec;
+    uint64_t _cost_stamp;
+
+    bool _phase_timing;
+    mysqlpp_histogram _phases[PHASE_COUNT];
+
+    uint64_t _stall_threshold;
+    stall_callback _stall_cb;
+    void *_stall_argument;
+    mysqlpp_histogram _callback_hist;
+    mysqlpp_histogram _blocking_hist;
+
+    mysqlpp_stmt_stats *_stmt_stats;
+
+    mysqlpp_recorder *_recorder;
+
+    int _auto_prepare;
+    int _auto_prepare_cache;
+    std::unordered_map<size_t, int> _shapes;  // shape hash -> times seen, -1 for can not be prepared
+
+    int _retry_attempts;
+    uint64_t _retry_backoff;
+
+    bool _reset_on_return;
+    bool _reset_unsupported;  // server answered COM_RESET_CONNECTION with unknown command
+
+    uint64_t _keepalive;
+    struct event *_keepalive_timer;
+
+    bool _multi_statements;
+
+    std::vector<mysqlpp_conn *> _conns;  // connections owned by the pool, each once
+    std::vector<mysqlpp_conn *> _idle;   // available ones, the most recently used at the back
+
+    std::vector<acquire_class_t> _classes;  // by priority, at least one
+    std::unordered_map<mysqlpp_conn *, int> _holders;  // connection -> class it was granted to
+    struct event *_acquire_timer;
+    bool _admission;
+    uint64_t _codel_target;
+    uint64_t _codel_interval;
+    mysqlpp_histogram _queue_hist;
+
+    mysqlpp_breaker _breaker;
+    mysqlpp_conn *_probe;  // half open probe connecting, nullptr for none
+
+    mysqlpp_metrics _metrics;
 };
 
 
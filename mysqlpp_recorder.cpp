@@ -0,0 +1,444 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 11:00:00
+ * @modify date 2026-10-20 18:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_recorder.h"
+#include "mysqlpp_conn.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char record_magic[] = "MYPPREC";
+static const uint8_t record_version = 1;
+static const size_t record_header_size = 7 + 1 + 8;
+
+static inline uint64_t zigzag(long long v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline long long unzigzag(uint64_t v) {
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+mysqlpp_recorder::mysqlpp_recorder(const std::string &path, size_t buffer_size)
+    : _buffer_size(buffer_size),
+      _start(mysqlpp_conn::now_usec()),
+      _last(0),
+      _limit(0),
+      _bytes(0),
+      _conns(0) {
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        _error = "recorder open " + path + ": " + strerror(errno);
+        return;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    uint64_t wall = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+    _buf.reserve(_buffer_size + 1024);
+    _buf.append(record_magic, 7);
+    _buf.push_back((char)record_version);
+    for (int i = 0; i < 8; i++) {
+        _buf.push_back((char)(wall >> (8 * i)));
+    }
+}
+
+mysqlpp_recorder::~mysqlpp_recorder() {
+    flush();
+
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+void mysqlpp_recorder::put_varint(uint64_t v) {
+    while (v >= 0x80) {
+        _buf.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+
+    _buf.push_back((char)v);
+}
+
+void mysqlpp_recorder::put_bytes(const char *s, size_t n) {
+    put_varint(n);
+    _buf.append(s, n);
+}
+
+bool mysqlpp_recorder::begin_record(record_type type, uint32_t conn) {
+    if (_fd < 0 || (_limit && _bytes + _buf.size() >= _limit)) {
+        return false;
+    }
+
+    uint64_t offset = mysqlpp_conn::now_usec() - _start;
+
+    _buf.push_back((char)type);
+    put_varint(offset - _last);
+    put_varint(conn);
+
+    _last = offset;
+
+    return true;
+}
+
+void mysqlpp_recorder::end_record() {
+    if (_buf.size() >= _buffer_size) {
+        flush();
+    }
+}
+
+void mysqlpp_recorder::query(uint32_t conn, const std::string &sql) {
+    if (!begin_record(RECORD_QUERY, conn))
+        return;
+
+    put_bytes(sql.data(), sql.size());
+    end_record();
+}
+
+void mysqlpp_recorder::prepare(uint32_t conn, const std::string &sql) {
+    if (!begin_record(RECORD_PREPARE, conn))
+        return;
+
+    put_bytes(sql.data(), sql.size());
+    end_record();
+}
+
+void mysqlpp_recorder::execute(uint32_t conn, mysqlpp_bind *bind) {
+    if (!begin_record(RECORD_EXECUTE, conn))
+        return;
+
+    int count = bind ? bind->_size : 0;
+
+    put_varint(count);
+
+    for (int i = 0; i < count; i++) {
+        const MYSQL_BIND &b = bind->_bind[i];
+
+        if (!b.buffer || (b.is_null && *b.is_null)) {
+            _buf.push_back((char)RECORD_PARAM_NULL);
+            continue;
+        }
+
+        switch (b.buffer_type) {
+        case MYSQL_TYPE_LONG:
+            _buf.push_back((char)RECORD_PARAM_INT);
+            put_varint(zigzag(*(const int *)b.buffer));
+            break;
+
+        case MYSQL_TYPE_LONGLONG:
+            _buf.push_back((char)RECORD_PARAM_LLONG);
+            put_varint(zigzag(*(const long long *)b.buffer));
+            break;
+
+        case MYSQL_TYPE_DOUBLE:
+            _buf.push_back((char)RECORD_PARAM_DOUBLE);
+            _buf.append((const char *)b.buffer, sizeof(double));
+            break;
+
+        case MYSQL_TYPE_TIMESTAMP: {
+            const MYSQL_TIME *t = (const MYSQL_TIME *)b.buffer;
+            struct tm ts;
+
+            memset(&ts, 0, sizeof(ts));
+            ts.tm_year = t->year - 1900;
+            ts.tm_mon = t->month - 1;
+            ts.tm_mday = t->day;
+            ts.tm_hour = t->hour;
+            ts.tm_min = t->minute;
+            ts.tm_sec = t->second;
+
+            _buf.push_back((char)RECORD_PARAM_TIMESTAMP);
+            put_varint(zigzag(timegm(&ts)));
+            break;
+        }
+
+        case MYSQL_TYPE_STRING:
+            _buf.push_back((char)RECORD_PARAM_STRING);
+            put_bytes((const char *)b.buffer, bind->_params[i].length);
+            break;
+
+        case MYSQL_TYPE_BLOB:
+            _buf.push_back((char)RECORD_PARAM_BLOB);
+            put_bytes((const char *)b.buffer, bind->_params[i].length);
+            break;
+
+        default:
+            _buf.push_back((char)RECORD_PARAM_NULL);
+            break;
+        }
+    }
+
+    end_record();
+}
+
+void mysqlpp_recorder::done(uint32_t conn, uint64_t elapsed, uint64_t rows, bool failed) {
+    if (!begin_record(RECORD_DONE, conn))
+        return;
+
+    put_varint(elapsed);
+    put_varint(rows);
+    _buf.push_back(failed ? 1 : 0);
+
+    end_record();
+}
+
+void mysqlpp_recorder::close(uint32_t conn) {
+    if (!begin_record(RECORD_CLOSE, conn))
+        return;
+
+    end_record();
+}
+
+bool mysqlpp_recorder::flush() {
+    if (_fd < 0) {
+        _buf.clear();
+        return false;
+    }
+
+    size_t off = 0;
+
+    while (off < _buf.size()) {
+        ssize_t n = ::write(_fd, _buf.data() + off, _buf.size() - off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            _error = std::string("recorder write: ") + strerror(errno);
+            ::close(_fd);
+            _fd = -1;
+            _buf.clear();
+            return false;
+        }
+
+        off += n;
+    }
+
+    _bytes += _buf.size();
+    _buf.clear();
+
+    return true;
+}
+
+mysqlpp_record_reader::mysqlpp_record_reader()
+    : _file(nullptr),
+      _buf(def_recorder_buffer),
+      _pos(0),
+      _end(0),
+      _start_time(0),
+      _offset(0) {
+}
+
+mysqlpp_record_reader::~mysqlpp_record_reader() {
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool mysqlpp_record_reader::open(const std::string &path) {
+    _file = fopen(path.c_str(), "rb");
+    if (!_file) {
+        _error = "open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    if (!fill(record_header_size) || memcmp(&_buf[0], record_magic, 7) != 0 || (uint8_t)_buf[7] != record_version) {
+        _error = path + ": not a mysqlpp record log";
+        return false;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        _start_time |= (uint64_t)(uint8_t)_buf[8 + i] << (8 * i);
+    }
+
+    _pos = record_header_size;
+
+    return true;
+}
+
+bool mysqlpp_record_reader::fill(size_t n) {
+    if (_end - _pos >= n) {
+        return true;
+    }
+
+    memmove(&_buf[0], &_buf[_pos], _end - _pos);
+    _end -= _pos;
+    _pos = 0;
+
+    if (n > _buf.size()) {
+        _buf.resize(n);
+    }
+
+    while (_end < n) {
+        size_t r = fread(&_buf[_end], 1, _buf.size() - _end, _file);
+        if (r == 0) {
+            return false;
+        }
+        _end += r;
+    }
+
+    return true;
+}
+
+bool mysqlpp_record_reader::get_byte(uint8_t &v) {
+    if (!fill(1))
+        return false;
+
+    v = (uint8_t)_buf[_pos++];
+    return true;
+}
+
+bool mysqlpp_record_reader::get_varint(uint64_t &v) {
+    int shift = 0;
+    uint8_t c;
+
+    v = 0;
+    while (shift < 64 && get_byte(c)) {
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+        shift += 7;
+    }
+
+    return false;
+}
+
+// 长度来自文件, 损坏的varint不能让fill()分配几个G: 不超过上限, 也不超过文件剩下的字节
+bool mysqlpp_record_reader::left(size_t n) {
+    if (n > def_record_max_bytes) {
+        return false;
+    }
+
+    if (n <= _end - _pos) {
+        return true;
+    }
+
+    struct stat st;
+    off_t at = ftello(_file);
+
+    if (at < 0 || fstat(fileno(_file), &st) != 0) {
+        return true;  // can't tell, fill() fails at the end of file anyway
+    }
+
+    return st.st_size >= at && n - (_end - _pos) <= (uint64_t)(st.st_size - at);
+}
+
+bool mysqlpp_record_reader::get_bytes(std::string &s, size_t n) {
+    if (!left(n) || !fill(n))
+        return false;
+
+    s.assign(&_buf[_pos], n);
+    _pos += n;
+
+    return true;
+}
+
+bool mysqlpp_record_reader::next(record_t &rec) {
+    uint8_t type;
+    uint64_t delta, conn, v;
+
+    if (!_file || !get_byte(type)) {
+        return false;  // end of log
+    }
+
+    if (!get_varint(delta) || !get_varint(conn)) {
+        goto broken;
+    }
+
+    _offset += delta;
+
+    rec.type = (record_type)type;
+    rec.offset = _offset;
+    rec.conn = (uint32_t)conn;
+    rec.sql.clear();
+    rec.params.clear();
+    rec.elapsed = 0;
+    rec.rows = 0;
+    rec.failed = false;
+
+    switch (type) {
+    case RECORD_QUERY:
+    case RECORD_PREPARE:
+        if (!get_varint(v) || !get_bytes(rec.sql, v))
+            goto broken;
+        break;
+
+    case RECORD_EXECUTE: {
+        uint64_t count;
+
+        if (!get_varint(count) || count > 65535)
+            goto broken;
+
+        rec.params.resize(count);
+
+        for (uint64_t i = 0; i < count; i++) {
+            record_param_t &p = rec.params[i];
+            uint8_t t;
+
+            if (!get_byte(t))
+                goto broken;
+
+            p.type = (record_param_type)t;
+            p.integer = 0;
+            p.real = 0;
+
+            switch (t) {
+            case RECORD_PARAM_NULL:
+                break;
+            case RECORD_PARAM_INT:
+            case RECORD_PARAM_LLONG:
+            case RECORD_PARAM_TIMESTAMP:
+                if (!get_varint(v))
+                    goto broken;
+                p.integer = unzigzag(v);
+                break;
+            case RECORD_PARAM_DOUBLE:
+                if (!fill(sizeof(double)))
+                    goto broken;
+                memcpy(&p.real, &_buf[_pos], sizeof(double));
+                _pos += sizeof(double);
+                break;
+            case RECORD_PARAM_STRING:
+            case RECORD_PARAM_BLOB:
+                if (!get_varint(v) || !get_bytes(p.data, v))
+                    goto broken;
+                break;
+            default:
+                goto broken;
+            }
+        }
+        break;
+    }
+
+    case RECORD_DONE: {
+        uint8_t failed;
+
+        if (!get_varint(rec.elapsed) || !get_varint(rec.rows) || !get_byte(failed))
+            goto broken;
+        rec.failed = failed != 0;
+        break;
+    }
+
+    case RECORD_CLOSE:
+        break;
+
+    default:
+        goto broken;
+    }
+
+    return true;
+
+broken:
+    _error = "truncated or corrupted record";
+    fclose(_file);
+    _file = nullptr;
+    return false;
+}
@@ -0,0 +1,162 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 11:00:00
+ * @modify date 2026-10-20 18:00:00
+ * @desc [负载录制: query/prepare/execute连同绑定参数, 时间偏移和连接编号写入紧凑的二进制日志, 供回放工具使用]
+ */
+
+#ifndef __mysql_recorder_h__
+#define __mysql_recorder_h__
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+class mysqlpp_bind;
+
+static const size_t def_recorder_buffer = 64 * 1024;
+static const size_t def_record_max_bytes = 1024 * 1024 * 1024;  // max_allowed_packet can't be larger
+
+enum record_type {
+    RECORD_QUERY = 1,
+    RECORD_PREPARE,
+    RECORD_EXECUTE,
+    RECORD_DONE,     // request finished: original latency, rows, failed
+    RECORD_CLOSE     // connection given back by the user
+};
+
+enum record_param_type {
+    RECORD_PARAM_NULL,
+    RECORD_PARAM_INT,
+    RECORD_PARAM_LLONG,
+    RECORD_PARAM_DOUBLE,
+    RECORD_PARAM_TIMESTAMP,  // integer is epoch seconds, UTC like set_timestamp
+    RECORD_PARAM_STRING,
+    RECORD_PARAM_BLOB
+};
+
+typedef struct record_param_s {
+    record_param_type type;
+    long long integer;
+    double real;
+    std::string data;
+} record_param_t;
+
+typedef struct record_s {
+    record_type type;
+    uint64_t offset;   // microseconds since recording started
+    uint32_t conn;     // connection number, unique in one log
+    std::string sql;   // QUERY, PREPARE
+    std::vector<record_param_t> params;  // EXECUTE
+
+    uint64_t elapsed;  // DONE
+    uint64_t rows;
+    bool failed;
+} record_t;
+
+/*
+ 文件格式: 头部"MYPPREC" + 版本(1字节) + 录制开始的墙上时间(8字节小端, 微秒).
+ 每条记录: 类型(1字节) + varint(与上一条的时间差) + varint(连接编号) + 负载:
+   QUERY/PREPARE  varint(长度) + sql
+   EXECUTE        varint(参数个数) + 每个参数: 类型(1字节) + 值(整数zigzag varint, double 8字节, 字符串varint长度前缀)
+   DONE           varint(耗时) + varint(行数) + 失败(1字节)
+   CLOSE          无
+ 只在event loop线程写, 先写入内存缓冲, 满了才write, 达到上限之后停止录制.
+*/
+class mysqlpp_recorder {
+public:
+    mysqlpp_recorder(const std::string &path, size_t buffer_size = def_recorder_buffer);
+    ~mysqlpp_recorder();
+
+    bool failed() {
+        return _fd < 0;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    // stop recording once the log reaches bytes, 0 for unlimited (default)
+    void set_limit(uint64_t bytes) {
+        _limit = bytes;
+    }
+
+    uint64_t get_bytes() {
+        return _bytes;
+    }
+
+    uint32_t next_conn() {
+        return ++_conns;
+    }
+
+    void query(uint32_t conn, const std::string &sql);
+    void prepare(uint32_t conn, const std::string &sql);
+    void execute(uint32_t conn, mysqlpp_bind *bind);
+    void done(uint32_t conn, uint64_t elapsed, uint64_t rows, bool failed);
+    void close(uint32_t conn);
+
+    bool flush();
+
+private:
+    bool begin_record(record_type type, uint32_t conn);
+    void end_record();
+
+    void put_varint(uint64_t v);
+    void put_bytes(const char *s, size_t n);
+
+private:
+    int _fd;
+    std::string _error;
+
+    std::string _buf;
+    size_t _buffer_size;
+
+    uint64_t _start;
+    uint64_t _last;
+    uint64_t _limit;
+    uint64_t _bytes;
+
+    uint32_t _conns;
+};
+
+class mysqlpp_record_reader {
+public:
+    mysqlpp_record_reader();
+    ~mysqlpp_record_reader();
+
+    bool open(const std::string &path);
+
+    // false at the end of log or on a broken record, see error()
+    bool next(record_t &rec);
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    uint64_t get_start_time() {
+        return _start_time;
+    }
+
+private:
+    bool fill(size_t n);
+    bool get_byte(uint8_t &v);
+    bool get_varint(uint64_t &v);
+    bool get_bytes(std::string &s, size_t n);
+    bool left(size_t n);
+
+private:
+    FILE *_file;
+    std::string _error;
+
+    std::vector<char> _buf;
+    size_t _pos;
+    size_t _end;
+
+    uint64_t _start_time;
+    uint64_t _offset;
+};
+
+#endif
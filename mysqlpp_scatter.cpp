@@ -0,0 +1,347 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 14:00:00
+ * @modify date 2026-10-19 18:30:00
+ * @desc [description]
+ */
+#include "mysqlpp_scatter.h"
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+mysqlpp_scatter::mysqlpp_scatter(const std::vector<mysqlpp_pool *> &pools, const std::string &sql)
+    : _pools(pools),
+      _sql(sql),
+      _cb(nullptr),
+      _argument(nullptr),
+      _order_column(0),
+      _order_type(ORDER_STRING),
+      _desc(false),
+      _limit(0),
+      _pushdown(false),
+      _delivered(0),
+      _columns(0),
+      _active(0),
+      _current(-1),
+      _failed(false),
+      _eof(false),
+      _pumping(false) {
+}
+
+mysqlpp_scatter::~mysqlpp_scatter() {
+}
+
+void mysqlpp_scatter::set_order(int column, scatter_order_type type, bool desc) {
+    _order_column = column;
+    _order_type = type;
+    _desc = desc;
+}
+
+// 只看引号和括号之外的部分, 这些子句都必须在LIMIT之后, 或者会吞掉追加的LIMIT
+static bool limit_appendable(const std::string &sql) {
+    static const char *clauses[] = { "limit", "for", "lock", "into", "procedure" };
+
+    const char *s = sql.c_str();
+    size_t len = sql.size();
+    size_t i = 0;
+    int depth = 0;
+
+    while (i < len) {
+        char c = s[i];
+
+        if (c == ';' || c == '#' || (c == '-' && i + 1 < len && s[i + 1] == '-') || (c == '/' && i + 1 < len && s[i + 1] == '*')) {
+            return false;
+        }
+
+        if (c == '\'' || c == '"' || c == '`') {
+            i++;
+            while (i < len && s[i] != c)
+                i += (s[i] == '\\' && c != '`') ? 2 : 1;
+            i++;
+            continue;
+        }
+
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+        } else if (isalpha((unsigned char)c) || c == '_') {
+            size_t start = i;
+            while (i < len && (isalnum((unsigned char)s[i]) || s[i] == '_' || s[i] == '$'))
+                i++;
+
+            if (depth == 0) {
+                for (unsigned int k = 0; k < sizeof(clauses) / sizeof(clauses[0]); k++) {
+                    if (strlen(clauses[k]) == i - start && strncasecmp(s + start, clauses[k], i - start) == 0)
+                        return false;
+                }
+            }
+            continue;
+        }
+
+        i++;
+    }
+
+    return true;
+}
+
+bool mysqlpp_scatter::set_limit(int limit, bool pushdown) {
+    _limit = limit;
+    _pushdown = pushdown && limit > 0 && limit_appendable(_sql);
+
+    return _pushdown || !pushdown;
+}
+
+int mysqlpp_scatter::get_shard() {
+    return _current;
+}
+
+char **mysqlpp_scatter::get_column_content() {
+    return _current < 0 ? nullptr : _shards[_current].row;
+}
+
+unsigned long *mysqlpp_scatter::get_column_lengths() {
+    return _current < 0 ? nullptr : _shards[_current].lengths;
+}
+
+// a是否排在b之后, 相同的key按分片序号稳定排序, NULL排在最前(与mysql一致)
+bool mysqlpp_scatter::after(int a, int b) {
+    const scatter_shard_t &x = _shards[a];
+    const scatter_shard_t &y = _shards[b];
+    int c = 0;
+
+    if (_order_column > 0) {
+        if (x.null || y.null) {
+            c = (int)y.null - (int)x.null;
+        } else if (_order_type == ORDER_INTEGER) {
+            c = x.ikey < y.ikey ? -1 : (x.ikey > y.ikey ? 1 : 0);
+        } else if (_order_type == ORDER_DOUBLE) {
+            c = x.dkey < y.dkey ? -1 : (x.dkey > y.dkey ? 1 : 0);
+        } else {
+            unsigned long n = x.slen < y.slen ? x.slen : y.slen;
+            c = memcmp(x.skey, y.skey, n);
+            if (c == 0)
+                c = x.slen < y.slen ? -1 : (x.slen > y.slen ? 1 : 0);
+        }
+
+        if (_desc)
+            c = -c;
+    }
+
+    if (c == 0)
+        return a > b;
+
+    return c > 0;
+}
+
+void mysqlpp_scatter::sift_up(int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!after(_heap[parent], _heap[pos]))
+            break;
+
+        int t = _heap[parent];
+        _heap[parent] = _heap[pos];
+        _heap[pos] = t;
+        pos = parent;
+    }
+}
+
+void mysqlpp_scatter::sift_down(int pos) {
+    int n = (int)_heap.size();
+
+    for (;;) {
+        int l = pos * 2 + 1, r = l + 1, m = pos;
+        if (l < n && after(_heap[m], _heap[l]))
+            m = l;
+        if (r < n && after(_heap[m], _heap[r]))
+            m = r;
+        if (m == pos)
+            break;
+
+        int t = _heap[m];
+        _heap[m] = _heap[pos];
+        _heap[pos] = t;
+        pos = m;
+    }
+}
+
+void mysqlpp_scatter::push(scatter_shard_t *sh) {
+    if (_order_column > 0) {
+        int i = _order_column - 1;
+        const char *s = sh->row[i];
+
+        sh->null = s == nullptr;
+        if (s) {
+            switch (_order_type) {
+            case ORDER_INTEGER:
+                sh->ikey = strtoll(s, nullptr, 10);
+                break;
+            case ORDER_DOUBLE:
+                sh->dkey = strtod(s, nullptr);
+                break;
+            default:
+                sh->skey = s;
+                sh->slen = sh->lengths ? sh->lengths[i] : strlen(s);
+                break;
+            }
+        }
+    }
+
+    _heap.push_back(sh->index);
+    sift_up((int)_heap.size() - 1);
+}
+
+int mysqlpp_scatter::pop() {
+    int top = _heap[0];
+
+    _heap[0] = _heap.back();
+    _heap.pop_back();
+
+    if (!_heap.empty())
+        sift_down(0);
+
+    return top;
+}
+
+void mysqlpp_scatter::start(scatter_callback cb, void *argument) {
+    _cb = cb;
+    _argument = argument;
+
+    std::string sql = _sql;
+    if (_limit > 0 && _pushdown) {
+        sql += " LIMIT " + std::to_string(_limit);
+    }
+
+    _shards.resize(_pools.size());
+    _heap.reserve(_pools.size());
+    _active = (int)_pools.size();
+
+    for (unsigned int i = 0; i < _pools.size(); i++) {
+        scatter_shard_t &sh = _shards[i];
+        memset(&sh, 0, sizeof(sh));
+        sh.sg = this;
+        sh.index = (int)i;
+        sh.conn = _pools[i]->get_connection();
+    }
+
+    // 所有分片都发出以后再处理回调, 同步失败的分片不会提前结束整个请求
+    _pumping = true;
+    for (unsigned int i = 0; i < _shards.size(); i++) {
+        mysqlpp_conn *conn = _shards[i].conn;
+        if (!conn)
+            continue;
+
+        conn->set_user_callback(&mysqlpp_scatter::shard_callback);
+        conn->set_user_argument(&_shards[i]);
+        conn->query(sql);
+    }
+    _pumping = false;
+
+    pump();
+}
+
+// 结束: 关闭所有分片连接, 还在读取结果的连接直接cancel, 然后释放自己
+void mysqlpp_scatter::finish() {
+    for (unsigned int i = 0; i < _shards.size(); i++) {
+        mysqlpp_conn *conn = _shards[i].conn;
+        if (!conn)
+            continue;
+
+        _shards[i].conn = nullptr;
+
+        conn->cancel();
+        conn->close();
+    }
+
+    delete this;
+}
+
+// 所有未结束的分片都有当前行时, 才能确定下一行; 不可重入, resume()可能同步回调shard_callback
+void mysqlpp_scatter::pump() {
+    if (_pumping) {
+        return;
+    }
+
+    _pumping = true;
+
+    for (;;) {
+        if (_failed) {
+            _current = -1;
+            _cb(this, _argument);
+            finish();
+            return;
+        }
+
+        int need = _order_column > 0 ? _active : 1;
+        if (_active > 0 && (int)_heap.size() < need) {
+            break;  // wait for more rows
+        }
+
+        if (_heap.empty() || (_limit > 0 && _delivered >= _limit)) {
+            _current = -1;
+            _eof = true;
+            _cb(this, _argument);
+            finish();
+            return;
+        }
+
+        _current = pop();
+        _delivered++;
+
+        if (_cb(this, _argument)) {
+            finish();  // user stop early
+            return;
+        }
+
+        mysqlpp_conn *conn = _shards[_current].conn;
+        _current = -1;
+
+        conn->resume();
+    }
+
+    _pumping = false;
+}
+
+bool mysqlpp_scatter::shard_callback(mysqlpp_conn *conn, void *argument) {
+    scatter_shard_t *sh = (scatter_shard_t *)argument;
+    mysqlpp_scatter *sg = sh->sg;
+
+    if (conn->failed()) {
+        if (!sg->_failed) {
+            sg->_failed = true;
+            sg->_error = "shard " + std::to_string(sh->index) + ": " + conn->error();
+        }
+
+        sh->conn = nullptr;
+        sg->_active--;
+        conn->close();
+
+        sg->pump();
+        return true;
+    }
+
+    if (conn->result_eof() || conn->get_column_count() == 0) {
+        sh->conn = nullptr;
+        sg->_active--;
+        conn->close();
+
+        sg->pump();
+        return true;
+    }
+
+    sg->_columns = conn->get_column_count();
+
+    sh->row = conn->get_column_content();
+    sh->lengths = conn->get_column_lengths();
+
+    conn->pause();
+    sg->push(sh);
+
+    sg->pump();  // sg may be freed
+    return false;
+}
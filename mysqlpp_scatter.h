@@ -0,0 +1,123 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 14:00:00
+ * @modify date 2026-10-19 18:30:00
+ * @desc [scatter-gather: 同一个查询并发发往所有分片, 按ORDER BY列流式k路归并]
+ */
+
+#ifndef __mysql_scatter_h__
+#define __mysql_scatter_h__
+
+#include <vector>
+#include <string>
+
+class mysqlpp_pool;
+class mysqlpp_conn;
+class mysqlpp_scatter;
+
+typedef bool (*scatter_callback)(mysqlpp_scatter *sg, void *argument);
+
+enum scatter_order_type {
+    ORDER_STRING,   // byte order, same as binary collation
+    ORDER_INTEGER,
+    ORDER_DOUBLE
+};
+
+typedef struct scatter_shard_s {
+    mysqlpp_scatter *sg;
+    int index;
+
+    mysqlpp_conn *conn;  // nullptr after eof or failed
+
+    char **row;  // current row, valid while the connection is paused
+    unsigned long *lengths;
+
+    bool null;
+    long long ikey;
+    double dkey;
+    const char *skey;
+    unsigned long slen;
+} scatter_shard_t;
+
+// 每个分片只保留当前一行(直接引用libmysql的行缓冲), 内存与分片数成正比, 与结果集大小无关.
+// 回调约定与mysqlpp_conn::query相同: 逐行回调, 返回true提前结束; 最后以result_eof()或failed()回调一次.
+// 对象在最后一次回调之后自己释放, 提前结束时还在读取的分片连接会被cancel
+class mysqlpp_scatter {
+public:
+    mysqlpp_scatter(const std::vector<mysqlpp_pool *> &pools, const std::string &sql);
+
+    // column starts from 1, every shard must be sorted by this column in the sql
+    void set_order(int column, scatter_order_type type, bool desc = false);
+
+    // pushdown: append " LIMIT n" to the sql sent to every shard, so the sql must end with ORDER BY
+    // or an earlier clause. 有分号, 注释, 顶层的LIMIT, FOR UPDATE, LOCK IN SHARE MODE, INTO时不下推,
+    // 返回false, limit仍然在归并时生效
+    bool set_limit(int limit, bool pushdown = true);
+
+    void start(scatter_callback cb, void *argument);
+
+    bool failed() {
+        return _failed;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    bool result_eof() {
+        return _eof;
+    }
+
+    int get_shard();  // shard index of current row
+
+    int get_column_count() {
+        return _columns;
+    }
+
+    char **get_column_content();
+    unsigned long *get_column_lengths();
+
+private:
+    ~mysqlpp_scatter();
+
+    static bool shard_callback(mysqlpp_conn *conn, void *argument);
+
+    void push(scatter_shard_t *sh);
+    int pop();
+    bool after(int a, int b);
+    void sift_up(int pos);
+    void sift_down(int pos);
+
+    void pump();
+    void finish();
+
+    std::vector<mysqlpp_pool *> _pools;
+    std::string _sql;
+
+    scatter_callback _cb;
+    void *_argument;
+
+    int _order_column;
+    scatter_order_type _order_type;
+    bool _desc;
+
+    int _limit;
+    bool _pushdown;
+    int _delivered;
+
+    int _columns;
+    int _active;  // shards not yet eof
+    int _current;
+
+    bool _failed;
+    bool _eof;
+    bool _pumping;
+
+    std::string _error;
+
+    std::vector<scatter_shard_t> _shards;
+    std::vector<int> _heap;  // shard index with a pending row, top is the next row in order
+};
+
+#endif
@@ -0,0 +1,581 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 19:00:00
+ * @modify date 2026-10-19 19:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_serialize.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const size_t min_capacity = 4096;
+
+// return length of the valid utf-8 sequence at s, 0 if invalid (overlong, surrogate, > U+10FFFF, truncated)
+static inline int utf8_sequence(const unsigned char *s, size_t n) {
+    unsigned char c = s[0];
+
+    if (c < 0x80)
+        return 1;
+
+    if (c < 0xc2)
+        return 0;
+
+    if (c < 0xe0) {
+        if (n < 2 || (s[1] & 0xc0) != 0x80)
+            return 0;
+        return 2;
+    }
+
+    if (c < 0xf0) {
+        if (n < 3 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80)
+            return 0;
+        if ((c == 0xe0 && s[1] < 0xa0) || (c == 0xed && s[1] >= 0xa0))
+            return 0;
+        return 3;
+    }
+
+    if (c < 0xf5) {
+        if (n < 4 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80 || (s[3] & 0xc0) != 0x80)
+            return 0;
+        if ((c == 0xf0 && s[1] < 0x90) || (c == 0xf4 && s[1] >= 0x90))
+            return 0;
+        return 4;
+    }
+
+    return 0;
+}
+
+// 返回第一个需要特殊处理的字节位置: 控制字符, '"', '\\', 以及非ASCII字节(需要UTF-8校验)
+static inline size_t scan_json(const unsigned char *s, size_t n) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+
+        // signed compare: bytes >= 0x80 are negative, so they are caught together with control characters
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                    _mm_cmplt_epi8(v, space));
+
+        int mask = _mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        unsigned char c = s[i];
+        if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\')
+            return i;
+    }
+
+    return n;
+}
+
+// CSV: ',', '"', CR, LF need quoting, non-ASCII bytes need validation
+static inline size_t scan_csv(const unsigned char *s, size_t n, bool text) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, quote)),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+
+        int mask = _mm_movemask_epi8(m);
+        if (text) {
+            mask |= _mm_movemask_epi8(v);  // high bit
+        }
+
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        unsigned char c = s[i];
+        if (c == ',' || c == '"' || c == '\r' || c == '\n' || (text && c >= 0x80))
+            return i;
+    }
+
+    return n;
+}
+
+bool mysqlpp_serializer::is_valid_utf8(const char *str, size_t n) {
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+
+    while (i < n) {
+#ifdef __SSE2__
+        // skip ascii 16 bytes at a time
+        while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))) == 0) {
+            i += 16;
+        }
+
+        if (i >= n)
+            break;
+#endif
+
+        int len = utf8_sequence(s + i, n - i);
+        if (!len)
+            return false;
+
+        i += len;
+    }
+
+    return true;
+}
+
+mysqlpp_serializer::mysqlpp_serializer(serialize_format format)
+    : _format(format),
+      _header(true),
+      _buf(nullptr),
+      _len(0),
+      _cap(0),
+      _flush(nullptr),
+      _flush_argument(nullptr),
+      _threshold(0),
+      _rows(0),
+      _begun(false),
+      _cb(nullptr),
+      _argument(nullptr) {
+}
+
+mysqlpp_serializer::~mysqlpp_serializer() {
+    free(_buf);
+}
+
+void mysqlpp_serializer::set_flush(flush_callback cb, void *argument, size_t threshold) {
+    _flush = cb;
+    _flush_argument = argument;
+    _threshold = threshold;
+}
+
+void mysqlpp_serializer::grow(size_t n) {
+    size_t cap = _cap * 2;
+
+    if (cap < _len + n)
+        cap = _len + n;
+
+    if (cap < min_capacity)
+        cap = min_capacity;
+
+    _buf = (char *)realloc(_buf, cap);
+    _cap = cap;
+}
+
+void mysqlpp_serializer::put(const char *s, size_t n) {
+    reserve(n);
+    memcpy(_buf + _len, s, n);
+    _len += n;
+}
+
+void mysqlpp_serializer::maybe_flush() {
+    if (_flush && _len >= _threshold) {
+        _flush(_buf, _len, _flush_argument);
+        _len = 0;
+    }
+}
+
+void mysqlpp_serializer::write_json_string(const char *str, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *s = (const unsigned char *)str;
+
+    reserve(n * 6 + 2);  // worst case: every byte is a control character, \u00XX
+
+    char *out = _buf + _len;
+    size_t i = 0;
+
+    *out++ = '"';
+
+    while (i < n) {
+        size_t k = scan_json(s + i, n - i);
+        memcpy(out, s + i, k);
+        out += k;
+        i += k;
+
+        while (i < n) {
+            unsigned char c = s[i];
+
+            if (c >= 0x80) {
+                int len = utf8_sequence(s + i, n - i);
+                if (len) {
+                    memcpy(out, s + i, len);
+                    out += len;
+                    i += len;
+                } else {
+                    memcpy(out, "\xef\xbf\xbd", 3);  // U+FFFD
+                    out += 3;
+                    i++;
+                }
+                continue;
+            }
+
+            if (c == '"' || c == '\\') {
+                *out++ = '\\';
+                *out++ = c;
+                i++;
+                continue;
+            }
+
+            if (c < 0x20) {
+                *out++ = '\\';
+                switch (c) {
+                case '\n': *out++ = 'n'; break;
+                case '\r': *out++ = 'r'; break;
+                case '\t': *out++ = 't'; break;
+                case '\b': *out++ = 'b'; break;
+                case '\f': *out++ = 'f'; break;
+                default:
+                    *out++ = 'u';
+                    *out++ = '0';
+                    *out++ = '0';
+                    *out++ = hex[c >> 4];
+                    *out++ = hex[c & 0x0f];
+                    break;
+                }
+                i++;
+                continue;
+            }
+
+            break;  // plain ascii again, back to vector scan
+        }
+    }
+
+    *out++ = '"';
+    _len = out - _buf;
+}
+
+void mysqlpp_serializer::write_csv_string(const char *str, size_t n, bool text) {
+    const unsigned char *s = (const unsigned char *)str;
+
+    if (!n) {
+        put("\"\"", 2);  // an empty string, not NULL
+        return;
+    }
+
+    size_t k = scan_csv(s, n, text);
+    if (k == n) {
+        put(str, n);  // the common case, no quoting
+        return;
+    }
+
+    reserve(n * 3 + 2);  // worst case: every byte is an invalid one, U+FFFD
+
+    // leave a slot for the opening quote, only valid non-ASCII text may end up unquoted
+    char *slot = _buf + _len;
+    char *out = slot + 1;
+    bool quoted = false;
+    size_t i = 0;
+
+    while (i < n) {
+        memcpy(out, s + i, k);
+        out += k;
+        i += k;
+
+        while (i < n) {
+            unsigned char c = s[i];
+
+            if (c >= 0x80 && text) {
+                int len = utf8_sequence(s + i, n - i);
+                if (len) {
+                    memcpy(out, s + i, len);
+                    out += len;
+                    i += len;
+                } else {
+                    memcpy(out, "\xef\xbf\xbd", 3);
+                    out += 3;
+                    i++;
+                }
+                continue;
+            }
+
+            if (c == '"') {
+                *out++ = '"';
+                *out++ = '"';
+                quoted = true;
+                i++;
+                continue;
+            }
+
+            if (c == ',' || c == '\r' || c == '\n') {
+                *out++ = c;
+                quoted = true;
+                i++;
+                continue;
+            }
+
+            break;
+        }
+
+        if (i < n) {
+            k = scan_csv(s + i, n - i, text);
+        }
+    }
+
+    if (quoted) {
+        *slot = '"';
+        *out++ = '"';
+        _len = out - _buf;
+    } else {
+        memmove(slot, slot + 1, out - slot - 1);
+        _len = out - 1 - _buf;
+    }
+}
+
+void mysqlpp_serializer::write_base64(const char *str, size_t n) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *s = (const unsigned char *)str;
+
+    reserve((n + 2) / 3 * 4 + 2);
+
+    char *out = _buf + _len;
+    size_t i = 0;
+
+    *out++ = '"';
+
+    for (; i + 3 <= n; i += 3) {
+        uint32_t v = (s[i] << 16) | (s[i + 1] << 8) | s[i + 2];
+        *out++ = table[v >> 18];
+        *out++ = table[(v >> 12) & 0x3f];
+        *out++ = table[(v >> 6) & 0x3f];
+        *out++ = table[v & 0x3f];
+    }
+
+    if (i < n) {
+        uint32_t v = s[i] << 16;
+        if (i + 1 < n)
+            v |= s[i + 1] << 8;
+
+        *out++ = table[v >> 18];
+        *out++ = table[(v >> 12) & 0x3f];
+        *out++ = i + 1 < n ? table[(v >> 6) & 0x3f] : '=';
+        *out++ = '=';
+    }
+
+    *out++ = '"';
+    _len = out - _buf;
+}
+
+void mysqlpp_serializer::write_cell(int i, const char *s, size_t n) {
+    column_kind kind = _kinds[i];
+
+    if (_format == SERIALIZE_CSV) {
+        if (kind == COLUMN_NUMBER) {
+            put(s, n);
+        } else {
+            write_csv_string(s, n, kind != COLUMN_BINARY);
+        }
+        return;
+    }
+
+    switch (kind) {
+    case COLUMN_NUMBER:
+    case COLUMN_JSON:
+        put(s, n);
+        break;
+    case COLUMN_BINARY:
+        write_base64(s, n);
+        break;
+    default:
+        write_json_string(s, n);
+        break;
+    }
+}
+
+void mysqlpp_serializer::begin(const MYSQL_FIELD *fields, int count) {
+    _kinds.resize(count);
+    _keys.resize(count);
+    _rows = 0;
+    _begun = true;
+
+    for (int i = 0; i < count; i++) {
+        column_kind kind = COLUMN_TEXT;
+
+        if (fields) {
+            switch (fields[i].type) {
+            case MYSQL_TYPE_TINY:
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_LONGLONG:
+            case MYSQL_TYPE_FLOAT:
+            case MYSQL_TYPE_DOUBLE:
+            case MYSQL_TYPE_DECIMAL:
+            case MYSQL_TYPE_NEWDECIMAL:
+            case MYSQL_TYPE_YEAR:
+                kind = COLUMN_NUMBER;
+                break;
+            case MYSQL_TYPE_JSON:
+                kind = COLUMN_JSON;
+                break;
+            case MYSQL_TYPE_BIT:
+            case MYSQL_TYPE_GEOMETRY:
+                kind = COLUMN_BINARY;
+                break;
+            case MYSQL_TYPE_STRING:
+            case MYSQL_TYPE_VAR_STRING:
+            case MYSQL_TYPE_VARCHAR:
+            case MYSQL_TYPE_TINY_BLOB:
+            case MYSQL_TYPE_MEDIUM_BLOB:
+            case MYSQL_TYPE_LONG_BLOB:
+            case MYSQL_TYPE_BLOB:
+                if (fields[i].charsetnr == 63)  // binary
+                    kind = COLUMN_BINARY;
+                break;
+            default:
+                break;  // temporal types are quoted text
+            }
+        }
+
+        _kinds[i] = kind;
+
+        if (_format == SERIALIZE_JSON_OBJECT) {
+            size_t len = _len;
+            const char *name = fields && fields[i].name ? fields[i].name : "";
+
+            write_json_string(name, strlen(name));
+            _keys[i].assign(_buf + len, _len - len);
+            _keys[i].push_back(':');
+            _len = len;
+        }
+    }
+
+    if (_format != SERIALIZE_CSV) {
+        reserve(1);
+        put('[');
+        return;
+    }
+
+    if (_header && count) {
+        for (int i = 0; i < count; i++) {
+            const char *name = fields && fields[i].name ? fields[i].name : "";
+
+            if (i) {
+                reserve(1);
+                put(',');
+            }
+
+            write_csv_string(name, strlen(name), true);
+        }
+
+        put("\r\n", 2);
+    }
+}
+
+void mysqlpp_serializer::add_row(char **row, const unsigned long *lengths) {
+    int count = (int)_kinds.size();
+
+    if (_format == SERIALIZE_CSV) {
+        for (int i = 0; i < count; i++) {
+            if (i) {
+                reserve(1);
+                put(',');
+            }
+
+            if (row[i]) {
+                write_cell(i, row[i], lengths ? lengths[i] : strlen(row[i]));
+            }
+        }
+
+        put("\r\n", 2);
+    } else {
+        bool object = _format == SERIALIZE_JSON_OBJECT;
+
+        reserve(2);
+        if (_rows)
+            put(',');
+        put(object ? '{' : '[');
+
+        for (int i = 0; i < count; i++) {
+            if (i) {
+                reserve(1);
+                put(',');
+            }
+
+            if (object) {
+                put(_keys[i].data(), _keys[i].size());
+            }
+
+            if (row[i]) {
+                write_cell(i, row[i], lengths ? lengths[i] : strlen(row[i]));
+            } else {
+                put("null", 4);
+            }
+        }
+
+        reserve(1);
+        put(object ? '}' : ']');
+    }
+
+    _rows++;
+
+    maybe_flush();
+}
+
+void mysqlpp_serializer::end() {
+    if (_format != SERIALIZE_CSV) {
+        reserve(1);
+        put(']');
+    }
+
+    _begun = false;
+
+    if (_flush && _len) {
+        _flush(_buf, _len, _flush_argument);
+        _len = 0;
+    }
+}
+
+void mysqlpp_serializer::attach(mysqlpp_conn *conn, user_callback cb, void *argument) {
+    _cb = cb;
+    _argument = argument;
+    _begun = false;
+
+    conn->set_user_callback(&mysqlpp_serializer::row_callback);
+    conn->set_user_argument(this);
+}
+
+bool mysqlpp_serializer::row_callback(mysqlpp_conn *conn, void *argument) {
+    mysqlpp_serializer *s = (mysqlpp_serializer *)argument;
+
+    if (conn->failed() || conn->result_eof() || conn->get_column_count() == 0) {
+        if (!conn->failed()) {
+            if (!s->_begun)
+                s->begin(conn);  // empty result or statement without result set
+            s->end();
+        }
+
+        s->_begun = false;
+
+        // give the connection back to the user, the callback may start next query on it
+        conn->set_user_callback(s->_cb);
+        conn->set_user_argument(s->_argument);
+
+        return s->_cb(conn, s->_argument);
+    }
+
+    if (!s->_begun) {
+        s->begin(conn);
+    }
+
+    s->add_row(conn);
+
+    return false;
+}
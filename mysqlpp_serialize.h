@@ -0,0 +1,128 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 19:00:00
+ * @modify date 2026-10-19 19:00:00
+ * @desc [结果集流式序列化为JSON/CSV: 按MYSQL_FIELD类型决定引号, 字符串用SSE2批量转义和UTF-8校验]
+ */
+
+#ifndef __mysql_serialize_h__
+#define __mysql_serialize_h__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "mysql/mysql.h"
+#include "mysqlpp_conn.h"
+
+enum serialize_format {
+    SERIALIZE_JSON_ARRAY,   // [[1,"a"],[2,"b"]]
+    SERIALIZE_JSON_OBJECT,  // [{"id":1,"name":"a"},{"id":2,"name":"b"}]
+    SERIALIZE_CSV           // RFC 4180, NULL is an empty unquoted field, empty string is ""
+};
+
+// 输出超过阈值时调用, 返回后缓冲清空复用
+typedef void (*flush_callback)(const char *data, size_t size, void *argument);
+
+/*
+ 数值列原样输出不加引号, JSON列在JSON格式里原样嵌入, 二进制列(charset binary)在JSON里输出base64.
+ 文本列里非法的UTF-8字节替换为U+FFFD, 保证输出总是合法的UTF-8.
+ 同一个对象可以反复使用, 缓冲的容量会保留下来.
+*/
+class mysqlpp_serializer {
+public:
+    mysqlpp_serializer(serialize_format format);
+    ~mysqlpp_serializer();
+
+    // stream output in chunks instead of keeping the whole result in memory
+    void set_flush(flush_callback cb, void *argument, size_t threshold = 64 * 1024);
+
+    // CSV only: first line is column names, default true
+    void set_header(bool header) {
+        _header = header;
+    }
+
+    // serialize the result of next query on conn, then call cb (with conn->failed() on error)
+    void attach(mysqlpp_conn *conn, user_callback cb, void *argument);
+
+    void begin(const MYSQL_FIELD *fields, int count);
+    void add_row(char **row, const unsigned long *lengths);
+    void end();
+
+    void begin(mysqlpp_conn *conn) {
+        begin(conn->get_fields(), conn->get_column_count());
+    }
+
+    void add_row(mysqlpp_conn *conn) {
+        add_row(conn->get_column_content(), conn->get_column_lengths());
+    }
+
+    const char *data() {
+        return _buf;
+    }
+
+    size_t size() {
+        return _len;
+    }
+
+    void clear() {
+        _len = 0;
+    }
+
+    uint64_t get_rows() {
+        return _rows;
+    }
+
+    static bool is_valid_utf8(const char *s, size_t n);
+
+private:
+    enum column_kind {
+        COLUMN_NUMBER,
+        COLUMN_TEXT,
+        COLUMN_BINARY,
+        COLUMN_JSON
+    };
+
+    static bool row_callback(mysqlpp_conn *conn, void *argument);
+
+    void reserve(size_t n) {
+        if (_len + n > _cap)
+            grow(n);
+    }
+
+    void put(char c) {
+        _buf[_len++] = c;
+    }
+
+    void put(const char *s, size_t n);
+    void grow(size_t n);
+    void maybe_flush();
+
+    void write_json_string(const char *s, size_t n);
+    void write_csv_string(const char *s, size_t n, bool text);
+    void write_base64(const char *s, size_t n);
+    void write_cell(int i, const char *s, size_t n);
+
+    serialize_format _format;
+    bool _header;
+
+    char *_buf;
+    size_t _len;
+    size_t _cap;
+
+    flush_callback _flush;
+    void *_flush_argument;
+    size_t _threshold;
+
+    std::vector<column_kind> _kinds;
+    std::vector<std::string> _keys;  // escaped "name": for JSON object
+
+    uint64_t _rows;
+    bool _begun;
+
+    user_callback _cb;
+    void *_argument;
+};
+
+#endif
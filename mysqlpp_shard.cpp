@@ -0,0 +1,186 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 13:00:00
+ * @modify date 2026-10-19 13:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_shard.h"
+#include "mysqlpp_pool.h"
+#include <algorithm>
+#include <string.h>
+
+static bool point_less(const shard_point_t &a, const shard_point_t &b) {
+    return a.hash < b.hash || (a.hash == b.hash && a.node < b.node);
+}
+
+mysqlpp_shard_router::mysqlpp_shard_router(int vnodes)
+    : _vnodes(vnodes) {
+}
+
+mysqlpp_shard_router::~mysqlpp_shard_router() {
+}
+
+// MurmurHash64A
+uint64_t mysqlpp_shard_router::hash(const void *key, size_t len, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    const unsigned char *data = (const unsigned char *)key;
+    const unsigned char *end = data + (len & ~(size_t)7);
+
+    uint64_t h = seed ^ (len * m);
+
+    while (data != end) {
+        uint64_t k;
+        memcpy(&k, data, 8);
+        data += 8;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= (uint64_t)data[6] << 48;  // fall through
+    case 6: h ^= (uint64_t)data[5] << 40;  // fall through
+    case 5: h ^= (uint64_t)data[4] << 32;  // fall through
+    case 4: h ^= (uint64_t)data[3] << 24;  // fall through
+    case 3: h ^= (uint64_t)data[2] << 16;  // fall through
+    case 2: h ^= (uint64_t)data[1] << 8;   // fall through
+    case 1: h ^= (uint64_t)data[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+int mysqlpp_shard_router::find_node(const std::string &name) {
+    for (unsigned int i = 0; i < _nodes.size(); i++) {
+        if (_nodes[i].name == name) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+void mysqlpp_shard_router::rebuild() {
+    std::vector<shard_point_t> ring;
+
+    for (unsigned int i = 0; i < _nodes.size(); i++) {
+        const std::string &name = _nodes[i].name;
+        int points = _nodes[i].weight * _vnodes;
+
+        for (int v = 0; v < points; v++) {
+            shard_point_t pt;
+            pt.hash = hash(name.data(), name.size(), (uint64_t)v);
+            pt.node = (int)i;
+            ring.push_back(pt);
+        }
+    }
+
+    std::sort(ring.begin(), ring.end(), point_less);
+
+    _ring.swap(ring);
+}
+
+bool mysqlpp_shard_router::add_node(const std::string &name, mysqlpp_pool *pp, int weight) {
+    if (weight <= 0 || !pp || find_node(name) >= 0) {
+        return false;
+    }
+
+    shard_node_t node;
+    node.name = name;
+    node.pool = pp;
+    node.weight = weight;
+
+    _nodes.push_back(node);
+    rebuild();
+
+    return true;
+}
+
+bool mysqlpp_shard_router::remove_node(const std::string &name) {
+    int i = find_node(name);
+    if (i < 0) {
+        return false;
+    }
+
+    _nodes.erase(_nodes.begin() + i);
+    rebuild();
+
+    return true;
+}
+
+bool mysqlpp_shard_router::set_weight(const std::string &name, int weight) {
+    int i = find_node(name);
+    if (i < 0 || weight <= 0) {
+        return false;
+    }
+
+    _nodes[i].weight = weight;
+    rebuild();
+
+    return true;
+}
+
+// 顺时针方向第一个虚拟节点
+int mysqlpp_shard_router::lookup(uint64_t h) {
+    if (_ring.empty()) {
+        return -1;
+    }
+
+    size_t lo = 0, hi = _ring.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (_ring[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == _ring.size()) {
+        lo = 0;  // wrap around
+    }
+
+    return _ring[lo].node;
+}
+
+mysqlpp_pool *mysqlpp_shard_router::route(const char *key, size_t len) {
+    int i = lookup(hash(key, len));
+
+    return i < 0 ? nullptr : _nodes[i].pool;
+}
+
+mysqlpp_pool *mysqlpp_shard_router::route(long long key) {
+    int i = lookup(hash(&key, sizeof(key)));
+
+    return i < 0 ? nullptr : _nodes[i].pool;
+}
+
+const std::string *mysqlpp_shard_router::route_name(const char *key, size_t len) {
+    int i = lookup(hash(key, len));
+
+    return i < 0 ? nullptr : &_nodes[i].name;
+}
+
+mysqlpp_conn *mysqlpp_shard_router::get_connection(const char *key, size_t len) {
+    mysqlpp_pool *pp = route(key, len);
+
+    return pp ? pp->get_connection() : nullptr;
+}
+
+mysqlpp_conn *mysqlpp_shard_router::get_connection(long long key) {
+    mysqlpp_pool *pp = route(key);
+
+    return pp ? pp->get_connection() : nullptr;
+}
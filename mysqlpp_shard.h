@@ -0,0 +1,73 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 13:00:00
+ * @modify date 2026-10-19 13:00:00
+ * @desc [一致性hash分片路由: 具名pool + 权重虚拟节点, 查找不分配内存]
+ */
+
+#ifndef __mysql_shard_h__
+#define __mysql_shard_h__
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+static const int def_shard_vnodes = 160;  // virtual nodes per weight unit
+
+class mysqlpp_pool;
+class mysqlpp_conn;
+
+typedef struct shard_node_s {
+    std::string name;
+    mysqlpp_pool *pool;
+    int weight;
+} shard_node_t;
+
+typedef struct shard_point_s {
+    uint64_t hash;
+    int node;  // index of _nodes
+} shard_point_t;
+
+// 虚拟节点的位置只取决于节点名字, 增删节点或者调整权重时只有相邻区间的key会迁移
+// router不拥有pool, 由用户负责释放
+class mysqlpp_shard_router {
+public:
+    mysqlpp_shard_router(int vnodes = def_shard_vnodes);
+    ~mysqlpp_shard_router();
+
+    // 以下修改操作会重建hash环, 不要在热路径上调用
+    bool add_node(const std::string &name, mysqlpp_pool *pp, int weight = 1);
+    bool remove_node(const std::string &name);
+    bool set_weight(const std::string &name, int weight);
+
+    int size() {
+        return (int)_nodes.size();
+    }
+
+    // 热路径, 不分配内存
+    mysqlpp_pool *route(const char *key, size_t len);
+    mysqlpp_pool *route(long long key);
+
+    // 返回节点名字, 用于记录日志或者迁移数据时比较新旧归属
+    const std::string *route_name(const char *key, size_t len);
+
+    mysqlpp_conn *get_connection(const char *key, size_t len);
+    mysqlpp_conn *get_connection(long long key);
+
+    static uint64_t hash(const void *key, size_t len, uint64_t seed = 0);
+
+private:
+    int find_node(const std::string &name);
+    int lookup(uint64_t h);
+
+    void rebuild();
+
+    int _vnodes;
+
+    std::vector<shard_node_t> _nodes;
+    std::vector<shard_point_t> _ring;  // sorted by hash
+};
+
+#endif
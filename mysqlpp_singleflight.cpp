@@ -0,0 +1,214 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 15:00:00
+ * @modify date 2026-10-19 15:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_singleflight.h"
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+
+static const uint32_t null_offset = 0xffffffff;
+
+mysqlpp_rows::mysqlpp_rows()
+    : _failed(false),
+      _rows(0),
+      _columns(0),
+      _affected_rows(0),
+      _insert_id(0) {
+}
+
+void mysqlpp_rows::set_columns(int columns) {
+    _columns = columns;
+}
+
+void mysqlpp_rows::append(int column, const char *value, unsigned long length) {
+    if (column == 1) {
+        _rows++;
+    }
+
+    if (!value) {
+        _offsets.push_back(null_offset);
+        _lengths.push_back(0);
+        return;
+    }
+
+    _offsets.push_back((uint32_t)_data.size());
+    _lengths.push_back((uint32_t)length);
+
+    _data.append(value, length);
+    _data.push_back('\0');
+}
+
+const char *mysqlpp_rows::get_value(int row, int column) {
+    if (row < 0 || row >= _rows || column < 1 || column > _columns) {
+        return nullptr;
+    }
+
+    uint32_t off = _offsets[row * _columns + column - 1];
+
+    return off == null_offset ? nullptr : _data.data() + off;
+}
+
+unsigned long mysqlpp_rows::get_length(int row, int column) {
+    if (row < 0 || row >= _rows || column < 1 || column > _columns) {
+        return 0;
+    }
+
+    return _lengths[row * _columns + column - 1];
+}
+
+mysqlpp_singleflight::mysqlpp_singleflight(mysqlpp_pool *pp)
+    : _pp(pp),
+      _executions(0),
+      _shared(0) {
+}
+
+// 正在执行的请求持有连接, 必须全部结束以后才能释放
+mysqlpp_singleflight::~mysqlpp_singleflight() {
+}
+
+// 参数用长度前缀区分, 避免不同参数拼接出相同的key
+void mysqlpp_singleflight::build_key(std::string &key, const std::string &sql, const std::vector<std::string> &params) {
+    key = sql;
+
+    for (unsigned int i = 0; i < params.size(); i++) {
+        key.push_back('\0');
+        key.append(std::to_string(params[i].size()));
+        key.push_back(':');
+        key.append(params[i]);
+    }
+}
+
+void mysqlpp_singleflight::query(const std::string &sql, flight_callback cb, void *argument) {
+    static const std::vector<std::string> no_params;
+
+    start(sql, sql, no_params, cb, argument);
+}
+
+void mysqlpp_singleflight::query(const std::string &sql, const std::vector<std::string> &params,
+                flight_callback cb, void *argument) {
+    std::string key;
+
+    build_key(key, sql, params);
+
+    start(key, sql, params, cb, argument);
+}
+
+void mysqlpp_singleflight::start(const std::string &key, const std::string &sql, const std::vector<std::string> &params,
+                flight_callback cb, void *argument) {
+    flight_waiter_t waiter;
+    waiter.cb = cb;
+    waiter.argument = argument;
+
+    std::unordered_map<std::string, flight_t *>::iterator it = _flights.find(key);
+    if (it != _flights.end()) {
+        it->second->waiters.push_back(waiter);
+        _shared++;
+        return;
+    }
+
+    flight_t *flight = new flight_t;
+    flight->sf = this;
+    flight->key = key;
+    flight->sql = sql;
+    flight->params = params;
+    flight->waiters.push_back(waiter);
+
+    _flights[key] = flight;
+    _executions++;
+
+    mysqlpp_conn *conn = _pp->get_connection();
+    conn->set_user_argument(flight);
+
+    if (params.empty()) {
+        conn->set_user_callback(&mysqlpp_singleflight::query_callback);
+        conn->query(flight->sql);
+    } else {
+        conn->set_user_callback(&mysqlpp_singleflight::prepare_callback);
+        conn->prepare(flight->sql);
+    }
+}
+
+// 先从表中摘除, 回调里再发起相同的查询会开始新的执行
+void mysqlpp_singleflight::complete(flight_t *flight, mysqlpp_conn *conn) {
+    if (conn->failed()) {
+        flight->rows._failed = true;
+        flight->rows._error = conn->error();
+    } else {
+        flight->rows._affected_rows = conn->affected_rows();
+        flight->rows._insert_id = conn->insert_id();
+    }
+
+    _flights.erase(flight->key);
+
+    conn->close();
+
+    for (unsigned int i = 0; i < flight->waiters.size(); i++) {
+        flight->waiters[i].cb(&flight->rows, flight->waiters[i].argument);
+    }
+
+    delete flight;
+}
+
+bool mysqlpp_singleflight::query_callback(mysqlpp_conn *conn, void *argument) {
+    flight_t *flight = (flight_t *)argument;
+
+    if (conn->failed() || conn->result_eof() || conn->get_column_count() == 0) {
+        flight->sf->complete(flight, conn);
+        return true;
+    }
+
+    int columns = conn->get_column_count();
+    char **row = conn->get_column_content();
+    unsigned long *lengths = conn->get_column_lengths();
+
+    flight->rows.set_columns(columns);
+    for (int i = 0; i < columns; i++) {
+        flight->rows.append(i + 1, row[i], lengths[i]);
+    }
+
+    return false;
+}
+
+bool mysqlpp_singleflight::prepare_callback(mysqlpp_conn *conn, void *argument) {
+    flight_t *flight = (flight_t *)argument;
+
+    if (conn->failed()) {
+        flight->sf->complete(flight, conn);
+        return true;
+    }
+
+    mysqlpp_bind *bind = conn->get_exec_bind();
+    for (unsigned int i = 0; bind && i < flight->params.size(); i++) {
+        bind->set_string(i + 1, flight->params[i].data(), flight->params[i].size());  // keyed by the whole value, NUL included
+    }
+
+    conn->set_user_callback(&mysqlpp_singleflight::execute_callback);
+    conn->execute();
+
+    return false;
+}
+
+bool mysqlpp_singleflight::execute_callback(mysqlpp_conn *conn, void *argument) {
+    flight_t *flight = (flight_t *)argument;
+    mysqlpp_result *result = conn->get_exec_result();
+
+    if (conn->failed() || conn->result_eof() || !result) {
+        flight->sf->complete(flight, conn);
+        return true;
+    }
+
+    int columns = result->get_column_count();
+
+    flight->rows.set_columns(columns);
+    for (int i = 1; i <= columns; i++) {
+        int size = 0;
+        const void *value = result->get_blob(i, size);
+
+        flight->rows.append(i, (const char *)value, (unsigned long)size);
+    }
+
+    return false;
+}
@@ -0,0 +1,140 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 15:00:00
+ * @modify date 2026-10-19 15:00:00
+ * @desc [single-flight: 相同sql和参数的并发查询合并为一次执行, 所有等待者得到同一份结果]
+ */
+
+#ifndef __mysql_singleflight_h__
+#define __mysql_singleflight_h__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+class mysqlpp_pool;
+class mysqlpp_conn;
+class mysqlpp_singleflight;
+
+// 一次执行的完整结果, 所有单元格连续存放在一块内存里
+class mysqlpp_rows {
+public:
+    mysqlpp_rows();
+
+    bool failed() {
+        return _failed;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    int get_row_count() {
+        return _rows;
+    }
+
+    int get_column_count() {
+        return _columns;
+    }
+
+    // row starts from 0, column starts from 1 (same as mysqlpp_result), nullptr for NULL
+    const char *get_value(int row, int column);
+    unsigned long get_length(int row, int column);
+
+    uint64_t affected_rows() {
+        return _affected_rows;
+    }
+
+    uint64_t insert_id() {
+        return _insert_id;
+    }
+
+private:
+    friend class mysqlpp_singleflight;
+
+    void set_columns(int columns);
+    void append(int column, const char *value, unsigned long length);
+
+    bool _failed;
+    std::string _error;
+
+    int _rows;
+    int _columns;
+
+    uint64_t _affected_rows;
+    uint64_t _insert_id;
+
+    std::string _data;  // every cell is NUL terminated
+    std::vector<uint32_t> _offsets;  // rows * columns, null_offset for NULL
+    std::vector<uint32_t> _lengths;
+};
+
+// rows只在回调期间有效, 需要保留的数据请自行拷贝
+typedef void (*flight_callback)(mysqlpp_rows *rows, void *argument);
+
+typedef struct flight_waiter_s {
+    flight_callback cb;
+    void *argument;
+} flight_waiter_t;
+
+typedef struct flight_s {
+    mysqlpp_singleflight *sf;
+
+    std::string key;
+    std::string sql;
+    std::vector<std::string> params;
+
+    std::vector<flight_waiter_t> waiters;
+
+    mysqlpp_rows rows;
+} flight_t;
+
+// 只用于只读且允许共享结果的查询. 执行结束前到达的相同请求挂在同一次执行上,
+// 结束以后到达的请求会发起新的执行
+class mysqlpp_singleflight {
+public:
+    mysqlpp_singleflight(mysqlpp_pool *pp);
+    ~mysqlpp_singleflight();
+
+    // text protocol, key is the sql
+    void query(const std::string &sql, flight_callback cb, void *argument);
+
+    // prepared statement, every parameter is bound as string, key is the sql and parameters
+    void query(const std::string &sql, const std::vector<std::string> &params,
+        flight_callback cb, void *argument);
+
+    int get_inflight() {
+        return (int)_flights.size();
+    }
+
+    uint64_t get_executions() {
+        return _executions;
+    }
+
+    uint64_t get_shared() {
+        return _shared;
+    }
+
+private:
+    static bool query_callback(mysqlpp_conn *conn, void *argument);
+    static bool prepare_callback(mysqlpp_conn *conn, void *argument);
+    static bool execute_callback(mysqlpp_conn *conn, void *argument);
+
+    static void build_key(std::string &key, const std::string &sql, const std::vector<std::string> &params);
+
+    void start(const std::string &key, const std::string &sql, const std::vector<std::string> &params,
+        flight_callback cb, void *argument);
+
+    void complete(flight_t *flight, mysqlpp_conn *conn);
+
+    mysqlpp_pool *_pp;
+
+    std::unordered_map<std::string, flight_t *> _flights;
+
+    uint64_t _executions;
+    uint64_t _shared;
+};
+
+#endif
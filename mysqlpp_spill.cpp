@@ -0,0 +1,329 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 20:00:00
+ * @modify date 2026-10-20 19:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_spill.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static inline size_t varint_size(uint64_t v) {
+    size_t n = 1;
+
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+
+    return n;
+}
+
+static inline char *put_varint(char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+
+    *p++ = (char)v;
+    return p;
+}
+
+static inline const char *get_varint(const char *p, const char *end, uint64_t &v) {
+    int shift = 0;
+
+    v = 0;
+    while (p < end && shift < 64) {
+        unsigned char c = *p++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return p;
+        shift += 7;
+    }
+
+    return nullptr;
+}
+
+mysqlpp_spill::mysqlpp_spill(const std::string &dir, size_t segment_size)
+    : _dir(dir),
+      _segment_size(segment_size),
+      _map(nullptr),
+      _rows(0),
+      _bytes(0),
+      _failed(false),
+      _cb(nullptr),
+      _argument(nullptr) {
+}
+
+mysqlpp_spill::~mysqlpp_spill() {
+    seal();
+
+    for (size_t i = 0; i < _segments.size(); i++) {
+        ::close(_segments[i].fd);
+    }
+}
+
+void mysqlpp_spill::fail(const char *what) {
+    _failed = true;
+    _error = std::string(what) + ": " + strerror(errno);
+}
+
+bool mysqlpp_spill::new_segment(size_t size) {
+    seal();
+
+    std::string path = _dir + "/mysqlpp_spill_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+    int fd = mkstemp(&name[0]);
+    if (fd < 0) {
+        fail("spill mkstemp");
+        return false;
+    }
+
+    unlink(&name[0]);
+
+    // a sparse file would get its blocks on the first write through the mapping, SIGBUS if the disk is full
+    int err = posix_fallocate(fd, 0, size);
+    if (err != 0) {
+        errno = err;
+        fail("spill fallocate");
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fail("spill mmap");
+        ::close(fd);
+        return false;
+    }
+
+    spill_segment_t seg;
+    seg.fd = fd;
+    seg.size = size;
+    seg.used = 0;
+    seg.rows = 0;
+
+    _segments.push_back(seg);
+    _map = (char *)map;
+
+    return true;
+}
+
+// 段写满之后解除映射, 脏页留在page cache里由内核回写, 不占用进程的内存
+void mysqlpp_spill::seal() {
+    if (!_map) {
+        return;
+    }
+
+    munmap(_map, _segments.back().size);
+    _map = nullptr;
+}
+
+void mysqlpp_spill::begin(const MYSQL_FIELD *fields, int count) {
+    _names.resize(count);
+    _types.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        _names[i] = fields && fields[i].name ? fields[i].name : "";
+        _types[i] = fields ? fields[i].type : MYSQL_TYPE_STRING;
+    }
+}
+
+bool mysqlpp_spill::add_row(char **row, const unsigned long *lengths) {
+    if (_failed) {
+        return false;
+    }
+
+    int count = (int)_names.size();
+    size_t size = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (!row[i]) {
+            size += 1;
+            continue;
+        }
+
+        unsigned long len = lengths ? lengths[i] : strlen(row[i]);
+        size += varint_size((uint64_t)len + 1) + len + 1;
+    }
+
+    if (!_map || _segments.back().used + size > _segments.back().size) {
+        if (!new_segment(size > _segment_size ? size : _segment_size))
+            return false;
+    }
+
+    spill_segment_t &seg = _segments.back();
+    char *p = _map + seg.used;
+
+    for (int i = 0; i < count; i++) {
+        if (!row[i]) {
+            *p++ = 0;
+            continue;
+        }
+
+        unsigned long len = lengths ? lengths[i] : strlen(row[i]);
+        p = put_varint(p, (uint64_t)len + 1);
+        memcpy(p, row[i], len);
+        p += len;
+        *p++ = '\0';
+    }
+
+    seg.used += size;
+    seg.rows++;
+
+    _rows++;
+    _bytes += size;
+
+    return true;
+}
+
+void mysqlpp_spill::end() {
+    seal();
+
+    // give back the unused tail of the last segment
+    if (!_segments.empty()) {
+        spill_segment_t &seg = _segments.back();
+        if (seg.used && seg.used < seg.size && ftruncate(seg.fd, seg.used) == 0) {
+            seg.size = seg.used;
+        }
+    }
+}
+
+void mysqlpp_spill::attach(mysqlpp_conn *conn, user_callback cb, void *argument) {
+    _cb = cb;
+    _argument = argument;
+
+    conn->set_user_callback(&mysqlpp_spill::row_callback);
+    conn->set_user_argument(this);
+}
+
+bool mysqlpp_spill::row_callback(mysqlpp_conn *conn, void *argument) {
+    mysqlpp_spill *s = (mysqlpp_spill *)argument;
+
+    bool done = conn->failed() || conn->result_eof() || conn->get_column_count() == 0;
+
+    if (!done) {
+        if (s->_names.empty() && s->_rows == 0) {
+            s->begin(conn);
+        }
+
+        if (s->add_row(conn)) {
+            return false;
+        }
+
+        // io error: stop fetching, the user closes the connection
+    } else if (s->_names.empty()) {
+        s->begin(conn);  // empty result
+    }
+
+    s->end();
+
+    conn->set_user_callback(s->_cb);
+    conn->set_user_argument(s->_argument);
+
+    s->_cb(conn, s->_argument);
+    return true;
+}
+
+mysqlpp_spill_cursor::mysqlpp_spill_cursor(mysqlpp_spill *spill)
+    : _spill(spill),
+      _segment(0),
+      _map(nullptr),
+      _map_size(0),
+      _pos(0) {
+    _values.resize(spill->get_column_count());
+    _lengths.resize(spill->get_column_count());
+}
+
+mysqlpp_spill_cursor::~mysqlpp_spill_cursor() {
+    unmap_segment();
+}
+
+bool mysqlpp_spill_cursor::map_segment() {
+    spill_segment_t &seg = _spill->_segments[_segment];
+
+    if (seg.used == 0) {
+        return true;
+    }
+
+    void *map = mmap(nullptr, seg.used, PROT_READ, MAP_SHARED, seg.fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    madvise(map, seg.used, MADV_SEQUENTIAL);
+
+    _map = (const char *)map;
+    _map_size = seg.used;
+
+    return true;
+}
+
+void mysqlpp_spill_cursor::unmap_segment() {
+    if (_map) {
+        munmap((void *)_map, _map_size);
+        _map = nullptr;
+        _map_size = 0;
+    }
+}
+
+void mysqlpp_spill_cursor::rewind() {
+    unmap_segment();
+
+    _segment = 0;
+    _pos = 0;
+}
+
+bool mysqlpp_spill_cursor::next() {
+    int count = (int)_values.size();
+
+    while (_segment < _spill->_segments.size()) {
+        if (!_map && _spill->_segments[_segment].used) {
+            if (!map_segment())
+                return false;
+        }
+
+        if (_pos >= _map_size) {
+            unmap_segment();
+            _segment++;
+            _pos = 0;
+            continue;
+        }
+
+        const char *p = _map + _pos;
+        const char *end = _map + _map_size;
+
+        for (int i = 0; i < count; i++) {
+            uint64_t v;
+
+            p = get_varint(p, end, v);
+            if (!p)
+                return false;
+
+            if (v == 0) {
+                _values[i] = nullptr;
+                _lengths[i] = 0;
+                continue;
+            }
+
+            if ((uint64_t)(end - p) < v)
+                return false;
+
+            _values[i] = p;
+            _lengths[i] = (unsigned long)(v - 1);
+            p += v;
+        }
+
+        _pos = p - _map;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,149 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 20:00:00
+ * @modify date 2026-10-20 19:00:00
+ * @desc [结果集落盘: 行按长度前缀格式追加到mmap的分段文件, 之后用游标重复读取, 连接可以立即还给pool]
+ */
+
+#ifndef __mysql_spill_h__
+#define __mysql_spill_h__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "mysql/mysql.h"
+#include "mysqlpp_conn.h"
+
+static const size_t def_spill_segment_size = 64 * 1024 * 1024;
+
+typedef struct spill_segment_s {
+    int fd;       // unlinked temporary file
+    size_t size;  // file size
+    size_t used;  // bytes of complete rows
+    uint64_t rows;
+} spill_segment_t;
+
+/*
+ 文件格式: 每个单元格为 varint(length + 1) + 数据 + '\0', NULL为单个0字节. 一行不会跨段.
+ 段文件创建后立即unlink, 由内核的page cache负责回写和换出, 对象析构时空间自动回收.
+ 段的空间在映射前用posix_fallocate预留, 磁盘满时add_row()返回false, 而不是写映射时SIGBUS.
+ dir必须在真正的磁盘上: 很多发行版的/tmp是tmpfs, 落在那里的数据仍然占内存, 所以默认用/var/tmp
+*/
+class mysqlpp_spill {
+public:
+    mysqlpp_spill(const std::string &dir = "/var/tmp", size_t segment_size = def_spill_segment_size);
+    ~mysqlpp_spill();
+
+    // spill the result of next query on conn, then call cb. check conn->failed() and failed() there,
+    // close the connection and read the rows back with mysqlpp_spill_cursor
+    void attach(mysqlpp_conn *conn, user_callback cb, void *argument);
+
+    void begin(const MYSQL_FIELD *fields, int count);
+    bool add_row(char **row, const unsigned long *lengths);  // false on io error
+    void end();
+
+    void begin(mysqlpp_conn *conn) {
+        begin(conn->get_fields(), conn->get_column_count());
+    }
+
+    bool add_row(mysqlpp_conn *conn) {
+        return add_row(conn->get_column_content(), conn->get_column_lengths());
+    }
+
+    bool failed() {
+        return _failed;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+    uint64_t get_rows() {
+        return _rows;
+    }
+
+    uint64_t get_bytes() {
+        return _bytes;
+    }
+
+    int get_column_count() {
+        return (int)_names.size();
+    }
+
+    // column starts from 1
+    const char *get_column_name(int column) {
+        return _names[column - 1].c_str();
+    }
+
+    enum_field_types get_column_type(int column) {
+        return _types[column - 1];
+    }
+
+private:
+    friend class mysqlpp_spill_cursor;
+
+    static bool row_callback(mysqlpp_conn *conn, void *argument);
+
+    bool new_segment(size_t size);
+    void seal();
+    void fail(const char *what);
+
+    std::string _dir;
+    size_t _segment_size;
+
+    std::vector<spill_segment_t> _segments;
+    char *_map;  // writable mapping of the last segment
+
+    std::vector<std::string> _names;
+    std::vector<enum_field_types> _types;
+
+    uint64_t _rows;
+    uint64_t _bytes;
+
+    bool _failed;
+    std::string _error;
+
+    user_callback _cb;
+    void *_argument;
+};
+
+// 顺序读取, 同一时刻只映射一个段. 可以同时打开多个游标
+class mysqlpp_spill_cursor {
+public:
+    mysqlpp_spill_cursor(mysqlpp_spill *spill);
+    ~mysqlpp_spill_cursor();
+
+    bool next();  // move to next row, false at the end or on error
+    void rewind();
+
+    int get_column_count() {
+        return _spill->get_column_count();
+    }
+
+    // column starts from 1, nullptr for NULL. valid until next()
+    const char *get_value(int column) {
+        return _values[column - 1];
+    }
+
+    unsigned long get_length(int column) {
+        return _lengths[column - 1];
+    }
+
+private:
+    bool map_segment();
+    void unmap_segment();
+
+    mysqlpp_spill *_spill;
+
+    size_t _segment;
+    const char *_map;
+    size_t _map_size;
+    size_t _pos;
+
+    std::vector<const char *> _values;
+    std::vector<unsigned long> _lengths;
+};
+
+#endif
@@ -0,0 +1,626 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 22:00:00
+ * @modify date 2026-10-19 22:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_stmtstats.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+static inline bool is_ident_start(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' || c >= 0x80;
+}
+
+static inline bool is_ident_char(unsigned char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+static inline bool is_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static inline bool ends_with(const std::string &s, size_t end, const char *t, size_t n) {
+    return end >= n && memcmp(s.data() + end - n, t, n) == 0;
+}
+
+// 分组和列表的分隔符两边不加空格, 其它token之间都是一个空格
+static void emit(std::string &out, const char *tok, size_t n) {
+    if (!out.empty()) {
+        char prev = out[out.size() - 1];
+        char next = tok[0];
+
+        bool tight = prev == '(' || prev == '.' || prev == ',' ||
+                    next == '(' || next == ')' || next == ',' || next == '.' || next == ';';
+
+        if (!tight) {
+            out.push_back(' ');
+        }
+    }
+
+    out.append(tok, n);
+}
+
+static void emit_param(std::string &out) {
+    if (ends_with(out, out.size(), "?,...,", 6)) {
+        out.resize(out.size() - 1);  // ?,... already
+        return;
+    }
+
+    if (ends_with(out, out.size(), "?,", 2)) {
+        out.append("...");
+        return;
+    }
+
+    emit(out, "?", 1);
+}
+
+// (a,b),(a,b) => (a,b),...
+static void close_group(std::string &out, std::vector<size_t> &opens) {
+    out.push_back(')');
+
+    if (opens.empty()) {
+        return;
+    }
+
+    size_t p = opens.back();
+    opens.pop_back();
+
+    if (p == 0 || out[p - 1] != ',') {
+        return;
+    }
+
+    size_t glen = out.size() - p;
+    const char *g = out.data() + p;
+    size_t before = p - 1;
+
+    if (ends_with(out, before, ",...", 4) && ends_with(out, before - 4, g, glen)) {
+        out.resize(before);
+    } else if (ends_with(out, before, g, glen)) {
+        out.resize(before);
+        out.append(",...");
+    }
+}
+
+uint64_t mysqlpp_stmt_stats::fingerprint(const char *sql, size_t len, std::string &out) {
+    const unsigned char *s = (const unsigned char *)sql;
+    size_t i = 0;
+    std::vector<size_t> opens;
+    char lower[64];
+
+    out.clear();
+
+    while (i < len) {
+        unsigned char c = s[i];
+
+        if (is_space(c)) {
+            i++;
+            continue;
+        }
+
+        // comments
+        if (c == '#' || (c == '-' && i + 1 < len && s[i + 1] == '-' && (i + 2 == len || s[i + 2] <= ' '))) {
+            while (i < len && s[i] != '\n')
+                i++;
+            continue;
+        }
+
+        if (c == '/' && i + 1 < len && s[i + 1] == '*') {
+            i += 2;
+            while (i + 1 < len && !(s[i] == '*' && s[i + 1] == '/'))
+                i++;
+            i = i + 2 < len ? i + 2 : len;
+            continue;
+        }
+
+        // string literal, x'..', b'..', n'..', _charset'..'
+        size_t q = i;
+        if (is_ident_start(c) && (c == 'x' || c == 'X' || c == 'b' || c == 'B' || c == 'n' || c == 'N')
+                && i + 1 < len && s[i + 1] == '\'') {
+            q = i + 1;
+        } else if (c == '_') {
+            size_t k = i + 1;
+            while (k < len && is_ident_char(s[k]))
+                k++;
+            if (k < len && (s[k] == '\'' || s[k] == '"'))
+                q = k;
+        }
+
+        if (s[q] == '\'' || s[q] == '"') {
+            unsigned char quote = s[q];
+            i = q + 1;
+            while (i < len) {
+                if (s[i] == '\\') {
+                    i += 2;
+                    continue;
+                }
+                if (s[i] == quote) {
+                    if (i + 1 < len && s[i + 1] == quote) {
+                        i += 2;  // doubled quote
+                        continue;
+                    }
+                    break;
+                }
+                i++;
+            }
+            i = i + 1 < len ? i + 1 : len;
+
+            emit_param(out);
+            continue;
+        }
+
+        // quoted identifier, copy as is
+        if (c == '`') {
+            size_t start = i++;
+            while (i < len && s[i] != '`')
+                i++;
+            i = i + 1 < len ? i + 1 : len;
+
+            emit(out, sql + start, i - start);
+            continue;
+        }
+
+        // number: 12, 1.5, .5, 1e-3, 0x1f, 0b101
+        if (is_digit(c) || (c == '.' && i + 1 < len && is_digit(s[i + 1]))) {
+            size_t start = i;
+
+            if (c == '0' && i + 1 < len && (s[i + 1] == 'x' || s[i + 1] == 'b')) {
+                i += 2;
+                while (i < len && is_ident_char(s[i]))
+                    i++;
+            } else {
+                while (i < len && (is_digit(s[i]) || s[i] == '.'))
+                    i++;
+                if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+                    size_t k = i + 1;
+                    if (k < len && (s[k] == '+' || s[k] == '-'))
+                        k++;
+                    if (k < len && is_digit(s[k])) {
+                        i = k;
+                        while (i < len && is_digit(s[i]))
+                            i++;
+                    }
+                }
+            }
+
+            if (i < len && is_ident_char(s[i])) {
+                // identifier starting with digits, like 1abc
+                while (i < len && is_ident_char(s[i]))
+                    i++;
+                emit(out, sql + start, i - start);
+                continue;
+            }
+
+            emit_param(out);
+            continue;
+        }
+
+        // keyword, identifier, @var, @@var
+        if (is_ident_start(c) || c == '@') {
+            size_t start = i;
+            while (i < len && s[i] == '@')
+                i++;
+            while (i < len && is_ident_char(s[i]))
+                i++;
+
+            size_t n = i - start;
+            if (n <= sizeof(lower)) {
+                for (size_t k = 0; k < n; k++) {
+                    unsigned char ch = s[start + k];
+                    lower[k] = (ch >= 'A' && ch <= 'Z') ? ch + 32 : ch;
+                }
+                emit(out, lower, n);
+            } else {
+                emit(out, sql + start, n);
+            }
+            continue;
+        }
+
+        if (c == '(') {
+            emit(out, "(", 1);
+            opens.push_back(out.size() - 1);
+            i++;
+            continue;
+        }
+
+        if (c == ')') {
+            close_group(out, opens);  // no space before ')'
+            i++;
+            continue;
+        }
+
+        if (c == '?') {
+            emit_param(out);  // placeholder of prepared statement
+            i++;
+            continue;
+        }
+
+        // operators, two or three characters at most
+        static const char *ops[] = {"<=>", "<=", ">=", "<>", "!=", ":=", "||", "&&", "<<", ">>", "->>", "->"};
+        size_t n = 1;
+        for (unsigned int k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+            size_t m = strlen(ops[k]);
+            if (m > n && i + m <= len && memcmp(sql + i, ops[k], m) == 0) {
+                n = m;
+            }
+        }
+
+        emit(out, sql + i, n);
+        i += n;
+    }
+
+    while (!out.empty() && out[out.size() - 1] == ';') {
+        out.resize(out.size() - 1);
+    }
+
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t k = 0; k < out.size(); k++) {
+        h ^= (unsigned char)out[k];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static inline bool word_is(const char *w, size_t n, const char *kw) {
+    size_t k = strlen(kw);
+
+    if (n != k)
+        return false;
+
+    for (size_t i = 0; i < n; i++) {
+        char c = w[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 32;
+        if (c != kw[i])
+            return false;
+    }
+
+    return true;
+}
+
+bool mysqlpp_stmt_stats::parameterize(const char *sql, size_t len, std::string &shape, std::vector<stmt_literal_t> &literals) {
+    const unsigned char *s = (const unsigned char *)sql;
+    size_t i = 0;
+    size_t copied = 0;
+    bool first = true;
+    bool select_list = false;
+    bool by_clause = false;  // GROUP BY, ORDER BY, PARTITION BY: 1 is a column position
+    int depth = 0;           // parentheses
+    int by_depth = 0;        // depth of the BY
+
+    shape.clear();
+    literals.clear();
+
+    while (i < len) {
+        unsigned char c = s[i];
+
+        if (is_space(c)) {
+            i++;
+            continue;
+        }
+
+        if (c == '#' || (c == '-' && i + 1 < len && s[i + 1] == '-' && (i + 2 == len || s[i + 2] <= ' '))) {
+            while (i < len && s[i] != '\n')
+                i++;
+            continue;
+        }
+
+        if (c == '/' && i + 1 < len && s[i + 1] == '*') {
+            i += 2;
+            while (i + 1 < len && !(s[i] == '*' && s[i + 1] == '/'))
+                i++;
+            i = i + 2 < len ? i + 2 : len;
+            continue;
+        }
+
+        if (c == '?' || c == ';') {
+            return false;  // placeholders already, or multiple statements
+        }
+
+        if (c == '\'' || c == '"' || c == '`') {
+            unsigned char quote = c;
+            size_t start = i;
+            std::string text;
+
+            i++;
+            while (i < len) {
+                unsigned char ch = s[i];
+
+                if (ch == '\\' && quote != '`' && i + 1 < len) {
+                    unsigned char e = s[i + 1];
+                    switch (e) {
+                    case '0': return false;  // NUL can not be bound by set_string
+                    case 'n': text.push_back('\n'); break;
+                    case 'r': text.push_back('\r'); break;
+                    case 't': text.push_back('\t'); break;
+                    case 'b': text.push_back('\b'); break;
+                    case 'Z': text.push_back('\032'); break;
+                    case '%': case '_': text.push_back('\\'); text.push_back(e); break;  // LIKE escapes are kept
+                    default: text.push_back(e); break;
+                    }
+                    i += 2;
+                    continue;
+                }
+
+                if (ch == 0) {
+                    return false;
+                }
+
+                if (ch == quote) {
+                    if (i + 1 < len && s[i + 1] == quote) {
+                        text.push_back(quote);
+                        i += 2;
+                        continue;
+                    }
+                    break;
+                }
+
+                text.push_back(ch);
+                i++;
+            }
+
+            if (i >= len) {
+                return false;  // unterminated
+            }
+            i++;
+
+            // "..." is an identifier with ANSI_QUOTES, keep it
+            if (quote == '\'' && !select_list) {
+                shape.append(sql + copied, start - copied);
+                shape.push_back('?');
+                copied = i;
+
+                stmt_literal_t lit;
+                lit.integer = false;
+                lit.value = 0;
+                lit.text.swap(text);
+                literals.push_back(lit);
+            }
+
+            continue;
+        }
+
+        if (is_digit(c) || (c == '.' && i + 1 < len && is_digit(s[i + 1]))) {
+            size_t start = i;
+            bool integer = c != '.';
+
+            while (i < len && (is_ident_char(s[i]) || s[i] == '.')) {
+                if (!is_digit(s[i]))
+                    integer = false;
+                i++;
+            }
+
+            // exponent sign, 1e-3
+            if (i < len && (s[i] == '+' || s[i] == '-') && (s[i - 1] == 'e' || s[i - 1] == 'E')) {
+                i++;
+                while (i < len && is_digit(s[i]))
+                    i++;
+            }
+
+            bool qualified = start > 0 && s[start - 1] == '.';
+
+            if (integer && i - start <= 18 && !select_list && !by_clause && !qualified) {
+                shape.append(sql + copied, start - copied);
+                shape.push_back('?');
+                copied = i;
+
+                stmt_literal_t lit;
+                lit.integer = true;
+                lit.value = strtoll(sql + start, nullptr, 10);
+                literals.push_back(lit);
+            }
+
+            continue;
+        }
+
+        if (is_ident_start(c) || c == '@') {
+            size_t start = i;
+            while (i < len && s[i] == '@')
+                i++;
+            while (i < len && is_ident_char(s[i]))
+                i++;
+
+            const char *w = sql + start;
+            size_t n = i - start;
+
+            if (first) {
+                first = false;
+                if (!word_is(w, n, "select") && !word_is(w, n, "insert") && !word_is(w, n, "update")
+                        && !word_is(w, n, "delete") && !word_is(w, n, "replace")) {
+                    return false;
+                }
+            }
+
+            // x'..', _utf8mb4'..': introducer, the literal is kept
+            if (i < len && s[i] == '\'') {
+                i++;
+                while (i < len && s[i] != '\'')
+                    i += (s[i] == '\\') ? 2 : 1;
+                i = i + 1 < len ? i + 1 : len;
+                continue;
+            }
+
+            if (word_is(w, n, "select")) {
+                select_list = true;
+            } else if (word_is(w, n, "from") || word_is(w, n, "where") || word_is(w, n, "into")) {
+                select_list = false;
+            }
+
+            // BY的列表一直到下一个子句, 中间的标识符和函数调用都还在列表里
+            if (word_is(w, n, "by")) {
+                by_clause = true;
+                by_depth = depth;
+            } else if (by_clause && depth == by_depth && (word_is(w, n, "limit") || word_is(w, n, "having")
+                    || word_is(w, n, "window") || word_is(w, n, "for") || word_is(w, n, "union"))) {
+                by_clause = false;
+            }
+
+            continue;
+        }
+
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+            if (by_clause && depth < by_depth) {
+                by_clause = false;  // end of the subquery or OVER (...)
+            }
+        }
+
+        i++;
+    }
+
+    if (first || literals.size() > 65535) {
+        return false;
+    }
+
+    shape.append(sql + copied, len - copied);
+
+    return true;
+}
+
+mysqlpp_stmt_stats::mysqlpp_stmt_stats(int capacity)
+    : _capacity(capacity > 0 ? capacity : 1) {
+    _entries.reserve(_capacity);
+    _heap.reserve(_capacity);
+    _pos.reserve(_capacity);
+}
+
+void mysqlpp_stmt_stats::reset() {
+    _entries.clear();
+    _heap.clear();
+    _pos.clear();
+    _index.clear();
+}
+
+void mysqlpp_stmt_stats::swap_heap(int a, int b) {
+    std::swap(_heap[a], _heap[b]);
+    _pos[_heap[a]] = a;
+    _pos[_heap[b]] = b;
+}
+
+// 新条目count为0, 上浮到堆顶
+void mysqlpp_stmt_stats::sift_up(int i) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+
+        if (_entries[_heap[p]].count <= _entries[_heap[i]].count)
+            break;
+
+        swap_heap(i, p);
+        i = p;
+    }
+}
+
+// 已有条目的count只会增加, 所以只需要下沉
+void mysqlpp_stmt_stats::sift_down(int i) {
+    int n = (int)_heap.size();
+
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+
+        if (l < n && _entries[_heap[l]].count < _entries[_heap[m]].count)
+            m = l;
+        if (r < n && _entries[_heap[r]].count < _entries[_heap[m]].count)
+            m = r;
+        if (m == i)
+            break;
+
+        swap_heap(i, m);
+        i = m;
+    }
+}
+
+void mysqlpp_stmt_stats::record(uint64_t fingerprint, const std::string &text, uint64_t usec, uint64_t rows, bool failed) {
+    std::unordered_map<uint64_t, int>::iterator it = _index.find(fingerprint);
+    int e;
+
+    if (it != _index.end()) {
+        e = it->second;
+    } else if ((int)_entries.size() < _capacity) {
+        e = (int)_entries.size();
+
+        stmt_stat_t st;
+        st.fingerprint = fingerprint;
+        st.text = text;
+        st.count = 0;
+        st.error = 0;
+        st.total_usec = 0;
+        st.max_usec = 0;
+        st.rows = 0;
+        st.errors = 0;
+
+        _entries.push_back(st);
+
+        _heap.push_back(e);
+        _pos.push_back((int)_heap.size() - 1);
+        sift_up((int)_heap.size() - 1);  // count 0 is the smallest, goes up to the root
+
+        _index[fingerprint] = e;
+    } else {
+        e = _heap[0];  // evict the least frequent
+
+        stmt_stat_t &st = _entries[e];
+        _index.erase(st.fingerprint);
+
+        st.fingerprint = fingerprint;
+        st.text = text;
+        st.error = st.count;
+        st.total_usec = 0;
+        st.max_usec = 0;
+        st.rows = 0;
+        st.errors = 0;
+
+        _index[fingerprint] = e;
+    }
+
+    stmt_stat_t &st = _entries[e];
+
+    st.count++;
+    st.total_usec += usec;
+    if (usec > st.max_usec)
+        st.max_usec = usec;
+    st.rows += rows;
+    if (failed)
+        st.errors++;
+
+    sift_down(_pos[e]);
+}
+
+static uint64_t order_key(const stmt_stat_t &st, stmt_order order) {
+    switch (order) {
+    case STMT_BY_COUNT: return st.count;
+    case STMT_BY_MAX: return st.max_usec;
+    case STMT_BY_ROWS: return st.rows;
+    case STMT_BY_ERRORS: return st.errors;
+    default: return st.total_usec;
+    }
+}
+
+void mysqlpp_stmt_stats::get_top(std::vector<stmt_stat_t> &out, int n, stmt_order order) const {
+    std::vector<std::pair<uint64_t, int> > keys;
+
+    keys.reserve(_entries.size());
+    for (unsigned int i = 0; i < _entries.size(); i++) {
+        keys.push_back(std::make_pair(order_key(_entries[i], order), (int)i));
+    }
+
+    if (n > (int)keys.size())
+        n = (int)keys.size();
+
+    std::partial_sort(keys.begin(), keys.begin() + n, keys.end(),
+        [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) { return a.first > b.first; });
+
+    out.clear();
+    for (int i = 0; i < n; i++) {
+        out.push_back(_entries[keys[i].second]);
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-19 22:00:00
+ * @modify date 2026-10-19 22:00:00
+ * @desc [语句指纹和top-N统计: 去掉字面量的归一化sql, space-saving算法固定内存]
+ */
+
+#ifndef __mysql_stmtstats_h__
+#define __mysql_stmtstats_h__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <stddef.h>
+
+static const int def_stmt_stats_capacity = 256;
+
+typedef struct stmt_stat_s {
+    uint64_t fingerprint;
+    std::string text;     // normalized sql
+
+    uint64_t count;
+    uint64_t error;       // count may be overestimated by at most this value (space-saving)
+
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t rows;
+    uint64_t errors;
+} stmt_stat_t;
+
+// 从sql里提取出来的字面量, 作为预处理语句的参数
+typedef struct stmt_literal_s {
+    bool integer;
+    long long value;
+    std::string text;  // unescaped string
+} stmt_literal_t;
+
+enum stmt_order {
+    STMT_BY_COUNT,
+    STMT_BY_TOTAL,
+    STMT_BY_MAX,
+    STMT_BY_ROWS,
+    STMT_BY_ERRORS
+};
+
+/*
+ 最多保留capacity条语句. 表满时新语句替换count最小的那条, 继承它的count(记入error),
+ 其余统计从0开始. 频繁出现的语句一定会留在表里, 开销和不同语句的数量无关.
+*/
+class mysqlpp_stmt_stats {
+public:
+    mysqlpp_stmt_stats(int capacity = def_stmt_stats_capacity);
+
+    void record(uint64_t fingerprint, const std::string &text, uint64_t usec, uint64_t rows, bool failed);
+
+    // the n largest entries by order
+    void get_top(std::vector<stmt_stat_t> &out, int n, stmt_order order = STMT_BY_TOTAL) const;
+
+    void reset();
+
+    int size() const {
+        return (int)_entries.size();
+    }
+
+    // 单遍扫描: 字符串/数字/十六进制等字面量替换为?, 去掉注释, 统一空白和大小写,
+    // 连续的?列表和相同的括号分组折叠为",...". 返回归一化文本的64位hash
+    static uint64_t fingerprint(const char *sql, size_t len, std::string &normalized);
+
+    // 把单引号字符串和整数字面量替换为?, 其它部分原样保留, 用于自动预处理.
+    // 只处理SELECT/INSERT/UPDATE/DELETE/REPLACE单条语句; select列表和ORDER/GROUP BY里的字面量不替换,
+    // 避免改变列名和语义. 不适合时返回false
+    static bool parameterize(const char *sql, size_t len, std::string &shape, std::vector<stmt_literal_t> &literals);
+
+private:
+    void sift_up(int i);
+    void sift_down(int i);
+    void swap_heap(int a, int b);
+
+    int _capacity;
+
+    std::vector<stmt_stat_t> _entries;
+    std::vector<int> _heap;  // min heap of entry index by count
+    std::vector<int> _pos;   // entry index -> heap position
+    std::unordered_map<uint64_t, int> _index;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 14:00:00
+ * @modify date 2026-10-20 14:00:00
+ * @desc [description]
+ */
+#include "mysqlpp_transaction.h"
+
+mysqlpp_transaction::mysqlpp_transaction(mysqlpp_conn *conn)
+    : _conn(conn),
+      _begun(false),
+      _finished(false),
+      _failed(false),
+      _ending(false),
+      _rollback_on_error(true),
+      _cb(nullptr),
+      _argument(nullptr) {
+}
+
+mysqlpp_transaction::~mysqlpp_transaction() {
+}
+
+std::string mysqlpp_transaction::quote_name(const std::string &name) {
+    std::string s = "`";
+
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == '`')
+            s += '`';
+        s += name[i];
+    }
+
+    return s + "`";
+}
+
+void mysqlpp_transaction::query(std::string &sql, user_callback cb, void *argument) {
+    issue(sql, false, cb, argument);
+}
+
+void mysqlpp_transaction::savepoint(const std::string &name) {
+    _pending.push_back("SAVEPOINT " + quote_name(name));
+}
+
+void mysqlpp_transaction::rollback_to(const std::string &name) {
+    _pending.push_back("ROLLBACK TO SAVEPOINT " + quote_name(name));
+}
+
+void mysqlpp_transaction::commit(std::string &sql, user_callback cb, void *argument) {
+    issue(sql, true, cb, argument);
+}
+
+void mysqlpp_transaction::commit(user_callback cb, void *argument) {
+    if (!_begun || _finished) {
+        finish_empty(cb, argument);
+        return;
+    }
+
+    issue(std::string(), true, cb, argument);
+}
+
+void mysqlpp_transaction::rollback(user_callback cb, void *argument) {
+    _pending.clear();  // nothing to undo that was not sent
+
+    if (!_begun || _finished) {
+        finish_empty(cb, argument);
+        return;
+    }
+
+    _finished = true;
+    _ending = true;
+
+    _cb = cb;
+    _argument = argument;
+
+    std::vector<std::string> batch(1, "ROLLBACK");
+
+    _conn->set_user_callback(&mysqlpp_transaction::statement_callback);
+    _conn->set_user_argument(this);
+    _conn->query_batch(batch, 0);
+}
+
+// nothing was sent, the callback runs before returning like a statement without result set
+void mysqlpp_transaction::finish_empty(user_callback cb, void *argument) {
+    _pending.clear();
+    _finished = true;
+
+    cb(_conn, argument);
+}
+
+// 一个事务步骤: 还没BEGIN就放在最前面, 接着待发送的SAVEPOINT, 然后是语句, commit时最后是COMMIT
+void mysqlpp_transaction::issue(const std::string &sql, bool commit, user_callback cb, void *argument) {
+    if (_finished) {
+        // the handle starts another transaction on the same connection
+        _begun = false;
+        _finished = false;
+        _failed = false;
+        _error.clear();
+    }
+
+    std::vector<std::string> batch;
+
+    if (!_begun) {
+        batch.push_back("BEGIN");
+        _begun = true;
+    }
+
+    batch.insert(batch.end(), _pending.begin(), _pending.end());
+    _pending.clear();
+
+    size_t user = batch.size();
+
+    if (commit) {
+        if (!sql.empty()) {
+            batch.push_back(sql);
+        }
+        batch.push_back("COMMIT");  // the user's statement when sql is empty
+
+        _ending = true;
+    } else {
+        batch.push_back(sql);
+    }
+
+    _cb = cb;
+    _argument = argument;
+
+    _conn->set_idempotent(false);  // a retried statement would run outside the rolled back transaction
+    _conn->set_user_callback(&mysqlpp_transaction::statement_callback);
+    _conn->set_user_argument(this);
+    _conn->query_batch(batch, user);
+}
+
+// 行直接交给用户, 最后一次回调之前结算事务状态
+bool mysqlpp_transaction::statement_callback(mysqlpp_conn *conn, void *argument) {
+    mysqlpp_transaction *t = (mysqlpp_transaction *)argument;
+
+    if (!conn->failed() && !conn->result_eof() && conn->get_column_count() != 0) {
+        return t->_cb(conn, t->_argument);
+    }
+
+    if (conn->failed() && t->_rollback_on_error && !t->_finished) {
+        t->_error = conn->error();
+        t->_failed = true;
+        t->_finished = true;
+        t->_ending = false;
+
+        std::vector<std::string> batch(1, "ROLLBACK");
+
+        conn->set_user_callback(&mysqlpp_transaction::rollback_callback);
+        conn->query_batch(batch, 0);
+        return true;
+    }
+
+    if (t->_ending) {
+        t->_ending = false;
+        if (!conn->failed())
+            t->_finished = true;  // a failed statement before COMMIT leaves it open
+    }
+
+    return t->_cb(conn, t->_argument);
+}
+
+// the statement's error, not the ROLLBACK's result
+bool mysqlpp_transaction::rollback_callback(mysqlpp_conn *conn, void *argument) {
+    mysqlpp_transaction *t = (mysqlpp_transaction *)argument;
+
+    conn->_failed = true;
+    conn->_sb = t->_error;
+
+    return t->_cb(conn, t->_argument);
+}
@@ -0,0 +1,89 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 14:00:00
+ * @modify date 2026-10-20 14:00:00
+ * @desc [固定在一个连接上的事务: BEGIN随第一条语句, COMMIT随最后一条语句发送, 出错自动回滚]
+ */
+
+#ifndef __mysql_transaction_h__
+#define __mysql_transaction_h__
+
+#include <string>
+#include <vector>
+#include "mysqlpp_conn.h"
+
+/*
+ 读-改-写事务只要两个往返:
+   txn.query("SELECT ... FOR UPDATE")   ->  BEGIN; SELECT ... FOR UPDATE
+   txn.commit("UPDATE ...")             ->  UPDATE ...; COMMIT
+ pool需要set_pipelined_transactions(true), 否则BEGIN/COMMIT逐条发送, 结果相同.
+ savepoint/rollback_to不单独发送, 和下一条语句一起. 用户回调和mysqlpp_conn相同, 只看到自己语句的行和结果,
+ 最后一次回调在COMMIT完成之后. 出错时(默认)先ROLLBACK再回调, failed()和error()仍然是原来的错误.
+ 事务结束之前不要close连接, 也不要在行回调里提前返回true, 剩下的结果会阻塞后面的语句.
+*/
+class mysqlpp_transaction {
+public:
+    mysqlpp_transaction(mysqlpp_conn *conn);
+    ~mysqlpp_transaction();
+
+    mysqlpp_conn *get_connection() {
+        return _conn;
+    }
+
+    // default on. off: a failed statement leaves the transaction open, rollback_to() or rollback() it
+    void set_rollback_on_error(bool on) {
+        _rollback_on_error = on;
+    }
+
+    void query(std::string &sql, user_callback cb, void *argument);
+
+    // sent in front of the next statement
+    void savepoint(const std::string &name);
+    void rollback_to(const std::string &name);
+
+    void commit(std::string &sql, user_callback cb, void *argument);  // sql then COMMIT
+    void commit(user_callback cb, void *argument);
+    void rollback(user_callback cb, void *argument);
+
+    // BEGIN sent, not committed or rolled back yet
+    bool active() {
+        return _begun && !_finished;
+    }
+
+    // rolled back because a statement failed
+    bool failed() {
+        return _failed;
+    }
+
+    const char *error() {
+        return _error.c_str();
+    }
+
+private:
+    static bool statement_callback(mysqlpp_conn *conn, void *argument);
+    static bool rollback_callback(mysqlpp_conn *conn, void *argument);
+
+    void issue(const std::string &sql, bool commit, user_callback cb, void *argument);
+    void finish_empty(user_callback cb, void *argument);
+
+    static std::string quote_name(const std::string &name);
+
+private:
+    mysqlpp_conn *_conn;
+
+    bool _begun;
+    bool _finished;
+    bool _failed;
+    bool _ending;  // commit or rollback in flight
+    bool _rollback_on_error;
+
+    std::vector<std::string> _pending;  // SAVEPOINT, ROLLBACK TO
+
+    user_callback _cb;
+    void *_argument;
+
+    std::string _error;
+};
+
+#endif
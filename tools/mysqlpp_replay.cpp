@@ -0,0 +1,411 @@
+/**
+ * @author rench
+ * @email finyren@163.com
+ * @create date 2026-10-20 11:00:00
+ * @modify date 2026-10-20 11:00:00
+ * @desc [回放mysqlpp_recorder录制的日志: 保持原来的连接并发和时间间隔(可加速), 输出延迟分布]
+ */
+#include <deque>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <event2/event.h>
+#include "mysqlpp_pool.h"
+#include "mysqlpp_conn.h"
+#include "mysqlpp_recorder.h"
+
+class replayer;
+
+// 录制日志里的一个连接, 请求按顺序串行执行, 到期时上一个请求还没结束就排队
+typedef struct replay_session_s {
+    replayer *r;
+    uint32_t id;
+    mysqlpp_conn *conn;
+    bool busy;
+    record_type running;
+    uint64_t issued;
+    std::deque<record_t> pending;
+} replay_session_t;
+
+class replayer {
+public:
+    replayer(struct event_base *base, mysqlpp_pool *pool, mysqlpp_record_reader *reader, double speed)
+        : _base(base),
+          _pool(pool),
+          _reader(reader),
+          _speed(speed),
+          _start(0),
+          _has_next(false),
+          _eof(false),
+          _rows(0),
+          _errors(0),
+          _late(0) {
+        _timer = event_new(base, -1, 0, &replayer::timer_callback, this);
+    }
+
+    ~replayer() {
+        event_free(_timer);
+
+        std::map<uint32_t, replay_session_t *>::iterator it;
+        for (it = _sessions.begin(); it != _sessions.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    void start() {
+        _start = mysqlpp_conn::now_usec();
+        schedule();
+    }
+
+    void report();
+
+private:
+    static void timer_callback(evutil_socket_t fd, short what, void *argument);
+    static bool result_callback(mysqlpp_conn *conn, void *argument);
+    static bool prepare_callback(mysqlpp_conn *conn, void *argument);
+
+    void schedule();
+    void dispatch(record_t &rec);
+    void run(replay_session_t *s);
+    void finished(replay_session_t *s, bool failed);
+    void maybe_done();
+
+    replay_session_t *session(uint32_t id);
+
+private:
+    struct event_base *_base;
+    mysqlpp_pool *_pool;
+    mysqlpp_record_reader *_reader;
+    double _speed;
+
+    struct event *_timer;
+    uint64_t _start;
+
+    record_t _next;
+    bool _has_next;
+    bool _eof;
+
+    std::map<uint32_t, replay_session_t *> _sessions;
+
+    mysqlpp_histogram _latency[RECORD_CLOSE + 1];  // by record type, replayed
+    mysqlpp_histogram _original;                   // DONE records
+    mysqlpp_histogram _lag;                        // issued later than scheduled
+
+    uint64_t _rows;
+    uint64_t _errors;
+    uint64_t _late;
+};
+
+replay_session_t *replayer::session(uint32_t id) {
+    std::map<uint32_t, replay_session_t *>::iterator it = _sessions.find(id);
+    if (it != _sessions.end()) {
+        return it->second;
+    }
+
+    replay_session_t *s = new replay_session_t;
+    s->r = this;
+    s->id = id;
+    s->conn = nullptr;
+    s->busy = false;
+    s->running = RECORD_QUERY;
+    s->issued = 0;
+
+    _sessions[id] = s;
+
+    return s;
+}
+
+void replayer::timer_callback(evutil_socket_t fd, short what, void *argument) {
+    ((replayer *)argument)->schedule();
+}
+
+// 把到期的记录交给各自的连接, 再为下一条记录设置定时器. 日志是流式读取的, 只预读一条
+void replayer::schedule() {
+    for (;;) {
+        if (!_has_next) {
+            if (!_reader->next(_next)) {
+                _eof = true;
+                if (*_reader->error()) {
+                    fprintf(stderr, "replay: %s, stop reading\n", _reader->error());
+                }
+                maybe_done();
+                return;
+            }
+            _has_next = true;
+        }
+
+        uint64_t due = _start + (uint64_t)(_next.offset / _speed);
+        uint64_t now = mysqlpp_conn::now_usec();
+
+        if (due > now) {
+            struct timeval tv;
+            tv.tv_sec = (due - now) / 1000000;
+            tv.tv_usec = (due - now) % 1000000;
+            event_add(_timer, &tv);
+            return;
+        }
+
+        _has_next = false;
+        dispatch(_next);
+    }
+}
+
+void replayer::dispatch(record_t &rec) {
+    if (rec.type == RECORD_DONE) {
+        _original.record(rec.elapsed);
+        return;
+    }
+
+    replay_session_t *s = session(rec.conn);
+
+    s->pending.push_back(record_t());
+    s->pending.back().type = rec.type;
+    s->pending.back().offset = rec.offset;
+    s->pending.back().sql.swap(rec.sql);
+    s->pending.back().params.swap(rec.params);
+
+    if (!s->busy) {
+        run(s);
+    }
+}
+
+void replayer::run(replay_session_t *s) {
+    while (!s->pending.empty()) {
+        record_t &rec = s->pending.front();
+        uint64_t now = mysqlpp_conn::now_usec();
+        uint64_t due = _start + (uint64_t)(rec.offset / _speed);
+
+        if (rec.type == RECORD_CLOSE) {
+            if (s->conn) {
+                s->conn->close();
+                s->conn = nullptr;
+            }
+            s->pending.pop_front();
+            continue;
+        }
+
+        if (now > due) {
+            _lag.record(now - due);
+            if (now - due > 1000)
+                _late++;
+        }
+
+        if (!s->conn) {
+            s->conn = _pool->get_connection();
+            s->conn->set_user_argument(s);
+        }
+
+        s->busy = true;
+        s->running = rec.type;
+        s->issued = now;
+
+        mysqlpp_conn *conn = s->conn;
+
+        switch (rec.type) {
+        case RECORD_QUERY:
+            conn->set_user_callback(&replayer::result_callback);
+            conn->query(rec.sql);
+            break;
+
+        case RECORD_PREPARE:
+            conn->set_user_callback(&replayer::prepare_callback);
+            conn->prepare(rec.sql);
+            break;
+
+        case RECORD_EXECUTE: {
+            mysqlpp_bind *bind = conn->get_exec_bind();
+
+            for (size_t i = 0; bind && i < rec.params.size(); i++) {
+                const record_param_t &p = rec.params[i];
+                int index = (int)i + 1;
+
+                switch (p.type) {
+                case RECORD_PARAM_INT: bind->set_int(index, (int)p.integer); break;
+                case RECORD_PARAM_LLONG: bind->set_llong(index, p.integer); break;
+                case RECORD_PARAM_DOUBLE: bind->set_double(index, p.real); break;
+                case RECORD_PARAM_TIMESTAMP: bind->set_timestamp(index, (time_t)p.integer); break;
+                case RECORD_PARAM_STRING: bind->set_string(index, p.data.data(), p.data.size()); break;
+                case RECORD_PARAM_BLOB: bind->set_blob(index, p.data.data(), (int)p.data.size()); break;
+                default: bind->set_string(index, nullptr); break;
+                }
+            }
+
+            // the parameters are read by execute(), the record is kept until the request finished
+            conn->set_user_callback(&replayer::result_callback);
+            conn->execute();
+            break;
+        }
+
+        default:
+            s->busy = false;
+            s->pending.pop_front();
+            continue;
+        }
+
+        return;
+    }
+}
+
+void replayer::finished(replay_session_t *s, bool failed) {
+    _latency[s->running].record(mysqlpp_conn::now_usec() - s->issued);
+
+    if (failed) {
+        if (_errors++ < 10) {
+            fprintf(stderr, "replay: connection %u: %s\n", s->id, s->conn->error());
+        }
+    }
+
+    s->busy = false;
+    s->pending.pop_front();
+
+    if (failed) {
+        // the connection may be broken, the next request of the session takes another one
+        s->conn->close();
+        s->conn = nullptr;
+    }
+
+    run(s);
+
+    if (!s->busy) {
+        maybe_done();
+    }
+}
+
+bool replayer::result_callback(mysqlpp_conn *conn, void *argument) {
+    replay_session_t *s = (replay_session_t *)argument;
+
+    if (conn->failed() || conn->result_eof() || conn->get_column_count() == 0) {
+        s->r->finished(s, conn->failed());
+        return true;
+    }
+
+    s->r->_rows++;
+
+    return false;
+}
+
+bool replayer::prepare_callback(mysqlpp_conn *conn, void *argument) {
+    replay_session_t *s = (replay_session_t *)argument;
+
+    s->r->finished(s, conn->failed());
+
+    return true;
+}
+
+void replayer::maybe_done() {
+    if (!_eof) {
+        return;
+    }
+
+    std::map<uint32_t, replay_session_t *>::iterator it;
+    for (it = _sessions.begin(); it != _sessions.end(); ++it) {
+        if (it->second->busy || !it->second->pending.empty())
+            return;
+    }
+
+    // all sessions idle: give back the connections, then the loop runs out of events
+    for (it = _sessions.begin(); it != _sessions.end(); ++it) {
+        if (it->second->conn) {
+            it->second->conn->close();
+            it->second->conn = nullptr;
+        }
+    }
+}
+
+static void print_histogram(const char *name, const mysqlpp_histogram &h) {
+    if (!h.count()) {
+        return;
+    }
+
+    printf("%-10s count %-9llu mean %-9.0f p50 %-9llu p90 %-9llu p99 %-9llu p99.9 %-9llu max %llu\n",
+        name, (unsigned long long)h.count(), h.mean(),
+        (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+        (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+        (unsigned long long)h.max());
+}
+
+void replayer::report() {
+    double wall = (mysqlpp_conn::now_usec() - _start) / 1e6;
+    uint64_t requests = _latency[RECORD_QUERY].count() + _latency[RECORD_EXECUTE].count();
+
+    printf("replayed %zu connections at %.2fx in %.3f s, %.0f requests/s, %llu rows, %llu errors\n",
+        _sessions.size(), _speed, wall, requests / wall, (unsigned long long)_rows, (unsigned long long)_errors);
+    printf("latency in microseconds\n");
+
+    print_histogram("query", _latency[RECORD_QUERY]);
+    print_histogram("prepare", _latency[RECORD_PREPARE]);
+    print_histogram("execute", _latency[RECORD_EXECUTE]);
+    print_histogram("original", _original);
+    print_histogram("lag", _lag);
+
+    if (_late) {
+        printf("%llu requests started more than 1 ms late, connections were busy or the replayer is saturated\n",
+            (unsigned long long)_late);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s -f log -h host [-P port] [-u user] [-p password] [-d dbname]\n"
+        "          [-s speed, 1 for original pace] [-c max_conn]\n", name);
+}
+
+int main(int argc, char **argv) {
+    std::string path;
+    std::string host;
+    std::string user = "root";
+    std::string passwd;
+    std::string dbname;
+    int port = 3306;
+    int max_conn = 1024;
+    double speed = 1.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:h:P:u:p:d:s:c:")) != -1) {
+        switch (opt) {
+        case 'f': path = optarg; break;
+        case 'h': host = optarg; break;
+        case 'P': port = atoi(optarg); break;
+        case 'u': user = optarg; break;
+        case 'p': passwd = optarg; break;
+        case 'd': dbname = optarg; break;
+        case 's': speed = atof(optarg); break;
+        case 'c': max_conn = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (path.empty() || host.empty() || speed <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mysqlpp_record_reader reader;
+    if (!reader.open(path)) {
+        fprintf(stderr, "%s\n", reader.error());
+        return 1;
+    }
+
+    mysqlpp_pool::init_library(0, nullptr);
+
+    struct event_base *base = event_base_new();
+    mysqlpp_pool *pool = new mysqlpp_pool(base, host, port, user, passwd, dbname, max_conn, max_conn);
+
+    replayer *r = new replayer(base, pool, &reader, speed);
+
+    r->start();
+    event_base_dispatch(base);
+
+    r->report();
+
+    delete r;
+    delete pool;
+    event_base_free(base);
+
+    return 0;
+}